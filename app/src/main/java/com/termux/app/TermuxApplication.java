@@ -16,6 +16,7 @@ import com.termux.shared.termux.shell.command.environment.TermuxShellEnvironment
 import com.termux.shared.termux.shell.am.TermuxAmSocketServer;
 import com.termux.shared.termux.shell.TermuxShellManager;
 import com.termux.shared.termux.theme.TermuxThemeUtils;
+import com.termux.terminal.TerminalSession;
 
 public class TermuxApplication extends Application {
 
@@ -24,6 +25,9 @@ public class TermuxApplication extends Application {
     public void onCreate() {
         super.onCreate();
 
+        // Fork the helper that terminal sessions are spawned from while the app process is still small
+        TerminalSession.startSpawnHelper();
+
         Context context = getApplicationContext();
 
         // Set crash handler for the app
@@ -0,0 +1,178 @@
+#!/usr/bin/env python3
+"""
+Generates the three-stage width lookup tables WcWidthTable.java and wcwidth_table.h from the interval tables in
+WcWidth.java, which stay the source kept in sync with https://github.com/termux/wcwidth.
+
+A code point is looked up as
+    stage3[stage2[stage1[cp >> 10] << 5 | (cp >> 5) & 31] << 5 | cp & 31]
+where stage3 holds the widths of deduplicated blocks of 32 code points and stage2 the deduplicated blocks of 32 such
+block indices, so that every stage fits in bytes.
+
+Run with `./gradlew :terminal-emulator:generateWcWidthTable` or directly, after changing WcWidth.java.
+"""
+
+import os
+import re
+
+MODULE_DIR = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+JAVA_DIR = os.path.join(MODULE_DIR, "src", "main", "java", "com", "termux", "terminal")
+WCWIDTH_JAVA = os.path.join(JAVA_DIR, "WcWidth.java")
+TABLE_JAVA = os.path.join(JAVA_DIR, "WcWidthTable.java")
+TABLE_HEADER = os.path.join(MODULE_DIR, "src", "main", "jni", "wcwidth_table.h")
+
+MAX_CODE_POINT = 0x10FFFF
+STAGE1_SHIFT = 10
+BLOCK_SHIFT = 5
+BLOCK_SIZE = 1 << BLOCK_SHIFT
+
+GENERATED_NOTE = "Generated by terminal-emulator/scripts/generate-wcwidth-table.py from WcWidth.java, do not edit."
+
+
+def read_intervals(source, name):
+    body = source[source.index(name + " = {"):]
+    body = body[:body.index("};")]
+    return [(int(start, 16), int(end, 16)) for start, end in re.findall(r"\{(0x[0-9a-f]+), (0x[0-9a-f]+)\}", body)]
+
+
+def compute_widths(source):
+    """The widths of all code points, as WcWidth.widthFromIntervals() computes them."""
+    widths = [1] * (MAX_CODE_POINT + 1)
+    for start, end in read_intervals(source, "WIDE_EASTASIAN"):
+        widths[start:end + 1] = [2] * (end + 1 - start)
+    for start, end in read_intervals(source, "ZERO_WIDTH"):
+        widths[start:end + 1] = [0] * (end + 1 - start)
+    zero = [0, 0x034F, 0x2028, 0x2029]
+    zero += list(range(0x200B, 0x200F + 1)) + list(range(0x202A, 0x202E + 1)) + list(range(0x2060, 0x2063 + 1))
+    zero += list(range(0, 32)) + list(range(0x7F, 0xA0))
+    for code_point in zero:
+        widths[code_point] = 0
+    return widths
+
+
+def deduplicate(values, block_size):
+    """Split values into blocks, returning the index of each block and the concatenated unique blocks."""
+    unique = {}
+    indices = []
+    for i in range(0, len(values), block_size):
+        indices.append(unique.setdefault(tuple(values[i:i + block_size]), len(unique)))
+    blocks = []
+    for block in sorted(unique, key=unique.get):
+        blocks.extend(block)
+    return indices, blocks
+
+
+def build_stages(widths):
+    stage2_indices, stage3 = deduplicate(widths, BLOCK_SIZE)
+    stage1, stage2 = deduplicate(stage2_indices, BLOCK_SIZE)
+    assert len(stage1) == (MAX_CODE_POINT + 1) >> STAGE1_SHIFT
+    assert max(stage1) < 256 and max(stage2) < 256, "stages do not fit in bytes"
+    return stage1, stage2, stage3
+
+
+def java_string(values, digits, indent):
+    text = "".join(format(value, "0%dx" % digits) for value in values)
+    lines = [text[i:i + 112] for i in range(0, len(text), 112)]
+    return ("\n" + indent + "+ ").join('"%s"' % line for line in lines)
+
+
+def write_java(stage1, stage2, stage3):
+    indent = " " * 8
+    with open(TABLE_JAVA, "w") as out:
+        out.write("""package com.termux.terminal;
+
+// %s
+
+/**
+ * Three-stage lookup table of {@link WcWidth#width(int)}, answering it with three array loads. The stages are encoded
+ * as hex strings to keep the class initializer small.
+ */
+final class WcWidthTable {
+
+    private static final byte[] STAGE1 = decode(
+        %s, 2);
+
+    private static final byte[] STAGE2 = decode(
+        %s, 2);
+
+    private static final byte[] STAGE3 = decode(
+        %s, 1);
+
+    private WcWidthTable() {
+    }
+
+    private static byte[] decode(String hex, int digits) {
+        byte[] values = new byte[hex.length() / digits];
+        for (int i = 0; i < values.length; i++) {
+            int value = 0;
+            for (int j = 0; j < digits; j++)
+                value = (value << 4) | Character.digit(hex.charAt(i * digits + j), 16);
+            values[i] = (byte) value;
+        }
+        return values;
+    }
+
+    /** The width of a code point from 0 to 0x10FFFF. */
+    static int width(int codePoint) {
+        int block = STAGE2[((STAGE1[codePoint >> %d] & 0xFF) << %d) | ((codePoint >> %d) & %d)] & 0xFF;
+        return STAGE3[(block << %d) | (codePoint & %d)];
+    }
+
+}
+""" % (GENERATED_NOTE, java_string(stage1, 2, indent), java_string(stage2, 2, indent), java_string(stage3, 1, indent),
+       STAGE1_SHIFT, BLOCK_SHIFT, BLOCK_SHIFT, BLOCK_SIZE - 1, BLOCK_SHIFT, BLOCK_SIZE - 1))
+
+
+def c_array(values):
+    lines = []
+    for i in range(0, len(values), 24):
+        lines.append("    " + ", ".join("%d" % value for value in values[i:i + 24]) + ",")
+    return "\n".join(lines)
+
+
+def write_header(stage1, stage2, stage3):
+    with open(TABLE_HEADER, "w") as out:
+        out.write("""/* %s */
+
+#ifndef TERMUX_WCWIDTH_TABLE_H
+#define TERMUX_WCWIDTH_TABLE_H
+
+#include <stdint.h>
+
+/* Three-stage lookup table of the terminal display width of code points, see WcWidth.java. */
+
+static const uint8_t termux_wcwidth_stage1[%d] = {
+%s
+};
+
+static const uint8_t termux_wcwidth_stage2[%d] = {
+%s
+};
+
+static const uint8_t termux_wcwidth_stage3[%d] = {
+%s
+};
+
+/* The display width of a code point: 0, 1 or 2. */
+static inline int termux_wcwidth(uint32_t code_point)
+{
+    if (code_point > 0x%X) return 1;
+    uint32_t block = termux_wcwidth_stage2[(termux_wcwidth_stage1[code_point >> %d] << %d) | ((code_point >> %d) & %d)];
+    return termux_wcwidth_stage3[(block << %d) | (code_point & %d)];
+}
+
+#endif
+""" % (GENERATED_NOTE, len(stage1), c_array(stage1), len(stage2), c_array(stage2), len(stage3), c_array(stage3),
+       MAX_CODE_POINT, STAGE1_SHIFT, BLOCK_SHIFT, BLOCK_SHIFT, BLOCK_SIZE - 1, BLOCK_SHIFT, BLOCK_SIZE - 1))
+
+
+def main():
+    with open(WCWIDTH_JAVA) as f:
+        source = f.read()
+    stage1, stage2, stage3 = build_stages(compute_widths(source))
+    write_java(stage1, stage2, stage3)
+    write_header(stage1, stage2, stage3)
+    print("Stages of %d, %d and %d bytes" % (len(stage1), len(stage2), len(stage3)))
+
+
+if __name__ == "__main__":
+    main()
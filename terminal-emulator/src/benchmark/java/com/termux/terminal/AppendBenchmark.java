@@ -0,0 +1,61 @@
+package com.termux.terminal;
+
+import java.nio.charset.StandardCharsets;
+
+/**
+ * Prints how fast {@link TerminalEmulator#append(byte[], int)} processes output, both in whole buffers and, as a
+ * baseline for processing byte by byte, one byte per call.
+ */
+public class AppendBenchmark extends TerminalTestCase {
+
+	/** Typical output, mostly ASCII with some colors and line breaks. */
+	public void testAsciiThroughput() {
+		StringBuilder builder = new StringBuilder();
+		for (int i = 0; i < 1000; i++) {
+			builder.append("[ 42%] Building CXX object src/CMakeFiles/target.dir/file").append(i).append(".cpp.o\r\n");
+			if (i % 10 == 0) builder.append("\033[32mok\033[0m\r\n");
+		}
+		printThroughput("ASCII", builder.toString());
+	}
+
+	/** Output dominated by two, three and four byte UTF-8 sequences. */
+	public void testUtf8Throughput() {
+		printThroughput("Latin-1", repeatLines("Größenänderung für Überprüfung déjà vu naïve façade"));
+		printThroughput("CJK", repeatLines("日本語のテキストと中文文本和한국어텍스트"));
+		printThroughput("Emoji", repeatLines("😀😃😄😁😆😅😂🤣🥲😊😇🙂🙃😉😌😍🥰😘"));
+	}
+
+	private static String repeatLines(String line) {
+		StringBuilder builder = new StringBuilder();
+		for (int i = 0; i < 1000; i++)
+			builder.append(line).append("\r\n");
+		return builder.toString();
+	}
+
+	private static void printThroughput(String workload, String output) {
+		byte[] bytes = output.getBytes(StandardCharsets.UTF_8);
+		TerminalEmulator terminal = new TerminalEmulator(new MockTerminalOutput(), 80, 24, INITIAL_CELL_WIDTH_PIXELS, INITIAL_CELL_HEIGHT_PIXELS, 1000, null);
+
+		long totalBytes = 0;
+		long start = System.nanoTime();
+		while (System.nanoTime() - start < 500_000_000L) {
+			terminal.append(bytes, bytes.length);
+			totalBytes += bytes.length;
+		}
+		double bulk = totalBytes * 1000.0 / (System.nanoTime() - start);
+
+		byte[] oneByte = new byte[1];
+		totalBytes = 0;
+		start = System.nanoTime();
+		while (System.nanoTime() - start < 500_000_000L) {
+			for (byte b : bytes) {
+				oneByte[0] = b;
+				terminal.append(oneByte, 1);
+			}
+			totalBytes += bytes.length;
+		}
+		double bytewise = totalBytes * 1000.0 / (System.nanoTime() - start);
+		System.out.printf("TerminalEmulator.append() of %s: %.1f MB/s, byte by byte %.1f MB/s%n", workload, bulk, bytewise);
+	}
+
+}
@@ -0,0 +1,50 @@
+package com.termux.terminal;
+
+import junit.framework.TestCase;
+
+/** Compares the throughput of {@link ByteRing} with the {@link ByteQueue} it replaced, at the terminal's queue size. */
+public class ByteRingBenchmark extends TestCase {
+
+	private static final int COUNT = 32 * 1024 * 1024;
+	private static final int ROUNDS = 3;
+
+	public void testThroughputAgainstByteQueue() throws InterruptedException {
+		long ringNanos = Long.MAX_VALUE;
+		long queueNanos = Long.MAX_VALUE;
+		for (int round = 0; round < ROUNDS; round++) {
+			final ByteRing ring = new ByteRing(4096, 4096);
+			long start = System.nanoTime();
+			Thread producer = startProducer((chunk, length) -> ring.write(chunk, 0, length));
+			byte[] buffer = new byte[4096];
+			for (int read = 0; read < COUNT; )
+				read += ring.read(buffer, true);
+			producer.join();
+			ringNanos = Math.min(ringNanos, System.nanoTime() - start);
+
+			final ByteQueue queue = new ByteQueue(4096);
+			start = System.nanoTime();
+			producer = startProducer((chunk, length) -> queue.write(chunk, 0, length));
+			for (int read = 0; read < COUNT; )
+				read += queue.read(buffer, true);
+			producer.join();
+			queueNanos = Math.min(queueNanos, System.nanoTime() - start);
+		}
+		System.out.printf("ByteRing: %.0f MB/s, ByteQueue: %.0f MB/s%n", COUNT * 1000.0 / ringNanos, COUNT * 1000.0 / queueNanos);
+	}
+
+	private interface Writer {
+		void write(byte[] chunk, int length);
+	}
+
+	/** Write COUNT bytes in chunks of the size of a typical paste or key burst on a new thread. */
+	private static Thread startProducer(Writer writer) {
+		Thread producer = new Thread(() -> {
+			byte[] chunk = new byte[1000];
+			for (int written = 0; written < COUNT; written += chunk.length)
+				writer.write(chunk, Math.min(chunk.length, COUNT - written));
+		});
+		producer.start();
+		return producer;
+	}
+
+}
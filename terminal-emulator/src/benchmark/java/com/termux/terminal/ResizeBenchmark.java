@@ -0,0 +1,28 @@
+package com.termux.terminal;
+
+/** Prints how long resizing takes, before and after reflowing the rest of the transcript, against its size. */
+public class ResizeBenchmark extends TerminalTestCase {
+
+	public void testResizeTimeAgainstTranscriptSize() {
+		StringBuilder line = new StringBuilder();
+		for (int i = 0; i < 60; i++)
+			line.append((char) ('a' + i % 26));
+		byte[] bytes = (line + "\r\n").getBytes();
+		for (int transcriptRows : new int[]{1000, 5000, 20000}) {
+			TerminalEmulator emulator = new TerminalEmulator(mOutput, 80, 40, INITIAL_CELL_WIDTH_PIXELS, INITIAL_CELL_HEIGHT_PIXELS, transcriptRows, null);
+			for (int i = 0; i < transcriptRows; i++)
+				emulator.append(bytes, bytes.length);
+
+			long start = System.nanoTime();
+			emulator.resize(50, 40, INITIAL_CELL_WIDTH_PIXELS, INITIAL_CELL_HEIGHT_PIXELS);
+			long resizeNanos = System.nanoTime() - start;
+			start = System.nanoTime();
+			while (emulator.reflowTranscript(1000)) ;
+			long reflowNanos = System.nanoTime() - start;
+			System.out.printf("Resizing with %d transcript rows: %.2f ms, then %.2f ms reflowing the transcript%n",
+				transcriptRows, resizeNanos / 1e6, reflowNanos / 1e6);
+			assertEquals(transcriptRows - 40, emulator.getScreen().getActiveTranscriptRows());
+		}
+	}
+
+}
@@ -0,0 +1,40 @@
+package com.termux.terminal;
+
+import junit.framework.TestCase;
+
+import java.io.File;
+import java.nio.file.Files;
+
+/** Prints the compression ratio of a compressed {@link ScrollbackFile} on typical build output, and its cost per MB. */
+public class ScrollbackFileBenchmark extends TestCase {
+
+	public void testCompressionRatioAndCost() throws Exception {
+		File directory = Files.createTempDirectory("scrollback").toFile();
+		try {
+			ScrollbackFile scrollback = new ScrollbackFile(directory, Integer.MAX_VALUE, true);
+			StyleTable styleTable = new StyleTable();
+			long start = System.nanoTime();
+			for (int i = 0; i < 200000; i++) {
+				String line = (i % 10 == 0) ? "[" + (i / 10) + "/20000] Building CXX object src/module" + (i % 97) + "/File" + i + ".cpp.o"
+					: "  compiling src/module" + (i % 97) + "/File" + i + ".cpp -O2 -Wall";
+				assertTrue(scrollback.append(newRow(styleTable, line, (i % 10 == 0) ? 2 : 7)));
+			}
+			double seconds = (System.nanoTime() - start) / 1e9;
+			double megabytes = scrollback.getRowBytes() / 1e6;
+			System.out.printf("Compressed %.1f MB of rows %.1f times, deflating at %.2f ms per MB, appending at %.2f ms per MB%n",
+				megabytes, (double) scrollback.getRowBytes() / scrollback.getWrittenBytes(),
+				scrollback.getDeflateNanos() / 1e6 / megabytes, seconds * 1e3 / megabytes);
+			scrollback.close();
+		} finally {
+			assertTrue(directory.delete());
+		}
+	}
+
+	private static TerminalRow newRow(StyleTable styleTable, String text, int color) {
+		TerminalRow row = new TerminalRow(80, styleTable, null, TextStyle.NORMAL);
+		for (int column = 0; column < text.length(); column++)
+			row.setChar(column, text.charAt(column), TextStyle.encode(color, TextStyle.COLOR_INDEX_BACKGROUND, 0));
+		return row;
+	}
+
+}
@@ -0,0 +1,35 @@
+package com.termux.terminal;
+
+import junit.framework.TestCase;
+
+/**
+ * Prints the heap used by a full scrollback of colored output, next to what its styles take as 16-bit ids and what they
+ * took before as a 64-bit style per cell.
+ */
+public class StyleTableBenchmark extends TestCase {
+
+	public void testScrollbackHeapUsage() {
+		final int columns = 200;
+		final int transcriptRows = 10000;
+		Runtime runtime = Runtime.getRuntime();
+		System.gc();
+		long before = runtime.totalMemory() - runtime.freeMemory();
+
+		TerminalEmulator emulator = new TerminalEmulator(new TerminalTestCase.MockTerminalOutput(), columns, 24, 13, 15, transcriptRows, null);
+		StringBuilder line = new StringBuilder();
+		for (int i = 0; i < 20; i++)
+			line.append("\033[3").append(i % 8).append("mcolored ");
+		line.append("\033[0m\r\n");
+		byte[] bytes = line.toString().getBytes();
+		for (int i = 0; i < transcriptRows; i++)
+			emulator.append(bytes, bytes.length);
+
+		System.gc();
+		long after = runtime.totalMemory() - runtime.freeMemory();
+		long cells = (long) transcriptRows * columns;
+		System.out.printf("%d rows of %d columns: %.1f MB heap, of which styles %.1f MB, %.1f MB as 64-bit styles%n",
+			transcriptRows, columns, (after - before) / 1e6, cells * 2 / 1e6, cells * 8 / 1e6);
+		assertEquals(transcriptRows, emulator.getScreen().getActiveRows());
+	}
+
+}
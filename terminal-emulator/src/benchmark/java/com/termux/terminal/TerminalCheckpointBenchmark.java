@@ -0,0 +1,35 @@
+package com.termux.terminal;
+
+import java.io.File;
+import java.io.IOException;
+import java.util.ArrayList;
+import java.util.List;
+
+/** Prints the time to restore 30 sessions with a full transcript of 2000 rows each from their checkpoints. */
+public class TerminalCheckpointBenchmark extends TerminalTestCase {
+
+	public void testRestoreTime() throws IOException {
+		List<File> files = new ArrayList<>();
+		try {
+			for (int i = 0; i < 30; i++) {
+				mTerminal = new TerminalEmulator(mOutput, 80, 24, INITIAL_CELL_WIDTH_PIXELS, INITIAL_CELL_HEIGHT_PIXELS, null, null);
+				for (int line = 0; line < 2000; line++)
+					enterString("\033[3" + (line % 8) + "m[" + line + "/2000] Building CXX object src/module" + (line % 97) + "/File" + line + ".cpp.o\r\n");
+				File file = File.createTempFile("checkpoint", null);
+				files.add(file);
+				try (TerminalCheckpoint checkpoint = new TerminalCheckpoint(file)) {
+					checkpoint.write(mTerminal);
+				}
+			}
+
+			long start = System.nanoTime();
+			for (File file : files)
+				TerminalCheckpoint.restore(file, mOutput, INITIAL_CELL_WIDTH_PIXELS, INITIAL_CELL_HEIGHT_PIXELS, null);
+			System.out.printf("Restored 30 sessions of 2000 rows in %.1f ms%n", (System.nanoTime() - start) / 1e6);
+		} finally {
+			for (File file : files)
+				assertTrue(file.delete());
+		}
+	}
+
+}
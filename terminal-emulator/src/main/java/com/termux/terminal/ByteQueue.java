@@ -1,6 +1,10 @@
 package com.termux.terminal;
 
-/** A circular byte buffer allowing one producer and one consumer thread. */
+/**
+ * A circular byte buffer allowing one producer and one consumer thread, synchronizing on its monitor.
+ * <p/>
+ * Superseded by the lock-free {@link ByteRing}, and kept as the baseline of ByteRingBenchmark in src/benchmark.
+ */
 final class ByteQueue {
 
     private final byte[] mBuffer;
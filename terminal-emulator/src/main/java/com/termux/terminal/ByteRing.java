@@ -0,0 +1,206 @@
+package com.termux.terminal;
+
+import java.util.concurrent.locks.LockSupport;
+
+/**
+ * A lock-free circular byte buffer for one producer and one consumer thread, which replaces the monitor based
+ * {@link ByteQueue}.
+ * <p/>
+ * Positions are published through volatile fields only, so neither side takes a lock. A thread is only parked when
+ * the ring is empty (consumer) or full (producer), and only then does the other side unpark it, which with
+ * {@link LockSupport} is a single futex wake.
+ * <p/>
+ * The capacity starts small and grows up to a maximum: when the producer finds the ring full it links in a segment of
+ * twice the size and continues there, and the consumer follows once it has drained the previous segment.
+ * <p/>
+ * Besides copying {@link #write(byte[], int, int)} and {@link #read(byte[], boolean)}, the contiguous regions of the
+ * current segments can be accessed in place: the producer fills {@link #acquireWrite()} bytes of
+ * {@link #writeArray()} at {@link #writeOffset()} and calls {@link #commitWrite(int)}, and likewise the consumer with
+ * {@link #acquireRead()}, {@link #readArray()}, {@link #readOffset()} and {@link #commitRead(int)}.
+ */
+final class ByteRing {
+
+    private static final class Segment {
+        final byte[] mBytes;
+        final int mMask;
+        /** Total bytes read from and written to this segment. */
+        volatile long mHead;
+        volatile long mTail;
+        /** The segment the producer continued in once this one was full. */
+        volatile Segment mNext;
+
+        Segment(int capacity) {
+            mBytes = new byte[capacity];
+            mMask = capacity - 1;
+        }
+    }
+
+    private final int mMaxCapacity;
+    /** Only touched by the producer. */
+    private Segment mProducerSegment;
+    /** Only touched by the consumer. */
+    private Segment mConsumerSegment;
+
+    private volatile boolean mOpen = true;
+    private volatile Thread mParkedProducer;
+    private volatile Thread mParkedConsumer;
+
+    /**
+     * @param initialCapacity The capacity to start with, which must be a power of two.
+     * @param maxCapacity     The capacity up to which to grow instead of making the producer wait.
+     */
+    public ByteRing(int initialCapacity, int maxCapacity) {
+        if (initialCapacity <= 0 || (initialCapacity & (initialCapacity - 1)) != 0)
+            throw new IllegalArgumentException("initialCapacity not a power of two: " + initialCapacity);
+        mMaxCapacity = maxCapacity;
+        mProducerSegment = mConsumerSegment = new Segment(initialCapacity);
+    }
+
+    /** The capacity of the segment currently written to. */
+    public int capacity() {
+        return mProducerSegment.mBytes.length;
+    }
+
+    public void close() {
+        mOpen = false;
+        LockSupport.unpark(mParkedProducer);
+        LockSupport.unpark(mParkedConsumer);
+    }
+
+    // Producer side.
+
+    public byte[] writeArray() {
+        return mProducerSegment.mBytes;
+    }
+
+    public int writeOffset() {
+        Segment segment = mProducerSegment;
+        return (int) (segment.mTail & segment.mMask);
+    }
+
+    /**
+     * The number of bytes which may be written at {@link #writeOffset()}, growing the ring if it is full and allowed
+     * to. Returns 0 if it is full.
+     */
+    public int acquireWrite() {
+        Segment segment = mProducerSegment;
+        int capacity = segment.mBytes.length;
+        long tail = segment.mTail;
+        int free = capacity - (int) (tail - segment.mHead);
+        if (free == 0 && capacity <= mMaxCapacity / 2) {
+            Segment next = new Segment(capacity * 2);
+            mProducerSegment = next;
+            segment.mNext = next;
+            return next.mBytes.length;
+        }
+        return Math.min(free, capacity - (int) (tail & segment.mMask));
+    }
+
+    /** Publish length bytes written at {@link #writeOffset()}, waking the consumer if it is waiting for them. */
+    public void commitWrite(int length) {
+        mProducerSegment.mTail += length;
+        Thread parked = mParkedConsumer;
+        if (parked != null) LockSupport.unpark(parked);
+    }
+
+    /**
+     * Write the specified portion of the provided buffer, waiting while the ring is full.
+     * <p/>
+     * Returns whether the output was totally written, false if it was closed before.
+     */
+    public boolean write(byte[] buffer, int offset, int lengthToWrite) {
+        return write(buffer, offset, lengthToWrite, null);
+    }
+
+    /**
+     * Write the specified portion of the provided buffer like {@link #write(byte[], int, int)}, running drainRequest,
+     * if not null, each time before waiting for room. This is for consumers which only drain the ring when asked to,
+     * such as the {@link TerminalReactor}, and which would otherwise never wake a producer waiting on a full ring.
+     */
+    public boolean write(byte[] buffer, int offset, int lengthToWrite, Runnable drainRequest) {
+        if (lengthToWrite + offset > buffer.length) {
+            throw new IllegalArgumentException("length + offset > buffer.length");
+        } else if (lengthToWrite <= 0) {
+            throw new IllegalArgumentException("length <= 0");
+        }
+
+        while (lengthToWrite > 0) {
+            if (!mOpen) return false;
+            int length = acquireWrite();
+            if (length == 0) {
+                if (drainRequest != null) drainRequest.run();
+                mParkedProducer = Thread.currentThread();
+                // Check again after announcing to not miss a consumer which made room in between.
+                if (acquireWrite() == 0 && mOpen) LockSupport.park(this);
+                mParkedProducer = null;
+                continue;
+            }
+            length = Math.min(length, lengthToWrite);
+            System.arraycopy(buffer, offset, writeArray(), writeOffset(), length);
+            commitWrite(length);
+            offset += length;
+            lengthToWrite -= length;
+        }
+        return true;
+    }
+
+    // Consumer side.
+
+    public byte[] readArray() {
+        return mConsumerSegment.mBytes;
+    }
+
+    public int readOffset() {
+        Segment segment = mConsumerSegment;
+        return (int) (segment.mHead & segment.mMask);
+    }
+
+    /** The number of bytes which may be read at {@link #readOffset()}, 0 if the ring is empty. */
+    public int acquireRead() {
+        Segment segment = mConsumerSegment;
+        while (true) {
+            // Read the link first: once it is set, nothing more is written to the segment.
+            Segment next = segment.mNext;
+            long head = segment.mHead;
+            int stored = (int) (segment.mTail - head);
+            if (stored > 0) return Math.min(stored, segment.mBytes.length - (int) (head & segment.mMask));
+            if (next == null) return 0;
+            mConsumerSegment = segment = next;
+        }
+    }
+
+    /** Release length bytes read at {@link #readOffset()}, waking the producer if it is waiting for room. */
+    public void commitRead(int length) {
+        mConsumerSegment.mHead += length;
+        Thread parked = mParkedProducer;
+        if (parked != null) LockSupport.unpark(parked);
+    }
+
+    /**
+     * Read as much as is available into buffer, waiting for something to be available if block is set.
+     *
+     * @return the number of bytes read, 0 if non-blocking and nothing was available, or -1 if closed.
+     */
+    public int read(byte[] buffer, boolean block) {
+        int length;
+        while ((length = acquireRead()) == 0) {
+            if (!mOpen) return -1;
+            if (!block) return 0;
+            mParkedConsumer = Thread.currentThread();
+            if (acquireRead() == 0 && mOpen) LockSupport.park(this);
+            mParkedConsumer = null;
+        }
+        if (!mOpen) return -1;
+
+        int totalRead = 0;
+        while (length > 0 && totalRead < buffer.length) {
+            int bytesToCopy = Math.min(length, buffer.length - totalRead);
+            System.arraycopy(readArray(), readOffset(), buffer, totalRead, bytesToCopy);
+            commitRead(bytesToCopy);
+            totalRead += bytesToCopy;
+            length = acquireRead();
+        }
+        return totalRead;
+    }
+
+}
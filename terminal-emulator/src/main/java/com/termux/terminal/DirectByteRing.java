@@ -0,0 +1,77 @@
+package com.termux.terminal;
+
+import java.nio.ByteBuffer;
+
+/**
+ * A circular buffer of bytes in a direct {@link ByteBuffer}, for one producer and one consumer thread. Native code can
+ * read(2) straight into the free region and the consumer can process the filled region in place, so bytes are not
+ * copied between the two.
+ * <p/>
+ * Both sides work on contiguous regions: the producer fills up to {@link #writableLength()} bytes at
+ * {@link #writableOffset()} and then calls {@link #commitWrite(int)}, and the consumer likewise with
+ * {@link #readableOffset()}, {@link #readableLength()} and {@link #commitRead(int)}. Neither blocks.
+ */
+final class DirectByteRing {
+
+    final ByteBuffer mBuffer;
+    private final int mCapacity;
+    private final int mMask;
+
+    /** Total number of bytes consumed. Only written by the consumer. */
+    private volatile long mHead;
+    /** Total number of bytes produced. Only written by the producer. */
+    private volatile long mTail;
+
+    /** @param capacity The capacity, which must be a power of two. */
+    DirectByteRing(int capacity) {
+        if (capacity <= 0 || (capacity & (capacity - 1)) != 0)
+            throw new IllegalArgumentException("capacity not a power of two: " + capacity);
+        mBuffer = ByteBuffer.allocateDirect(capacity);
+        mCapacity = capacity;
+        mMask = capacity - 1;
+    }
+
+    int capacity() {
+        return mCapacity;
+    }
+
+    /** The number of bytes which have been written but not yet read. */
+    int size() {
+        return (int) (mTail - mHead);
+    }
+
+    /** Offset in {@link #mBuffer} at which the producer may write next. */
+    int writableOffset() {
+        return (int) (mTail & mMask);
+    }
+
+    /** The number of bytes the producer may write at {@link #writableOffset()}, 0 if the ring is full. */
+    int writableLength() {
+        long tail = mTail;
+        int free = mCapacity - (int) (tail - mHead);
+        return Math.min(free, mCapacity - (int) (tail & mMask));
+    }
+
+    /** Publish length bytes written at {@link #writableOffset()} to the consumer. */
+    void commitWrite(int length) {
+        mTail += length;
+    }
+
+    /** Offset in {@link #mBuffer} at which the consumer may read next. */
+    int readableOffset() {
+        return (int) (mHead & mMask);
+    }
+
+    /** The number of bytes the consumer may read at {@link #readableOffset()}, 0 if the ring is empty. */
+    int readableLength() {
+        long head = mHead;
+        int stored = (int) (mTail - head);
+        return Math.min(stored, mCapacity - (int) (head & mMask));
+    }
+
+    /** Release length bytes read at {@link #readableOffset()} to the producer. */
+    void commitRead(int length) {
+        mHead += length;
+    }
+
+}
@@ -1,5 +1,7 @@
 package com.termux.terminal;
 
+import java.nio.ByteBuffer;
+
 /**
  * Native methods for creating and managing pseudoterminal subprocesses. C code is in jni/termux.c.
  */
@@ -9,10 +11,20 @@ final class JNI {
         System.loadLibrary("termux");
     }
 
+    /**
+     * Fork the spawn helper process that subprocesses are started from. The helper does not exec, so it keeps a
+     * copy-on-write image of what the app process has mapped when it is forked, and this should be called as early as
+     * possible. Calls after the first do nothing.
+     */
+    public static native void startSpawnHelper();
+
     /**
      * Create a subprocess. Differs from {@link ProcessBuilder} in that a pseudoterminal is used to communicate with the
      * subprocess.
      * <p/>
+     * The subprocess is started by the spawn helper process if {@link #startSpawnHelper()} has been called, so that
+     * the app process itself does not have to fork. It is spawned directly if the helper is not available.
+     * <p/>
      * Callers are responsible for calling {@link #close(int)} on the returned file descriptor.
      *
      * @param cmd       The command to execute
@@ -25,6 +37,36 @@ final class JNI {
      */
     public static native int createSubprocess(String cmd, String cwd, String[] args, String[] envVars, int[] processId, int rows, int columns, int cellWidth, int cellHeight);
 
+    /**
+     * Create several subprocesses with a single native call, as if by calling
+     * {@link #createSubprocess(String, String, String[], String[], int[], int, int, int, int)} for each index of the
+     * arrays. The spawn helper is sent all requests back to back, and consecutive entries sharing the same envVars
+     * array are only converted once.
+     *
+     * @param processIds An array as long as cmds to which the process IDs of the started processes will be written.
+     * @return the file descriptors of the /dev/ptmx master devices, as for {@link #createSubprocess}. A subprocess
+     * that could not be started instead has -1 as both file descriptor and process ID.
+     */
+    public static native int[] createSubprocesses(String[] cmds, String[] cwds, String[][] args, String[][] envVars, int[] processIds, int rows, int columns, int cellWidth, int cellHeight);
+
+    /**
+     * Encode a command in native memory for repeated launches with
+     * {@link #createSubprocessFromTemplate(int, String[], int[], int, int, int, int)}.
+     *
+     * @return the id of the template, to be released with {@link #destroySpawnTemplate(int)}.
+     */
+    public static native int createSpawnTemplate(String cmd, String cwd, String[] args, String[] envVars);
+
+    /**
+     * Create a subprocess from a template, as {@link #createSubprocess} would for its command.
+     *
+     * @param args The arguments to use instead of those of the template, or null to keep them.
+     */
+    public static native int createSubprocessFromTemplate(int templateId, String[] args, int[] processId, int rows, int columns, int cellWidth, int cellHeight);
+
+    /** Free a template created by {@link #createSpawnTemplate(String, String, String[], String[])}. */
+    public static native void destroySpawnTemplate(int templateId);
+
     /** Set the window size for a given pty, which allows connected programs to learn how large their screen is. */
     public static native void setPtyWindowSize(int fd, int rows, int cols, int cellWidth, int cellHeight);
 
@@ -35,6 +77,65 @@ final class JNI {
      */
     public static native int waitFor(int processId);
 
+    /**
+     * Wait for the process to exit for at most timeoutMillis, or without limit if negative. A timeout of 0 polls
+     * without blocking. Unlike {@link #waitFor(int)} this does not need a thread per process to be blocked, as exits
+     * are tracked through a pidfd or exit pipe for each process.
+     *
+     * @param exitCode      A one-element array to which the exit code as returned by {@link #waitFor(int)} is written.
+     * @param resourceUsage An array of {@link ProcessResourceUsage#LONGS} to which the resources used by the process
+     *                      are written, or null.
+     * @return 1 if the process has exited, 0 if it has not within the timeout, or -1 if its exit cannot be collected
+     * here, as when it was already collected by the {@link TerminalReactor} or another waiting thread.
+     */
+    public static native int waitForExit(int processId, int timeoutMillis, int[] exitCode, long[] resourceUsage);
+
+    /**
+     * Get a file descriptor which becomes readable when the process exits, for use in an event loop. It stays owned
+     * by the native side and is closed once the exit is collected with {@link #waitForExit(int, int, int[], long[])}.
+     *
+     * @return the file descriptor, or -1 if the exit of the process is not tracked.
+     */
+    public static native int getExitFd(int processId);
+
+    /**
+     * Register a pty master, which is made non-blocking, with the epoll instance of the {@link TerminalReactor}.
+     *
+     * @param token Identifies the session in events reported by {@link #reactorPoll(int[], long[], int)}.
+     * @return whether the exit of the process will be reported as an event, which is the case if it has an exit file
+     * descriptor as of {@link #getExitFd(int)}. Otherwise {@link #waitFor(int)} has to be used.
+     */
+    public static native boolean reactorAdd(int fd, int processId, int token);
+
+    /** Set whether the reactor waits for input from and room for output to a registered pty. */
+    public static native void reactorSetInterest(int fd, int token, boolean input, boolean output);
+
+    /** Unregister a pty from the reactor, before closing it. */
+    public static native void reactorRemove(int fd);
+
+    /** Make the current or next {@link #reactorPoll(int[], long[], int)} return. */
+    public static native void reactorWake();
+
+    /**
+     * Wait for and return a batch of reactor events, four ints each: type, token, exit code and index into
+     * resourceUsage. The resources used by exited processes are written to resourceUsage,
+     * {@link ProcessResourceUsage#LONGS} each.
+     *
+     * @param timeoutMillis How long to wait at most, or -1 to wait until something happens.
+     * @return the number of events, 0 if timed out.
+     */
+    public static native int reactorPoll(int[] events, long[] resourceUsage, int timeoutMillis);
+
+    /**
+     * Read from a non-blocking pty into a direct buffer, without copying.
+     *
+     * @return the number of bytes read, 0 if nothing is available or -1 once the slave side has been closed.
+     */
+    public static native int readPty(int fd, ByteBuffer buffer, int offset, int length);
+
+    /** Write to a non-blocking pty. Returns the number of bytes written, 0 if it is full and -1 on error. */
+    public static native int reactorWrite(int fd, byte[] data, int offset, int length);
+
     /** Close a file descriptor through the close(2) system call. */
     public static native void close(int fileDescriptor);
 
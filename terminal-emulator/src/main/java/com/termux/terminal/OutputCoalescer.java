@@ -0,0 +1,70 @@
+package com.termux.terminal;
+
+/**
+ * Decides when the main thread is told about output read from a pty, for the {@link TerminalReactor}.
+ * <p/>
+ * Telling it after every read makes output arriving in many small chunks, like a build log, cause as many main thread
+ * wakeups and screen invalidations. So while output is streaming, read output is held until {@link #MAX_HELD_BYTES}
+ * have accumulated or the first of them has been held for {@link #MAX_HOLD_MICROS}. Output arriving after the pty has
+ * been idle for {@link #IDLE_MICROS}, like the echo of a key press, is passed on at once, and held output is passed on
+ * as soon as the stream goes idle, so interactive latency is unchanged.
+ * <p/>
+ * Only used by the reactor thread, except for the counters.
+ */
+final class OutputCoalescer {
+
+    /** Half the {@link TerminalSession#mProcessToTerminalRing}, so that reading goes on while the main thread catches up. */
+    static final int MAX_HELD_BYTES = 8 * 1024;
+    /** A quarter of a 60 Hz frame. */
+    static final int MAX_HOLD_MICROS = 4000;
+    /** Reads further apart than this are not part of the same stream. */
+    static final int IDLE_MICROS = 1000;
+
+    private int mHeldBytes;
+    private boolean mHolding;
+    private long mHeldSinceNanos;
+    private boolean mReadBefore;
+    private long mLastReadNanos;
+
+    /** The number of reads which returned output, each of which used to be a message to the main thread. */
+    volatile long mReadCount;
+    /** The number of messages actually sent to the main thread. */
+    volatile long mMessageCount;
+
+    /** Account for bytes returned by a read from the pty. */
+    void onRead(int bytes) {
+        mReadCount++;
+        mHeldBytes += bytes;
+    }
+
+    /**
+     * Called after a batch of reads, to decide whether the main thread should be told about the output now. If not, it
+     * is held and {@link #flushDeadline()} tells until when.
+     */
+    boolean shouldFlush(long nowNanos) {
+        boolean idle = !mReadBefore || nowNanos - mLastReadNanos >= IDLE_MICROS * 1000L;
+        mReadBefore = true;
+        mLastReadNanos = nowNanos;
+        if (!mHolding) {
+            mHolding = true;
+            mHeldSinceNanos = nowNanos;
+        }
+        return idle || mHeldBytes >= MAX_HELD_BYTES || nowNanos - mHeldSinceNanos >= MAX_HOLD_MICROS * 1000L;
+    }
+
+    boolean isHolding() {
+        return mHolding;
+    }
+
+    /** When held output is to be passed on, in {@link System#nanoTime()} time, if no more has been read before. */
+    long flushDeadline() {
+        return Math.min(mHeldSinceNanos + MAX_HOLD_MICROS * 1000L, mLastReadNanos + IDLE_MICROS * 1000L);
+    }
+
+    /** Called when the main thread has been told about all output read. */
+    void flushed() {
+        mHolding = false;
+        mHeldBytes = 0;
+    }
+
+}
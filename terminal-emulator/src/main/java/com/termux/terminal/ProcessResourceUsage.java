@@ -0,0 +1,42 @@
+package com.termux.terminal;
+
+/**
+ * The resources used by a terminal session's process and its waited-for descendants over their lifetime, as reported
+ * by wait4(2) when it exited.
+ */
+public final class ProcessResourceUsage {
+
+    /** The number of longs the usage is passed from native code in, in the order of the fields below. */
+    static final int LONGS = 7;
+
+    /** CPU time spent in user mode, in microseconds. */
+    public final long mUserTimeMicros;
+    /** CPU time spent in the kernel, in microseconds. */
+    public final long mSystemTimeMicros;
+    /** The largest resident set size, in kilobytes. */
+    public final long mMaxResidentSetKilobytes;
+    /** Page faults serviced without and with I/O. */
+    public final long mMinorPageFaults;
+    public final long mMajorPageFaults;
+    /** Context switches because of waiting for a resource, and because of being preempted. */
+    public final long mVoluntaryContextSwitches;
+    public final long mInvoluntaryContextSwitches;
+
+    ProcessResourceUsage(long[] usage, int offset) {
+        mUserTimeMicros = usage[offset];
+        mSystemTimeMicros = usage[offset + 1];
+        mMaxResidentSetKilobytes = usage[offset + 2];
+        mMinorPageFaults = usage[offset + 3];
+        mMajorPageFaults = usage[offset + 4];
+        mVoluntaryContextSwitches = usage[offset + 5];
+        mInvoluntaryContextSwitches = usage[offset + 6];
+    }
+
+    @Override
+    public String toString() {
+        return "ProcessResourceUsage[user=" + mUserTimeMicros + "us, system=" + mSystemTimeMicros + "us, maxRss="
+            + mMaxResidentSetKilobytes + "kB, faults=" + mMinorPageFaults + "/" + mMajorPageFaults + ", switches="
+            + mVoluntaryContextSwitches + "/" + mInvoluntaryContextSwitches + "]";
+    }
+
+}
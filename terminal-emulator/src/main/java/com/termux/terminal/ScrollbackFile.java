@@ -0,0 +1,338 @@
+package com.termux.terminal;
+
+import java.io.File;
+import java.io.IOException;
+import java.io.RandomAccessFile;
+import java.nio.ByteBuffer;
+import java.nio.MappedByteBuffer;
+import java.nio.channels.FileChannel;
+import java.util.ArrayList;
+import java.util.Arrays;
+import java.util.zip.DataFormatException;
+import java.util.zip.Deflater;
+import java.util.zip.Inflater;
+
+/**
+ * The rows scrolled out of the full transcript of a {@link TerminalBuffer}, kept off the heap in memory-mapped files so
+ * that the scrollback can be far longer than the transcript. Rows are appended {@link TerminalRow#writeTo encoded} to
+ * segments, each a file mapped once and unlinked right away, so that its space is reclaimed with the mapping even if the
+ * process dies. Only the offset of each row in its segment stays on the heap.
+ * <p/>
+ * When compressing, as for sessions logging for days, rows are instead gathered into blocks of about
+ * {@link #BLOCK_BYTES}, each deflated as a whole into the segments, and only the offset and first row of each block are
+ * kept. Reading a row inflates its block, which is kept for reading the rows around it. A block is written as its
+ * inflated and deflated lengths followed by the deflated rows, which are followed by the offset of each row in the block
+ * and their number.
+ * <p/>
+ * Rows are numbered in the order appended, counting the rows dropped as the oldest once more than the maximum are kept.
+ */
+final class ScrollbackFile {
+
+    static final int SEGMENT_BYTES = 4 << 20;
+    /** The size of the blocks of rows deflated together when compressing, small enough to inflate to read a row. */
+    static final int BLOCK_BYTES = 64 << 10;
+
+    private static final class Segment {
+        final MappedByteBuffer mBuffer;
+        /** The number of the first row in this segment. */
+        final long mFirstRow;
+        /** Where each row of this segment starts, or each block when compressing, mEntryCount of them. */
+        int[] mOffsets = new int[256];
+        /** The number of the first row of each block, when compressing. */
+        long[] mBlockFirstRows;
+        int mEntryCount;
+
+        Segment(MappedByteBuffer buffer, long firstRow, boolean compressed) {
+            mBuffer = buffer;
+            mFirstRow = firstRow;
+            if (compressed) mBlockFirstRows = new long[mOffsets.length];
+        }
+    }
+
+    private final File mDirectory;
+    private final int mMaxRows;
+    private final int mSegmentBytes;
+    private final ArrayList<Segment> mSegments = new ArrayList<>();
+    /** The number of the oldest row kept, and of the next row appended. */
+    private long mFirstRow, mEndRow;
+
+    /** The block being filled with the rows from mBlockFirstRow on, when compressing, or null. */
+    private ByteBuffer mBlock;
+    private long mBlockFirstRow;
+    private int[] mBlockRowOffsets;
+    /** Created when first needed, and again after {@link #releaseCompressor()}. */
+    private Deflater mDeflater;
+    private byte[] mDeflated;
+    /** The block last inflated to read a row, of the rows from mInflatedFirstRow on, or -1 if none. */
+    private Inflater mInflater;
+    private ByteBuffer mInflated;
+    private long mInflatedFirstRow = -1;
+
+    /** The number of bytes of the rows appended, and of those written to the segments. */
+    private long mRowBytes, mWrittenBytes;
+    private long mDeflateNanos;
+
+    ScrollbackFile(File directory, int maxRows, boolean compress) {
+        this(directory, maxRows, compress, SEGMENT_BYTES);
+    }
+
+    ScrollbackFile(File directory, int maxRows, boolean compress, int segmentBytes) {
+        mDirectory = directory;
+        mMaxRows = maxRows;
+        mSegmentBytes = segmentBytes;
+        if (compress) {
+            mBlock = ByteBuffer.allocate(BLOCK_BYTES);
+            mBlockRowOffsets = new int[256];
+            mDeflated = new byte[BLOCK_BYTES];
+            mInflated = ByteBuffer.allocate(BLOCK_BYTES);
+        }
+    }
+
+    /** The number of rows kept. */
+    int size() {
+        return (int) (mEndRow - mFirstRow);
+    }
+
+    /** The number of the next row appended, one more than the newest. */
+    long getEndRow() {
+        return mEndRow;
+    }
+
+    int getSegmentCount() {
+        return mSegments.size();
+    }
+
+    /** The number of bytes of the rows appended, encoded. */
+    long getRowBytes() {
+        return mRowBytes;
+    }
+
+    /**
+     * The number of bytes written to the files, which when compressing does not count the rows of the block being
+     * filled.
+     */
+    long getWrittenBytes() {
+        return mWrittenBytes;
+    }
+
+    /** The time spent compressing, in nanoseconds. */
+    long getDeflateNanos() {
+        return mDeflateNanos;
+    }
+
+    /**
+     * Append a row, frozen if not already, dropping the oldest if more than the maximum would be kept. Returns false if
+     * it could not be written, as when out of disk space.
+     */
+    boolean append(TerminalRow row) {
+        row.freeze();
+        final int length = row.getEncodedLength();
+        if (mBlock != null) {
+            if (!appendToBlock(row, length)) return false;
+        } else {
+            Segment segment = segmentWithRoom(length);
+            if (segment == null) return false;
+            addEntry(segment, segment.mBuffer.position());
+            row.writeTo(segment.mBuffer);
+            mWrittenBytes += length;
+        }
+        mRowBytes += length;
+        mEndRow++;
+
+        if (size() > mMaxRows) {
+            mFirstRow++;
+            // Unreferenced, the segment is unmapped when garbage collected:
+            if (mSegments.size() > 1 && mSegments.get(1).mFirstRow <= mFirstRow) mSegments.remove(0);
+        }
+        return true;
+    }
+
+    private boolean appendToBlock(TerminalRow row, int length) {
+        final int blockRows = (int) (mEndRow - mBlockFirstRow);
+        // Leave room for the offsets ending the block:
+        if (mBlock.position() + length + 4 * (blockRows + 2) > mBlock.capacity()) {
+            if (blockRows > 0) return writeBlock() && appendToBlock(row, length);
+            // A row larger than a block is a block of its own:
+            mBlock = ByteBuffer.allocate(length + 8);
+        }
+        if (blockRows == mBlockRowOffsets.length) mBlockRowOffsets = Arrays.copyOf(mBlockRowOffsets, blockRows * 2);
+        mBlockRowOffsets[blockRows] = mBlock.position();
+        row.writeTo(mBlock);
+        return true;
+    }
+
+    /** Deflate the block being filled into a segment, and start the next one. */
+    private boolean writeBlock() {
+        final int blockRows = (int) (mEndRow - mBlockFirstRow);
+        for (int i = 0; i < blockRows; i++)
+            mBlock.putInt(mBlockRowOffsets[i]);
+        mBlock.putInt(blockRows);
+
+        final long startNanos = System.nanoTime();
+        if (mDeflater == null) mDeflater = new Deflater(Deflater.BEST_SPEED);
+        mDeflater.reset();
+        mDeflater.setInput(mBlock.array(), 0, mBlock.position());
+        mDeflater.finish();
+        int deflatedLength = 0;
+        while (!mDeflater.finished()) {
+            if (deflatedLength == mDeflated.length) mDeflated = Arrays.copyOf(mDeflated, mDeflated.length * 2);
+            deflatedLength += mDeflater.deflate(mDeflated, deflatedLength, mDeflated.length - deflatedLength);
+        }
+        mDeflateNanos += System.nanoTime() - startNanos;
+
+        Segment segment = segmentWithRoom(8 + deflatedLength);
+        if (segment == null) {
+            // Take the offsets off again, for the block to be written with the next row:
+            mBlock.position(mBlock.position() - 4 * (blockRows + 1));
+            return false;
+        }
+        addEntry(segment, segment.mBuffer.position());
+        segment.mBlockFirstRows[segment.mEntryCount - 1] = mBlockFirstRow;
+        segment.mBuffer.putInt(mBlock.position());
+        segment.mBuffer.putInt(deflatedLength);
+        segment.mBuffer.put(mDeflated, 0, deflatedLength);
+        mWrittenBytes += 8 + deflatedLength;
+
+        if (mBlock.capacity() > BLOCK_BYTES) mBlock = ByteBuffer.allocate(BLOCK_BYTES);
+        mBlock.clear();
+        mBlockFirstRow = mEndRow;
+        return true;
+    }
+
+    /** The last segment if it has room for a number of bytes, else a new one, or null if it could not be created. */
+    private Segment segmentWithRoom(int length) {
+        Segment segment = mSegments.isEmpty() ? null : mSegments.get(mSegments.size() - 1);
+        if (segment == null || segment.mBuffer.remaining() < length) {
+            try {
+                segment = newSegment(Math.max(mSegmentBytes, length));
+            } catch (IOException e) {
+                return null;
+            }
+            mSegments.add(segment);
+        }
+        return segment;
+    }
+
+    private Segment newSegment(int bytes) throws IOException {
+        File file = File.createTempFile("scrollback", null, mDirectory);
+        try (RandomAccessFile randomAccessFile = new RandomAccessFile(file, "rw")) {
+            // The mapping outlives the channel and the name of the file:
+            MappedByteBuffer buffer = randomAccessFile.getChannel().map(FileChannel.MapMode.READ_WRITE, 0, bytes);
+            // When compressing, segments are only created to write the block being filled:
+            return new Segment(buffer, (mBlock == null) ? mEndRow : mBlockFirstRow, mBlock != null);
+        } finally {
+            //noinspection ResultOfMethodCallIgnored
+            file.delete();
+        }
+    }
+
+    private static void addEntry(Segment segment, int offset) {
+        if (segment.mEntryCount == segment.mOffsets.length) {
+            segment.mOffsets = Arrays.copyOf(segment.mOffsets, segment.mEntryCount * 2);
+            if (segment.mBlockFirstRows != null)
+                segment.mBlockFirstRows = Arrays.copyOf(segment.mBlockFirstRows, segment.mEntryCount * 2);
+        }
+        segment.mOffsets[segment.mEntryCount++] = offset;
+    }
+
+    /** Read a row by number, which must be one of those kept, frozen and with its styles interned in a table. */
+    TerminalRow read(long rowNumber, StyleTable styleTable, TerminalRowPool pool) {
+        if (rowNumber < mFirstRow || rowNumber >= mEndRow)
+            throw new IllegalArgumentException("rowNumber=" + rowNumber + ", mFirstRow=" + mFirstRow + ", mEndRow=" + mEndRow);
+
+        // Read through duplicates, leaving the positions of the buffers written to as they are:
+        final ByteBuffer buffer;
+        if (mBlock == null) {
+            final Segment segment = findSegment(rowNumber);
+            buffer = segment.mBuffer.duplicate();
+            buffer.position(segment.mOffsets[(int) (rowNumber - segment.mFirstRow)]);
+        } else if (rowNumber >= mBlockFirstRow) {
+            buffer = mBlock.duplicate();
+            buffer.position(mBlockRowOffsets[(int) (rowNumber - mBlockFirstRow)]);
+        } else {
+            final long blockFirstRow = inflateBlock(rowNumber);
+            final int blockRows = mInflated.getInt(mInflated.limit() - 4);
+            final int offsetsStart = mInflated.limit() - 4 * (blockRows + 1);
+            buffer = mInflated.duplicate();
+            buffer.position(mInflated.getInt(offsetsStart + 4 * (int) (rowNumber - blockFirstRow)));
+        }
+        return TerminalRow.readFrom(buffer, styleTable, pool);
+    }
+
+    /** Inflate the block of a row into {@link #mInflated}, unless already there, returning its first row. */
+    private long inflateBlock(long rowNumber) {
+        final Segment segment = findSegment(rowNumber);
+        int low = 0, high = segment.mEntryCount - 1;
+        while (low < high) {
+            int middle = (low + high + 1) >>> 1;
+            if (segment.mBlockFirstRows[middle] <= rowNumber) low = middle;
+            else high = middle - 1;
+        }
+        final long blockFirstRow = segment.mBlockFirstRows[low];
+        if (blockFirstRow == mInflatedFirstRow) return blockFirstRow;
+
+        ByteBuffer buffer = segment.mBuffer.duplicate();
+        buffer.position(segment.mOffsets[low]);
+        final int inflatedLength = buffer.getInt();
+        final byte[] deflated = new byte[buffer.getInt()];
+        buffer.get(deflated);
+        if (mInflated.capacity() < inflatedLength) mInflated = ByteBuffer.allocate(inflatedLength);
+        if (mInflater == null) mInflater = new Inflater();
+        mInflater.reset();
+        mInflater.setInput(deflated);
+        try {
+            int inflated = 0;
+            while (inflated < inflatedLength && !mInflater.finished() && !mInflater.needsInput())
+                inflated += mInflater.inflate(mInflated.array(), inflated, inflatedLength - inflated);
+        } catch (DataFormatException e) {
+            throw new IllegalStateException("Corrupt scrollback block of row " + blockFirstRow, e);
+        }
+        mInflated.clear();
+        mInflated.limit(inflatedLength);
+        mInflatedFirstRow = blockFirstRow;
+        return blockFirstRow;
+    }
+
+    private Segment findSegment(long rowNumber) {
+        int low = 0, high = mSegments.size() - 1;
+        while (low < high) {
+            int middle = (low + high + 1) >>> 1;
+            if (mSegments.get(middle).mFirstRow <= rowNumber) low = middle;
+            else high = middle - 1;
+        }
+        return mSegments.get(low);
+    }
+
+    /** Drop all rows. Row numbers are not reused, so rows read before are never mistaken for later ones. */
+    void clear() {
+        mSegments.clear();
+        mFirstRow = mEndRow;
+        if (mBlock != null) {
+            mBlock.clear();
+            mBlockFirstRow = mEndRow;
+        }
+    }
+
+    /**
+     * Free the native memory of the compressor, as once the process of the session exited, keeping the rows readable. It
+     * is created again should another block be written or read.
+     */
+    void releaseCompressor() {
+        if (mDeflater != null) {
+            mDeflater.end();
+            mDeflater = null;
+        }
+        if (mInflater != null) {
+            mInflater.end();
+            mInflater = null;
+        }
+    }
+
+    /** Drop all rows and free the native memory of the compressor, after which the scrollback may not be used. */
+    void close() {
+        clear();
+        releaseCompressor();
+        mInflatedFirstRow = -1;
+    }
+
+}
@@ -0,0 +1,44 @@
+package com.termux.terminal;
+
+import java.io.Closeable;
+
+/**
+ * A command which is launched repeatedly, such as the login shell of new sessions, kept encoded in native memory so
+ * that starting a {@link TerminalSession} from it does not have to convert the command, arguments and environment
+ * again each time.
+ * <p>
+ * Templates hold native memory until {@link #close()} is called.
+ */
+public final class SpawnTemplate implements Closeable {
+
+    final String mShellPath;
+    final String mCwd;
+    final String[] mArgs;
+    final String[] mEnv;
+
+    /** The id of the native template, 0 once closed. */
+    private int mId;
+
+    public SpawnTemplate(String shellPath, String cwd, String[] args, String[] env) {
+        this.mShellPath = shellPath;
+        this.mCwd = cwd;
+        this.mArgs = args;
+        this.mEnv = env;
+        this.mId = JNI.createSpawnTemplate(shellPath, cwd, args, env);
+    }
+
+    synchronized int getId() {
+        if (mId == 0) throw new IllegalStateException("Spawn template has been closed");
+        return mId;
+    }
+
+    /** Release the native memory of this template. Sessions already started from it are not affected. */
+    @Override
+    public synchronized void close() {
+        if (mId != 0) {
+            JNI.destroySpawnTemplate(mId);
+            mId = 0;
+        }
+    }
+
+}
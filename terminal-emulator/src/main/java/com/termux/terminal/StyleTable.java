@@ -0,0 +1,171 @@
+package com.termux.terminal;
+
+import java.util.Arrays;
+
+/**
+ * Interns the {@link TextStyle} encoded styles used in a {@link TerminalBuffer}, so that its rows store a 16-bit id per
+ * cell in {@link TerminalRow#mStyleIds} instead of a 64-bit style. A screen rarely uses more than a handful of distinct
+ * styles, so nearly all cells share a few ids.
+ * <p/>
+ * Ids are never reassigned while in use. Once all {@link #MAX_STYLES} ids have been handed out, the ids no longer used
+ * by any of the {@link #rows()} are freed for reuse. Should they all still be in use, which needs a scrollback full of
+ * distinct true colors, a further style is rendered with the nearest one interned: the same colors without effects, the
+ * foreground color alone, or {@link TextStyle#NORMAL}.
+ */
+class StyleTable {
+
+    private static final String LOG_TAG = "StyleTable";
+
+    static final int MAX_STYLES = 1 << 16;
+
+    /** The style of each id. */
+    private long[] mStyles = new long[16];
+    /** The number of ids handed out, including freed ones. */
+    private int mIdCount;
+    /** Ids freed for reuse, mFreeIdCount of them. */
+    private char[] mFreeIds;
+    private int mFreeIdCount;
+
+    /** Open addressing hash table of id + 1 by style, 0 marking an empty slot. */
+    private int[] mSlots = new int[32];
+
+    /** The number of new styles to render with the nearest one before looking for unused ids again, once none were found. */
+    private int mScansToSkip;
+    private boolean mOverflowLogged;
+
+    /** The last style interned, as rows are mostly written in the same style. */
+    private long mLastStyle;
+    private int mLastId = -1;
+
+    /** The rows using this table, which are scanned for ids in use when running out of them. */
+    TerminalRow[] rows() {
+        return new TerminalRow[0];
+    }
+
+    /** The number of distinct styles currently interned. */
+    int size() {
+        return mIdCount - mFreeIdCount;
+    }
+
+    long get(int id) {
+        return mStyles[id];
+    }
+
+    /** The id of a style, interning it if new. */
+    int intern(long style) {
+        if (style == mLastStyle && mLastId >= 0) return mLastId;
+
+        int id = find(style);
+        if (id >= 0) {
+            mLastStyle = style;
+            return mLastId = id;
+        }
+
+        id = newId();
+        if (id < 0) return nearest(style);
+        mStyles[id] = style;
+        if ((size() * 2) > mSlots.length) {
+            rehash(mSlots.length * 2);
+        } else {
+            // Probe again, as newId() may have rehashed.
+            insert(id);
+        }
+        mLastStyle = style;
+        return mLastId = id;
+    }
+
+    /** The id of an interned style, or -1 if not interned. */
+    private int find(long style) {
+        final int mask = mSlots.length - 1;
+        int slot = hash(style) & mask;
+        int entry;
+        while ((entry = mSlots[slot]) != 0) {
+            if (mStyles[entry - 1] == style) return entry - 1;
+            slot = (slot + 1) & mask;
+        }
+        return -1;
+    }
+
+    /** The id of the interned style nearest to one for which no id was left, logging the first time this happens. */
+    private int nearest(long style) {
+        if (!mOverflowLogged) {
+            mOverflowLogged = true;
+            Logger.logWarn(null, LOG_TAG, "All " + MAX_STYLES + " style ids are in use, rendering new styles with the nearest one");
+        }
+        final int foreColor = TextStyle.decodeForeColor(style);
+        int id = find(TextStyle.encode(foreColor, TextStyle.decodeBackColor(style), 0));
+        if (id < 0) id = find(TextStyle.encode(foreColor, TextStyle.COLOR_INDEX_BACKGROUND, 0));
+        if (id < 0) id = find(TextStyle.NORMAL);
+        return Math.max(id, 0);
+    }
+
+    /** The id in another table of each id of this one, interning there the styles of the ids in use. */
+    char[] idsIn(StyleTable table) {
+        final char[] ids = new char[mIdCount];
+        boolean[] free = new boolean[mIdCount];
+        for (int i = 0; i < mFreeIdCount; i++)
+            free[mFreeIds[i]] = true;
+        for (int id = 0; id < mIdCount; id++) {
+            if (!free[id]) ids[id] = (char) table.intern(mStyles[id]);
+        }
+        return ids;
+    }
+
+    private int newId() {
+        if (mFreeIdCount > 0) return mFreeIds[--mFreeIdCount];
+        if (mIdCount == MAX_STYLES) {
+            if (mScansToSkip > 0) {
+                mScansToSkip--;
+                return -1;
+            } else if (!freeUnusedIds()) {
+                // Do not scan all rows for every new style while the table is full.
+                mScansToSkip = 4096;
+                return -1;
+            }
+            return mFreeIds[--mFreeIdCount];
+        }
+        if (mIdCount == mStyles.length) mStyles = Arrays.copyOf(mStyles, Math.min(mStyles.length * 2, MAX_STYLES));
+        return mIdCount++;
+    }
+
+    /** Free the ids not used by any row. Returns whether any were freed. */
+    private boolean freeUnusedIds() {
+        boolean[] used = new boolean[MAX_STYLES];
+        for (TerminalRow row : rows()) {
+            if (row != null && row.mStyleTable == this) row.markStyleIds(used);
+        }
+        if (mFreeIds == null) mFreeIds = new char[MAX_STYLES];
+        mFreeIdCount = 0;
+        for (int id = MAX_STYLES - 1; id >= 0; id--) {
+            if (!used[id]) mFreeIds[mFreeIdCount++] = (char) id;
+        }
+        if (mFreeIdCount == 0) return false;
+        mLastId = -1;
+        rehash(mSlots.length);
+        return true;
+    }
+
+    private void insert(int id) {
+        final int mask = mSlots.length - 1;
+        int slot = hash(mStyles[id]) & mask;
+        while (mSlots[slot] != 0)
+            slot = (slot + 1) & mask;
+        mSlots[slot] = id + 1;
+    }
+
+    private void rehash(int capacity) {
+        boolean[] free = new boolean[mIdCount];
+        for (int i = 0; i < mFreeIdCount; i++)
+            free[mFreeIds[i]] = true;
+        mSlots = new int[capacity];
+        for (int id = 0; id < mIdCount; id++) {
+            if (!free[id]) insert(id);
+        }
+    }
+
+    private static int hash(long style) {
+        long h = style * 0x9E3779B97F4A7C15L;
+        return (int) (h ^ (h >>> 32));
+    }
+
+}
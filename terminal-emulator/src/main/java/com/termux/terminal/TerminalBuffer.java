@@ -1,6 +1,10 @@
 package com.termux.terminal;
 
+import java.io.File;
+import java.nio.ByteBuffer;
+import java.util.ArrayList;
 import java.util.Arrays;
+import java.util.concurrent.RecursiveAction;
 
 /**
  * A circular buffer of {@link TerminalRow}:s which keeps notes about what is visible on a logical screen and the scroll
@@ -10,7 +14,18 @@ import java.util.Arrays;
  */
 public final class TerminalBuffer {
 
+    /** The most rows left to reflow by a {@link ReflowTask} on one thread rather than split up. */
+    private static final int REFLOW_TASK_ROWS = 1024;
+    /** The number of rows of the {@link #mScrollback} paged into {@link #mLines} at once, see {@link #pageIn(int)}. */
+    private static final int PAGED_ROWS = 256;
+
     TerminalRow[] mLines;
+    /** The styles used by the rows in {@link #mLines}. */
+    private StyleTable mStyleTable = newStyleTable();
+    /** Recycles the arrays of rows frozen into the transcript for the rows reused for new lines. */
+    private final TerminalRowPool mRowPool = new TerminalRowPool();
+    /** The copy a frozen row is thawed into by {@link #getLineForReading(int)}. */
+    private TerminalRow mReadRow;
     /** The length of {@link #mLines}. */
     int mTotalRows;
     /** The number of rows and columns visible on the screen. */
@@ -20,6 +35,23 @@ public final class TerminalBuffer {
     /** The index in the circular buffer where the visible screen starts. */
     private int mScreenFirstRow = 0;
 
+    /**
+     * The rows above the transcript left to reflow by {@link #resize(int, int, int, int[], long, boolean)}, oldest first,
+     * in the first {@link #mRowsToReflowCount} elements. See {@link #reflowTranscript(int)}.
+     */
+    private TerminalRow[] mRowsToReflow;
+    private int mRowsToReflowCount;
+    /** The style of the blank rows of a resize, used for the rows it left to reflow. */
+    private long mReflowStyle;
+
+    /**
+     * The rows scrolled out of the full transcript, above it, if kept on disk. See
+     * {@link #setScrollbackDirectory(File, int, boolean)}.
+     */
+    private ScrollbackFile mScrollback;
+    /** The number in {@link #mScrollback} of the row paged into each slot of {@link #mLines} after mTotalRows, or -1. */
+    private long[] mPagedRowNumbers;
+
     /**
      * Create a transcript screen.
      *
@@ -37,15 +69,27 @@ public final class TerminalBuffer {
         blockSet(0, 0, columns, screenRows, ' ', TextStyle.NORMAL);
     }
 
+    private StyleTable newStyleTable() {
+        return new StyleTable() {
+            @Override
+            TerminalRow[] rows() {
+                return mLines;
+            }
+        };
+    }
+
     public String getTranscriptText() {
+        reflowTranscript(Integer.MAX_VALUE);
         return getSelectedText(0, -getActiveTranscriptRows(), mColumns, mScreenRows).trim();
     }
 
     public String getTranscriptTextWithoutJoinedLines() {
+        reflowTranscript(Integer.MAX_VALUE);
         return getSelectedText(0, -getActiveTranscriptRows(), mColumns, mScreenRows, false).trim();
     }
 
     public String getTranscriptTextWithFullLinesJoined() {
+        reflowTranscript(Integer.MAX_VALUE);
         return getSelectedText(0, -getActiveTranscriptRows(), mColumns, mScreenRows, true, true).trim();
     }
 
@@ -64,6 +108,7 @@ public final class TerminalBuffer {
         if (selY1 < -getActiveTranscriptRows()) selY1 = -getActiveTranscriptRows();
         if (selY2 >= mScreenRows) selY2 = mScreenRows - 1;
 
+        TerminalRow thawedRow = null;
         for (int row = selY1; row <= selY2; row++) {
             int x1 = (row == selY1) ? selX1 : 0;
             int x2;
@@ -74,6 +119,13 @@ public final class TerminalBuffer {
                 x2 = columns;
             }
             TerminalRow lineObject = mLines[externalToInternalRow(row)];
+            if (lineObject.isFrozen()) {
+                // Read transcript rows through a thawed copy, so that copying the transcript does not thaw it all.
+                if (thawedRow == null || thawedRow.mStyleTable != lineObject.mStyleTable)
+                    thawedRow = new TerminalRow(columns, lineObject.mStyleTable, null, TextStyle.NORMAL);
+                lineObject.thawInto(thawedRow);
+                lineObject = thawedRow;
+            }
             int x1Index = lineObject.findStartOfColumn(x1);
             int x2Index = (x2 < mColumns) ? lineObject.findStartOfColumn(x2) : lineObject.getSpaceUsed();
             if (x2Index == x1Index) {
@@ -144,12 +196,23 @@ public final class TerminalBuffer {
         return text.substring(x1 + 1, x2);
     }
 
+    /** The number of rows above the screen, in the transcript and, if any, in the scrollback file above it. */
     public int getActiveTranscriptRows() {
-        return mActiveTranscriptRows;
+        return (mScrollback == null) ? mActiveTranscriptRows : (mActiveTranscriptRows + mScrollback.size());
     }
 
     public int getActiveRows() {
-        return mActiveTranscriptRows + mScreenRows;
+        return getActiveTranscriptRows() + mScreenRows;
+    }
+
+    /** The number of rows given recycled arrays from the row pool, instead of newly allocated ones. */
+    public long getRowPoolHits() {
+        return mRowPool.getHits();
+    }
+
+    /** The number of rows given newly allocated arrays, for a new row or for thawing or reusing a frozen one. */
+    public long getRowAllocations() {
+        return mRowPool.getAllocations();
     }
 
     /**
@@ -174,14 +237,81 @@ public final class TerminalBuffer {
      * @return The row corresponding to the input argument in the private coordinate system.
      */
     public int externalToInternalRow(int externalRow) {
-        if (externalRow < -mActiveTranscriptRows || externalRow > mScreenRows)
+        if (externalRow < -mActiveTranscriptRows || externalRow > mScreenRows) {
+            if (externalRow < -mActiveTranscriptRows && externalRow >= -getActiveTranscriptRows()) return pageIn(externalRow);
             throw new IllegalArgumentException("extRow=" + externalRow + ", mScreenRows=" + mScreenRows + ", mActiveTranscriptRows=" + mActiveTranscriptRows);
+        }
         final int internalRow = mScreenFirstRow + externalRow;
         return (internalRow < 0) ? (mTotalRows + internalRow) : (internalRow % mTotalRows);
     }
 
+    /**
+     * Keep the rows scrolled out of the full transcript of up to a number of them in memory-mapped files in a directory,
+     * instead of dropping them, or stop if the directory is null. They are rows above the transcript, included in
+     * {@link #getActiveTranscriptRows()}, and are read back when their external row is mapped by
+     * {@link #externalToInternalRow(int)}. Rows scrolled out before are kept in their width, so they are cut or padded
+     * rather than reflowed when the number of columns changes. Compressing the rows, in blocks, takes several times less
+     * space for a little more time, and is meant for long-running sessions with a large maximum.
+     * <p/>
+     * Meant for the main buffer, the size of its ring of rows in {@link #mTotalRows} not changing but on reflow. The rows
+     * kept so far are dropped.
+     */
+    public void setScrollbackDirectory(File directory, int maxRows, boolean compress) {
+        if (mScrollback != null) mScrollback.close();
+        mScrollback = (directory == null) ? null : new ScrollbackFile(directory, maxRows, compress);
+        mLines = Arrays.copyOf(mLines, mTotalRows + (mScrollback == null ? 0 : PAGED_ROWS));
+        resetPagedRows();
+    }
+
+    /**
+     * Free the native memory taken to compress the scrollback, if any, as once no more output is expected. The rows kept
+     * stay readable.
+     */
+    void releaseScrollbackCompressor() {
+        if (mScrollback != null) mScrollback.releaseCompressor();
+    }
+
+    ScrollbackFile getScrollback() {
+        return mScrollback;
+    }
+
+    private void resetPagedRows() {
+        if (mScrollback == null) {
+            mPagedRowNumbers = null;
+        } else {
+            if (mPagedRowNumbers == null) mPagedRowNumbers = new long[PAGED_ROWS];
+            Arrays.fill(mPagedRowNumbers, -1);
+            Arrays.fill(mLines, mTotalRows, mTotalRows + PAGED_ROWS, null);
+        }
+    }
+
+    /**
+     * Read a row of the {@link #mScrollback} into one of the slots of {@link #mLines} after the ring of rows, returning
+     * its index there. A row stays paged in until another one takes its slot, which the {@link #PAGED_ROWS} rows
+     * following it do not.
+     */
+    private int pageIn(int externalRow) {
+        final long rowNumber = mScrollback.getEndRow() + mActiveTranscriptRows + externalRow;
+        final int slot = (int) (rowNumber % PAGED_ROWS);
+        if (mPagedRowNumbers[slot] != rowNumber) {
+            TerminalRow row = mScrollback.read(rowNumber, mStyleTable, mRowPool);
+            if (row.getColumns() != mColumns) {
+                TerminalRow fittedRow = new TerminalRow(mColumns, mStyleTable, mRowPool, TextStyle.NORMAL);
+                fittedRow.copyInterval(row, 0, Math.min(row.getColumns(), mColumns), 0);
+                fittedRow.mLineWrap = row.mLineWrap;
+                fittedRow.freeze();
+                row = fittedRow;
+            }
+            mLines[mTotalRows + slot] = row;
+            mPagedRowNumbers[slot] = rowNumber;
+        }
+        return mTotalRows + slot;
+    }
+
     public void setLineWrap(int row) {
-        mLines[externalToInternalRow(row)].mLineWrap = true;
+        TerminalRow line = mLines[externalToInternalRow(row)];
+        line.mLineWrap = true;
+        line.mCheckpointOffset = -1;
     }
 
     public boolean getLineWrap(int row) {
@@ -189,12 +319,15 @@ public final class TerminalBuffer {
     }
 
     public void clearLineWrap(int row) {
-        mLines[externalToInternalRow(row)].mLineWrap = false;
+        TerminalRow line = mLines[externalToInternalRow(row)];
+        line.mLineWrap = false;
+        line.mCheckpointOffset = -1;
     }
 
     /**
-     * Resize the screen which this transcript backs. Currently, this only works if the number of columns does not
-     * change or the rows expand (that is, it only works when shrinking the number of rows).
+     * Resize the screen which this transcript backs. When the number of columns changes, the rows are reflowed to the new
+     * width, but only those needed to fill the new screen: the rest of the transcript is left to
+     * {@link #reflowTranscript(int)}.
      *
      * @param newColumns The number of columns the screen should have.
      * @param newRows    The number of rows the screen should have.
@@ -231,126 +364,323 @@ public final class TerminalBuffer {
             cursor[1] -= shiftDownOfTopRow;
             mScreenRows = newRows;
         } else {
-            // Copy away old state and update new:
-            TerminalRow[] oldLines = mLines;
-            mLines = new TerminalRow[newTotalRows];
-            for (int i = 0; i < newTotalRows; i++)
-                mLines[i] = new TerminalRow(newColumns, currentStyle);
-
             final int oldActiveTranscriptRows = mActiveTranscriptRows;
             final int oldScreenFirstRow = mScreenFirstRow;
             final int oldScreenRows = mScreenRows;
-            final int oldTotalRows = mTotalRows;
+            final int oldColumns = mColumns;
+
+            // All rows in order, starting with those still left to reflow by an earlier resize:
+            final int rowsToReflow = mRowsToReflowCount;
+            final int oldRowCount = rowsToReflow + oldActiveTranscriptRows + oldScreenRows;
+            final TerminalRow[] oldRows = new TerminalRow[oldRowCount];
+            if (rowsToReflow > 0) System.arraycopy(mRowsToReflow, 0, oldRows, 0, rowsToReflow);
+            for (int externalOldRow = -oldActiveTranscriptRows; externalOldRow < oldScreenRows; externalOldRow++)
+                oldRows[rowsToReflow + oldActiveTranscriptRows + externalOldRow] = mLines[externalToInternalRow(externalOldRow)];
+            final int cursorIndex = rowsToReflow + oldActiveTranscriptRows + cursor[1];
+
+            mLines = new TerminalRow[newTotalRows + (mScrollback == null ? 0 : PAGED_ROWS)];
+            // The old rows keep their table, and styles no longer used are dropped with it.
+            mStyleTable = newStyleTable();
             mTotalRows = newTotalRows;
+            resetPagedRows();
             mScreenRows = newRows;
-            mActiveTranscriptRows = mScreenFirstRow = 0;
             mColumns = newColumns;
 
-            int newCursorRow = -1;
-            int newCursorColumn = -1;
-            int oldCursorRow = cursor[1];
-            int oldCursorColumn = cursor[0];
-            boolean newCursorPlaced = false;
-
-            int currentOutputExternalRow = 0;
-            int currentOutputExternalColumn = 0;
-
-            // Loop over every character in the initial state.
-            // Blank lines should be skipped only if at end of transcript (just as is done in the "fast" resize), so we
-            // keep track how many blank lines we have skipped if we later on find a non-blank line.
-            int skippedBlankLines = 0;
-            for (int externalOldRow = -oldActiveTranscriptRows; externalOldRow < oldScreenRows; externalOldRow++) {
-                // Do what externalToInternalRow() does but for the old state:
-                int internalOldRow = oldScreenFirstRow + externalOldRow;
-                internalOldRow = (internalOldRow < 0) ? (oldTotalRows + internalOldRow) : (internalOldRow % oldTotalRows);
-
-                TerminalRow oldLine = oldLines[internalOldRow];
-                boolean cursorAtThisRow = externalOldRow == oldCursorRow;
-                // The cursor may only be on a non-null line, which we should not skip:
-                if (oldLine == null || (!(!newCursorPlaced && cursorAtThisRow)) && oldLine.isBlank()) {
-                    skippedBlankLines++;
-                    continue;
-                } else if (skippedBlankLines > 0) {
-                    // After skipping some blank lines we encounter a non-blank line. Insert the skipped blank lines.
-                    for (int i = 0; i < skippedBlankLines; i++) {
-                        if (currentOutputExternalRow == mScreenRows - 1) {
-                            scrollDownOneLine(0, mScreenRows, currentStyle);
-                        } else {
-                            currentOutputExternalRow++;
-                        }
-                        currentOutputExternalColumn = 0;
-                    }
-                    skippedBlankLines = 0;
+            // Reflow just enough of the last rows to fill the new screen, leaving the rest of the transcript to
+            // reflowTranscript(). Reflowing from a row following a non-blank row without line wrap gives the same rows
+            // as reflowing everything, as such a row always ends with a line break.
+            Reflow reflow;
+            int firstRow;
+            int rowsNeeded = 2 * newRows * Math.max(1, (newColumns + oldColumns - 1) / oldColumns);
+            while (true) {
+                firstRow = altScreen ? 0 : startOfLineAtOrBefore(oldRows, Math.min(cursorIndex, oldRowCount - rowsNeeded));
+                reflow = new Reflow(currentStyle);
+                for (int i = firstRow; i < oldRowCount; i++)
+                    reflow.reflowRow(oldRows[i], (i == cursorIndex) ? cursor[0] : -1, i == oldRowCount - 1);
+                // The reflowed rows must fill the screen, for the rows reflowed later to only add to the transcript:
+                if (firstRow == 0 || reflow.mOutputRow >= newRows - 1) break;
+                rowsNeeded *= 2;
+            }
+
+            final int outputRows = reflow.mOutputRow + 1;
+            final int firstScreenRow = Math.max(0, outputRows - newRows);
+            mActiveTranscriptRows = Math.min(firstScreenRow, newTotalRows - newRows);
+            mScreenFirstRow = mActiveTranscriptRows;
+            for (int i = 0; i < mActiveTranscriptRows + newRows; i++) {
+                int outputRow = firstScreenRow - mActiveTranscriptRows + i;
+                mLines[i] = (outputRow < outputRows) ? reflow.row(outputRow) : new TerminalRow(newColumns, mStyleTable, mRowPool, currentStyle);
+                if (i < mActiveTranscriptRows) mLines[i].freeze();
+            }
+
+            if (firstRow > 0 && mActiveTranscriptRows < newTotalRows - newRows) {
+                Arrays.fill(oldRows, firstRow, oldRowCount, null);
+                mRowsToReflow = oldRows;
+                mRowsToReflowCount = firstRow;
+                mReflowStyle = currentStyle;
+            } else {
+                if (mScrollback != null) {
+                    // The rows not fitting in the transcript go to the scrollback file, oldest first:
+                    for (int i = 0; i < firstRow; i++)
+                        if (oldRows[i] != null) mScrollback.append(oldRows[i]);
+                    for (int outputRow = 0; outputRow < firstScreenRow - mActiveTranscriptRows; outputRow++)
+                        mScrollback.append(reflow.row(outputRow));
                 }
+                mRowsToReflow = null;
+                mRowsToReflowCount = 0;
+            }
 
-                int lastNonSpaceIndex = 0;
-                boolean justToCursor = false;
-                if (cursorAtThisRow || oldLine.mLineWrap) {
-                    // Take the whole line, either because of cursor on it, or if line wrapping.
-                    lastNonSpaceIndex = oldLine.getSpaceUsed();
-                    if (cursorAtThisRow) justToCursor = true;
-                } else {
-                    for (int i = 0; i < oldLine.getSpaceUsed(); i++)
-                        // NEWLY INTRODUCED BUG! Should not index oldLine.mStyle with char indices
-                        if (oldLine.mText[i] != ' '/* || oldLine.mStyle[i] != currentStyle */)
-                            lastNonSpaceIndex = i + 1;
+            cursor[0] = reflow.mCursorColumn;
+            cursor[1] = (reflow.mCursorRow < 0) ? -1 : (reflow.mCursorRow - firstScreenRow);
+        }
+
+        // Handle cursor scrolling off screen:
+        if (cursor[0] < 0 || cursor[1] < 0) cursor[0] = cursor[1] = 0;
+    }
+
+    /** If a resize left rows to reflow, see {@link #reflowTranscript(int)}. */
+    public boolean hasRowsToReflow() {
+        return mRowsToReflowCount > 0;
+    }
+
+    /**
+     * Reflow the rows left by a resize to the current width, up to about a number of them, adding them to the top of the
+     * transcript. The newest rows are reflowed first, so that the transcript grows upwards from the screen. Many rows,
+     * as when reflowing all of them, are reflowed in parallel, see {@link ReflowTask}.
+     *
+     * @return whether rows are left to reflow.
+     */
+    public boolean reflowTranscript(int maxRows) {
+        if (mRowsToReflowCount == 0) return false;
+        final int endRow = mRowsToReflowCount;
+        final int firstRow = startOfLineAtOrBefore(mRowsToReflow, endRow - Math.min(maxRows, endRow));
+        ReflowTask task = new ReflowTask(firstRow, endRow);
+        // Runs on this thread, forking parts of many rows to the common pool:
+        task.invoke();
+        Arrays.fill(mRowsToReflow, firstRow, endRow, null);
+        mRowsToReflowCount = firstRow;
+        final int transcriptRows = mActiveTranscriptRows;
+        task.addToTranscript();
+        if (mActiveTranscriptRows == mTotalRows - mScreenRows) {
+            // Older rows would not fit in the full transcript, and go to the scrollback file if kept, oldest first:
+            dropRowsToReflow();
+            if (mScrollback != null) task.appendToScrollback(task.getOutputRows() - (mActiveTranscriptRows - transcriptRows));
+        } else if (mRowsToReflowCount == 0) {
+            mRowsToReflow = null;
+        }
+        return mRowsToReflowCount > 0;
+    }
+
+    /** Give up reflowing the rows left by a resize, appending them as they are to the scrollback file if kept. */
+    private void dropRowsToReflow() {
+        if (mScrollback != null) {
+            for (int i = 0; i < mRowsToReflowCount; i++)
+                if (mRowsToReflow[i] != null) mScrollback.append(mRowsToReflow[i]);
+        }
+        mRowsToReflow = null;
+        mRowsToReflowCount = 0;
+    }
+
+    /**
+     * The last index at or before a row that follows a non-blank row without line wrap, or 0. Reflowing rows from there
+     * on gives the same rows as reflowing them all.
+     */
+    private static int startOfLineAtOrBefore(TerminalRow[] rows, int row) {
+        if (row <= 0) return 0;
+        while (row > 0) {
+            TerminalRow previous = rows[row - 1];
+            if (previous != null && !previous.mLineWrap && !previous.isBlank()) break;
+            row--;
+        }
+        return row;
+    }
+
+    /**
+     * Reflows a range of the rows left by a resize. Ranges longer than {@link #REFLOW_TASK_ROWS} are split at the start
+     * of a line, where reflowing can start afresh, into halves reflowed in parallel. As neither style tables nor row
+     * pools are thread-safe, each part reflows into frozen rows of a style table of its own, which
+     * {@link #addToTranscript()} then moves to those of the buffer on the calling thread.
+     */
+    private final class ReflowTask extends RecursiveAction {
+
+        final int mFirstRow, mEndRow;
+        /** The halves reflowed, if split. */
+        ReflowTask mFirstHalf, mSecondHalf;
+        /** The rows reflowed, if not split. */
+        Reflow mReflow;
+
+        ReflowTask(int firstRow, int endRow) {
+            mFirstRow = firstRow;
+            mEndRow = endRow;
+        }
+
+        @Override
+        protected void compute() {
+            if (mEndRow - mFirstRow > REFLOW_TASK_ROWS) {
+                int middleRow = startOfLineAtOrBefore(mRowsToReflow, (mFirstRow + mEndRow) >>> 1);
+                if (middleRow > mFirstRow) {
+                    mFirstHalf = new ReflowTask(mFirstRow, middleRow);
+                    mSecondHalf = new ReflowTask(middleRow, mEndRow);
+                    invokeAll(mFirstHalf, mSecondHalf);
+                    return;
+                }
+            }
+
+            mReflow = new Reflow(mReflowStyle, new StyleTable() {
+                @Override
+                TerminalRow[] rows() {
+                    return mReflow.mRows.toArray(new TerminalRow[0]);
                 }
+            }, null);
+            for (int i = mFirstRow; i < mEndRow; i++)
+                mReflow.reflowRow(mRowsToReflow[i], -1, false);
+            // The last row reflowed ends with a line break, so the rows before the current output row are complete:
+            for (int outputRow = 0; outputRow < mReflow.mOutputRow; outputRow++)
+                mReflow.row(outputRow).freeze();
+        }
 
-                int currentOldCol = 0;
-                long styleAtCol = 0;
-                for (int i = 0; i < lastNonSpaceIndex; i++) {
-                    // Note that looping over java character, not cells.
-                    char c = oldLine.mText[i];
-                    int codePoint = (Character.isHighSurrogate(c)) ? Character.toCodePoint(c, oldLine.mText[++i]) : c;
-                    int displayWidth = WcWidth.width(codePoint);
-                    // Use the last style if this is a zero-width character:
-                    if (displayWidth > 0) styleAtCol = oldLine.getStyle(currentOldCol);
-
-                    // Line wrap as necessary:
-                    if (currentOutputExternalColumn + displayWidth > mColumns) {
-                        setLineWrap(currentOutputExternalRow);
-                        if (currentOutputExternalRow == mScreenRows - 1) {
-                            if (newCursorPlaced) newCursorRow--;
-                            scrollDownOneLine(0, mScreenRows, currentStyle);
-                        } else {
-                            currentOutputExternalRow++;
-                        }
-                        currentOutputExternalColumn = 0;
-                    }
+        /** Add the rows reflowed to the top of the transcript, newest first, while there is room. */
+        void addToTranscript() {
+            if (mReflow == null) {
+                mSecondHalf.addToTranscript();
+                mFirstHalf.addToTranscript();
+                return;
+            }
+            final int maxTranscriptRows = mTotalRows - mScreenRows;
+            char[] newStyleIds = null;
+            for (int outputRow = mReflow.mOutputRow - 1; outputRow >= 0 && mActiveTranscriptRows < maxTranscriptRows; outputRow--) {
+                if (newStyleIds == null) newStyleIds = mReflow.mStyleTable.idsIn(mStyleTable);
+                TerminalRow row = mReflow.row(outputRow);
+                row.moveTo(mStyleTable, mRowPool, newStyleIds);
+                mActiveTranscriptRows++;
+                mLines[externalToInternalRow(-mActiveTranscriptRows)] = row;
+            }
+        }
 
-                    int offsetDueToCombiningChar = ((displayWidth <= 0 && currentOutputExternalColumn > 0) ? 1 : 0);
-                    int outputColumn = currentOutputExternalColumn - offsetDueToCombiningChar;
-                    setChar(outputColumn, currentOutputExternalRow, codePoint, styleAtCol);
-
-                    if (displayWidth > 0) {
-                        if (oldCursorRow == externalOldRow && oldCursorColumn == currentOldCol) {
-                            newCursorColumn = currentOutputExternalColumn;
-                            newCursorRow = currentOutputExternalRow;
-                            newCursorPlaced = true;
-                        }
-                        currentOldCol += displayWidth;
-                        currentOutputExternalColumn += displayWidth;
-                        if (justToCursor && newCursorPlaced) break;
-                    }
+        int getOutputRows() {
+            return (mReflow == null) ? (mFirstHalf.getOutputRows() + mSecondHalf.getOutputRows()) : mReflow.mOutputRow;
+        }
+
+        /** Append the oldest rows reflowed, up to a number of them, to the scrollback file. Returns how many are left. */
+        int appendToScrollback(int rows) {
+            if (mReflow == null) return mSecondHalf.appendToScrollback(mFirstHalf.appendToScrollback(rows));
+            for (int outputRow = 0; outputRow < mReflow.mOutputRow && rows > 0; outputRow++, rows--)
+                mScrollback.append(mReflow.row(outputRow));
+            return rows;
+        }
+
+    }
+
+    /**
+     * Reflows rows of any width, one at a time, into new rows of {@link #mColumns} columns, kept from the first on. A row
+     * not line wrapped is followed by a line break, and blank rows are only kept when followed by a non-blank one.
+     */
+    private final class Reflow {
+
+        final ArrayList<TerminalRow> mRows = new ArrayList<>();
+        /** The style of new blank rows. */
+        final long mStyle;
+        /** Where the new rows intern their styles and recycle their arrays. */
+        final StyleTable mStyleTable;
+        final TerminalRowPool mRowPool;
+        /** The position where the next character is written. */
+        int mOutputRow, mOutputColumn;
+        /** Blank rows skipped, to be added if a non-blank row follows. */
+        int mSkippedBlankLines;
+        /** The new position of the cursor, or -1 if not placed. */
+        int mCursorRow = -1, mCursorColumn = -1;
+        /** A copy of the frozen row being reflowed. */
+        TerminalRow mThawedRow;
+
+        Reflow(long style) {
+            this(style, TerminalBuffer.this.mStyleTable, TerminalBuffer.this.mRowPool);
+        }
+
+        Reflow(long style, StyleTable styleTable, TerminalRowPool rowPool) {
+            mStyle = style;
+            mStyleTable = styleTable;
+            mRowPool = rowPool;
+        }
+
+        /** The new row at an index, created blank if not yet written to. */
+        TerminalRow row(int index) {
+            while (mRows.size() <= index)
+                mRows.add(new TerminalRow(mColumns, mStyleTable, mRowPool, mStyle));
+            return mRows.get(index);
+        }
+
+        private void lineBreak() {
+            mOutputRow++;
+            mOutputColumn = 0;
+        }
+
+        /**
+         * @param cursorColumn the column of the cursor if it is on this row, or -1.
+         * @param lastRow      if this is the last row, which is not followed by a line break.
+         */
+        void reflowRow(TerminalRow oldLine, int cursorColumn, boolean lastRow) {
+            boolean cursorAtThisRow = cursorColumn >= 0;
+            // The cursor may only be on a non-null line, which we should not skip:
+            if (oldLine == null || (!(mCursorRow < 0 && cursorAtThisRow)) && oldLine.isBlank()) {
+                mSkippedBlankLines++;
+                return;
+            } else if (mSkippedBlankLines > 0) {
+                // After skipping some blank lines we encounter a non-blank line. Insert the skipped blank lines.
+                for (int i = 0; i < mSkippedBlankLines; i++)
+                    lineBreak();
+                mSkippedBlankLines = 0;
+            }
+
+            if (oldLine.isFrozen()) {
+                if (mThawedRow == null || mThawedRow.mStyleTable != oldLine.mStyleTable || mThawedRow.getColumns() != oldLine.getColumns())
+                    mThawedRow = new TerminalRow(oldLine);
+                oldLine.thawInto(mThawedRow);
+                oldLine = mThawedRow;
+            }
+
+            int lastNonSpaceIndex = 0;
+            boolean justToCursor = false;
+            if (cursorAtThisRow || oldLine.mLineWrap) {
+                // Take the whole line, either because of cursor on it, or if line wrapping.
+                lastNonSpaceIndex = oldLine.getSpaceUsed();
+                if (cursorAtThisRow) justToCursor = true;
+            } else {
+                for (int i = 0; i < oldLine.getSpaceUsed(); i++)
+                    if (oldLine.mText[i] != ' ') lastNonSpaceIndex = i + 1;
+            }
+
+            int currentOldCol = 0;
+            long styleAtCol = 0;
+            for (int i = 0; i < lastNonSpaceIndex; i++) {
+                // Note that looping over java character, not cells.
+                char c = oldLine.mText[i];
+                int codePoint = (Character.isHighSurrogate(c)) ? Character.toCodePoint(c, oldLine.mText[++i]) : c;
+                int displayWidth = WcWidth.width(codePoint);
+                // Use the last style if this is a zero-width character:
+                if (displayWidth > 0) styleAtCol = oldLine.getStyle(currentOldCol);
+
+                // Line wrap as necessary:
+                if (mOutputColumn + displayWidth > mColumns) {
+                    row(mOutputRow).mLineWrap = true;
+                    lineBreak();
                 }
-                // Old row has been copied. Check if we need to insert newline if old line was not wrapping:
-                if (externalOldRow != (oldScreenRows - 1) && !oldLine.mLineWrap) {
-                    if (currentOutputExternalRow == mScreenRows - 1) {
-                        if (newCursorPlaced) newCursorRow--;
-                        scrollDownOneLine(0, mScreenRows, currentStyle);
-                    } else {
-                        currentOutputExternalRow++;
+
+                int offsetDueToCombiningChar = ((displayWidth <= 0 && mOutputColumn > 0) ? 1 : 0);
+                row(mOutputRow).setChar(mOutputColumn - offsetDueToCombiningChar, codePoint, styleAtCol);
+
+                if (displayWidth > 0) {
+                    if (cursorColumn == currentOldCol) {
+                        mCursorColumn = mOutputColumn;
+                        mCursorRow = mOutputRow;
                     }
-                    currentOutputExternalColumn = 0;
+                    currentOldCol += displayWidth;
+                    mOutputColumn += displayWidth;
+                    if (justToCursor && mCursorRow >= 0) break;
                 }
             }
-
-            cursor[0] = newCursorColumn;
-            cursor[1] = newCursorRow;
+            // Old row has been copied. Check if we need to insert newline if old line was not wrapping:
+            if (!lastRow && !oldLine.mLineWrap) lineBreak();
         }
 
-        // Handle cursor scrolling off screen:
-        if (cursor[0] < 0 || cursor[1] < 0) cursor[0] = cursor[1] = 0;
     }
 
     /**
@@ -385,6 +715,13 @@ public final class TerminalBuffer {
         if (topMargin > bottomMargin - 1 || topMargin < 0 || bottomMargin > mScreenRows)
             throw new IllegalArgumentException("topMargin=" + topMargin + ", bottomMargin=" + bottomMargin + ", mScreenRows=" + mScreenRows);
 
+        if (mTotalRows == mScreenRows && 2 * (bottomMargin - topMargin) < mScreenRows) {
+            // Without a transcript, as in the alternate buffer, rotating the rows of a region smaller than the rest of
+            // the screen moves fewer rows than moving the ring and the rows outside of it.
+            scrollRows(topMargin, bottomMargin, 1, style);
+            return;
+        }
+
         // Copy the fixed topMargin lines one line down so that they remain on screen in same position:
         blockCopyLinesDown(mScreenFirstRow, topMargin);
         // Copy the fixed mScreenRows-bottomMargin lines one line down so that they remain on screen in same
@@ -394,17 +731,72 @@ public final class TerminalBuffer {
         // Update the screen location in the ring buffer:
         mScreenFirstRow = (mScreenFirstRow + 1) % mTotalRows;
         // Note that the history has grown if not already full:
-        if (mActiveTranscriptRows < mTotalRows - mScreenRows) mActiveTranscriptRows++;
+        final boolean transcriptWasFull = mActiveTranscriptRows == mTotalRows - mScreenRows;
+        if (!transcriptWasFull) mActiveTranscriptRows++;
+
+        // Compact the line that scrolled into the transcript, first so that its arrays go to the line blanked below:
+        if (mActiveTranscriptRows > 0) {
+            TerminalRow scrolledOutRow = mLines[externalToInternalRow(-1)];
+            if (scrolledOutRow != null) scrolledOutRow.freeze();
+        }
 
         // Blank the newly revealed line above the bottom margin:
         int blankRow = externalToInternalRow(bottomMargin - 1);
         if (mLines[blankRow] == null) {
-            mLines[blankRow] = new TerminalRow(mColumns, style);
+            mLines[blankRow] = new TerminalRow(mColumns, mStyleTable, mRowPool, style);
         } else {
+            if (transcriptWasFull && mScrollback != null && mActiveTranscriptRows > 0) {
+                // The line blanked is the oldest of the full transcript, newer than any rows left to reflow:
+                if (mRowsToReflowCount > 0) dropRowsToReflow();
+                mScrollback.append(mLines[blankRow]);
+            }
             mLines[blankRow].clear(style);
         }
     }
 
+    /**
+     * Move the full width rows from topMargin to bottomMargin (exclusive) up by a number of lines, or down if negative,
+     * and blank the rows revealed. The row references are rotated instead of their cells copied, and nothing is put into
+     * the transcript.
+     *
+     * @param topMargin    First row that is moved.
+     * @param bottomMargin One row after the last row that is moved.
+     * @param lines        the number of lines to move up, or down if negative.
+     * @param style        the style for the newly revealed rows.
+     */
+    public void scrollRows(int topMargin, int bottomMargin, int lines, long style) {
+        if (topMargin > bottomMargin - 1 || topMargin < 0 || bottomMargin > mScreenRows)
+            throw new IllegalArgumentException("topMargin=" + topMargin + ", bottomMargin=" + bottomMargin + ", mScreenRows=" + mScreenRows);
+
+        final int height = bottomMargin - topMargin;
+        final int distance = Math.min(Math.abs(lines), height);
+        if (distance == 0) return;
+
+        // Rotate the region by reversing the rows moved and the rows revealed, then the whole region:
+        final int split = topMargin + ((lines > 0) ? distance : height - distance);
+        reverseRows(topMargin, split);
+        reverseRows(split, bottomMargin);
+        reverseRows(topMargin, bottomMargin);
+
+        final int firstBlankRow = (lines > 0) ? (bottomMargin - distance) : topMargin;
+        for (int row = firstBlankRow; row < firstBlankRow + distance; row++) {
+            TerminalRow line = allocateFullLineIfNecessary(externalToInternalRow(row));
+            line.clear(style);
+            line.mLineWrap = false;
+        }
+    }
+
+    /** Reverse the order of the rows from startRow to endRow (exclusive). */
+    private void reverseRows(int startRow, int endRow) {
+        for (int i = startRow, j = endRow - 1; i < j; i++, j--) {
+            int internalI = externalToInternalRow(i);
+            int internalJ = externalToInternalRow(j);
+            TerminalRow row = mLines[internalI];
+            mLines[internalI] = mLines[internalJ];
+            mLines[internalJ] = row;
+        }
+    }
+
     /**
      * Block copy characters from one position in the screen to another. The two positions can overlap. All characters
      * of the source and destination must be within the bounds of the screen, or else an InvalidParameterException will
@@ -444,8 +836,24 @@ public final class TerminalBuffer {
                 setChar(sx + x, sy + y, val, style);
     }
 
+    /** The row at an internal index, allocated if null and thawed if frozen, so that its full text can be read. */
     public TerminalRow allocateFullLineIfNecessary(int row) {
-        return (mLines[row] == null) ? (mLines[row] = new TerminalRow(mColumns, 0)) : mLines[row];
+        if (mLines[row] == null) return mLines[row] = new TerminalRow(mColumns, mStyleTable, mRowPool, 0);
+        mLines[row].thaw();
+        return mLines[row];
+    }
+
+    /**
+     * The row at an internal index to read its full text from, like {@link #allocateFullLineIfNecessary(int)} but
+     * leaving a frozen row frozen: it is thawed into a copy instead, which is only valid until the next call.
+     */
+    public TerminalRow getLineForReading(int row) {
+        final TerminalRow line = mLines[row];
+        if (line == null || !line.isFrozen()) return allocateFullLineIfNecessary(row);
+        if (mReadRow == null || mReadRow.getColumns() != line.getColumns() || mReadRow.mStyleTable != line.mStyleTable)
+            mReadRow = new TerminalRow(line);
+        line.thawInto(mReadRow);
+        return mReadRow;
     }
 
     public void setChar(int column, int row, int codePoint, long style) {
@@ -455,8 +863,21 @@ public final class TerminalBuffer {
         allocateFullLineIfNecessary(row).setChar(column, codePoint, style);
     }
 
+    /**
+     * Write a run of printable ASCII characters, all of width one, with the same style from a column on. See
+     * {@link TerminalRow#setAsciiChars(int, byte[], int, int, long)}.
+     */
+    public void setAsciiChars(int column, int row, byte[] chars, int start, int length, long style) {
+        if (row < 0 || row >= mScreenRows || column < 0 || column + length > mColumns)
+            throw new IllegalArgumentException("TerminalBuffer.setAsciiChars(): row=" + row + ", column=" + column + ", length=" + length + ", mScreenRows=" + mScreenRows + ", mColumns=" + mColumns);
+        row = externalToInternalRow(row);
+        allocateFullLineIfNecessary(row).setAsciiChars(column, chars, start, length, style);
+    }
+
     public long getStyleAt(int externalRow, int column) {
-        return allocateFullLineIfNecessary(externalToInternalRow(externalRow)).getStyle(column);
+        final int row = externalToInternalRow(externalRow);
+        // Frozen rows look the style up in their runs without being thawed.
+        return (mLines[row] == null) ? allocateFullLineIfNecessary(row).getStyle(column) : mLines[row].getStyle(column);
     }
 
     /** Support for http://vt100.net/docs/vt510-rm/DECCARA and http://vt100.net/docs/vt510-rm/DECCARA */
@@ -479,12 +900,56 @@ public final class TerminalBuffer {
                 } else {
                     effect &= ~bits;
                 }
-                line.mStyle[x] = TextStyle.encode(foreColor, backColor, effect);
+                line.setStyle(x, TextStyle.encode(foreColor, backColor, effect));
+            }
+        }
+    }
+
+    /**
+     * The rows of the transcript, oldest first, and of the screen, for a {@link TerminalCheckpoint}. The rows left to
+     * reflow are reflowed first, while those of the scrollback file are not included.
+     */
+    TerminalRow[] getCheckpointRows() {
+        reflowTranscript(Integer.MAX_VALUE);
+        final TerminalRow[] rows = new TerminalRow[mActiveTranscriptRows + mScreenRows];
+        for (int i = 0; i < rows.length; i++) {
+            final int internalRow = mScreenFirstRow - mActiveTranscriptRows + i;
+            rows[i] = mLines[(internalRow < 0) ? (mTotalRows + internalRow) : (internalRow % mTotalRows)];
+        }
+        return rows;
+    }
+
+    /**
+     * Replace the rows of this new buffer by those of a {@link TerminalCheckpoint}, read from the records at offsets in
+     * its file, transcript first as given by {@link #getCheckpointRows()}. Null rows have an offset of -1.
+     */
+    void restoreRows(ByteBuffer file, long[] offsets) {
+        final int transcriptRows = offsets.length - mScreenRows;
+        if (transcriptRows < 0 || offsets.length > mTotalRows)
+            throw new IllegalArgumentException("Checkpoint of " + offsets.length + " rows for " + mScreenRows + " screen and " + mTotalRows + " total rows");
+        Arrays.fill(mLines, null);
+        for (int i = 0; i < offsets.length; i++) {
+            if (offsets[i] < 0) {
+                if (i >= transcriptRows) mLines[i] = new TerminalRow(mColumns, mStyleTable, mRowPool, TextStyle.NORMAL);
+                continue;
             }
+            file.position((int) offsets[i]);
+            TerminalRow row = TerminalRow.readFrom(file, mStyleTable, mRowPool);
+            if (row.getColumns() != mColumns)
+                throw new IllegalArgumentException("Checkpoint row of " + row.getColumns() + " columns for " + mColumns);
+            row.mCheckpointOffset = offsets[i];
+            mLines[i] = row;
         }
+        mScreenFirstRow = mActiveTranscriptRows = transcriptRows;
     }
 
     public void clearTranscript() {
+        mRowsToReflow = null;
+        mRowsToReflowCount = 0;
+        if (mScrollback != null) {
+            mScrollback.clear();
+            resetPagedRows();
+        }
         if (mScreenFirstRow < mActiveTranscriptRows) {
             Arrays.fill(mLines, mTotalRows + mScreenFirstRow - mActiveTranscriptRows, mTotalRows, null);
             Arrays.fill(mLines, 0, mScreenFirstRow, null);
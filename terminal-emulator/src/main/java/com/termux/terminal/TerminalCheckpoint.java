@@ -0,0 +1,260 @@
+package com.termux.terminal;
+
+import java.io.ByteArrayOutputStream;
+import java.io.Closeable;
+import java.io.DataOutput;
+import java.io.DataOutputStream;
+import java.io.File;
+import java.io.IOException;
+import java.io.RandomAccessFile;
+import java.nio.ByteBuffer;
+import java.nio.MappedByteBuffer;
+import java.nio.channels.FileChannel;
+import java.util.Random;
+
+/**
+ * A file keeping the state of a {@link TerminalEmulator}, with its screen and transcript, for it to be restored once the
+ * process was killed. Each {@link #write(TerminalEmulator)} appends only the rows changed since the last one, followed by
+ * a state record referring to all the rows by the offsets of their records, and only then points the header to that
+ * record, so that a checkpoint cut short leaves the previous one in place. Restoring maps the file and decodes the rows
+ * straight from it, which takes milliseconds even for a long transcript.
+ * <p/>
+ * The rows scrolled out of the transcript into a {@link ScrollbackFile} are not kept, and the escape sequence parser
+ * starts over in its ground state. Once the file has grown to twice its length when last rewritten, or by a megabyte if
+ * more, with records no longer used, the next checkpoint rewrites it under a new id, as do those of an emulator last
+ * written to another file.
+ * <p/>
+ * The layout of the file, with numbers big-endian:
+ * <pre>
+ * header:       int magic, int version, long file id, long offset of the latest state record, long rewritten length
+ * row record:   see {@link TerminalRow#writeTo(ByteBuffer)}
+ * state record: int columns, int rows, int total rows of the main buffer, the state of the emulator, then for the main
+ *               and the alternate buffer the number of rows and the offset of the record of each, -1 if null
+ * </pre>
+ */
+public final class TerminalCheckpoint implements Closeable {
+
+    private static final int MAGIC = 0x54434B50;
+    private static final int VERSION = 1;
+    private static final int HEADER_BYTES = 32;
+    /** The size of the buffer the row records are gathered in before being written. */
+    private static final int STAGING_BYTES = 256 << 10;
+    /** The number of bytes the file grows by before it is rewritten, however short it was when last rewritten. */
+    private static final int MIN_GROWTH_BYTES = 1 << 20;
+
+    private final File mFile;
+    private FileChannel mChannel;
+    /** The id of the file, or 0 if it is not a checkpoint yet, which rows of an emulator with another one are not in. */
+    private long mFileId;
+    /** The length of the file, where the next records are appended, and its length when last rewritten. */
+    private long mEnd, mRewrittenLength;
+    private ByteBuffer mStaging = ByteBuffer.allocate(STAGING_BYTES);
+    private final Random mRandom = new Random();
+    /** The number of rows written by the last checkpoint. */
+    private int mWrittenRows;
+
+    public TerminalCheckpoint(File file) {
+        mFile = file;
+    }
+
+    public File getFile() {
+        return mFile;
+    }
+
+    int getWrittenRows() {
+        return mWrittenRows;
+    }
+
+    /** Write the changes to an emulator since its last checkpoint to this file, or all of it if that was not here. */
+    public void write(TerminalEmulator emulator) throws IOException {
+        if (mChannel == null) open();
+        final TerminalBuffer[] buffers = {emulator.getMainBuffer(), emulator.mAltBuffer};
+        final TerminalRow[][] rows = new TerminalRow[buffers.length][];
+        for (int i = 0; i < buffers.length; i++)
+            rows[i] = buffers[i].getCheckpointRows();
+
+        final boolean rewrite = mFileId == 0 || emulator.mCheckpointFileId != mFileId
+            || mEnd - mRewrittenLength > Math.max(mRewrittenLength, MIN_GROWTH_BYTES);
+        final File rewriteFile = new File(mFile.getPath() + ".tmp");
+        FileChannel channel = mChannel;
+        long fileId = mFileId, end = mEnd;
+        if (rewrite) {
+            channel = new RandomAccessFile(rewriteFile, "rw").getChannel();
+            do {
+                fileId = mRandom.nextLong();
+            } while (fileId == 0);
+            end = HEADER_BYTES;
+        }
+
+        final long[][] offsets = new long[buffers.length][];
+        int writtenRows = 0;
+        try {
+            if (rewrite) channel.truncate(0);
+            mStaging.clear();
+            for (int i = 0; i < buffers.length; i++) {
+                offsets[i] = new long[rows[i].length];
+                for (int j = 0; j < rows[i].length; j++) {
+                    final TerminalRow row = rows[i][j];
+                    if (row == null || (!rewrite && row.mCheckpointOffset >= 0)) {
+                        offsets[i][j] = (row == null) ? -1 : row.mCheckpointOffset;
+                        continue;
+                    }
+                    final int length = row.getEncodedLength();
+                    if (mStaging.remaining() < length) {
+                        end = flushStaging(channel, end);
+                        if (mStaging.capacity() < length) mStaging = ByteBuffer.allocate(length);
+                    }
+                    offsets[i][j] = end + mStaging.position();
+                    row.writeTo(mStaging);
+                    writtenRows++;
+                }
+            }
+            end = flushStaging(channel, end);
+
+            final ByteArrayOutputStream bytes = new ByteArrayOutputStream();
+            final DataOutputStream out = new DataOutputStream(bytes);
+            out.writeInt(emulator.mColumns);
+            out.writeInt(emulator.mRows);
+            out.writeInt(buffers[0].mTotalRows);
+            emulator.writeState(out);
+            for (long[] bufferOffsets : offsets) {
+                out.writeInt(bufferOffsets.length);
+                for (long offset : bufferOffsets)
+                    out.writeLong(offset);
+            }
+            final long stateOffset = end;
+            writeFully(channel, ByteBuffer.wrap(bytes.toByteArray()), stateOffset);
+            end += bytes.size();
+            final long rewrittenLength = rewrite ? end : mRewrittenLength;
+
+            // The records must be on disk before the header points to them:
+            channel.force(false);
+            final ByteBuffer header = ByteBuffer.allocate(HEADER_BYTES);
+            header.putInt(MAGIC).putInt(VERSION).putLong(fileId).putLong(stateOffset).putLong(rewrittenLength);
+            header.flip();
+            writeFully(channel, header, 0);
+            channel.force(false);
+
+            if (rewrite) {
+                if (!rewriteFile.renameTo(mFile)) throw new IOException("Cannot rename " + rewriteFile + " to " + mFile);
+                mChannel.close();
+                mChannel = channel;
+            }
+        } catch (IOException | RuntimeException e) {
+            if (rewrite) {
+                channel.close();
+                //noinspection ResultOfMethodCallIgnored
+                rewriteFile.delete();
+            }
+            throw e;
+        }
+
+        mFileId = emulator.mCheckpointFileId = fileId;
+        mEnd = end;
+        if (rewrite) mRewrittenLength = end;
+        mWrittenRows = writtenRows;
+        for (int i = 0; i < buffers.length; i++)
+            for (int j = 0; j < rows[i].length; j++)
+                if (rows[i][j] != null) rows[i][j].mCheckpointOffset = offsets[i][j];
+    }
+
+    /**
+     * Restore an emulator from the latest checkpoint written to a file, its rows decoded from the file mapped into
+     * memory. It has the size it had, and rows written to the file again are only those changed since.
+     */
+    public static TerminalEmulator restore(File file, TerminalOutput session, int cellWidthPixels, int cellHeightPixels,
+                                           TerminalSessionClient client) throws IOException {
+        final MappedByteBuffer map;
+        try (RandomAccessFile randomAccessFile = new RandomAccessFile(file, "r")) {
+            final long length = randomAccessFile.length();
+            if (length > Integer.MAX_VALUE) throw new IOException("Terminal checkpoint too large to map: " + file);
+            // The mapping outlives the channel:
+            map = randomAccessFile.getChannel().map(FileChannel.MapMode.READ_ONLY, 0, length);
+        }
+
+        try {
+            if (map.getInt() != MAGIC || map.getInt() != VERSION) throw new IOException("Not a terminal checkpoint: " + file);
+            final long fileId = map.getLong();
+            map.position((int) map.getLong());
+            final int columns = map.getInt(), rows = map.getInt(), totalRows = map.getInt();
+            final TerminalEmulator emulator = new TerminalEmulator(session, columns, rows, cellWidthPixels, cellHeightPixels, totalRows, client);
+            emulator.readState(map);
+            final long[] mainOffsets = readOffsets(map);
+            final long[] altOffsets = readOffsets(map);
+            emulator.getMainBuffer().restoreRows(map, mainOffsets);
+            emulator.mAltBuffer.restoreRows(map, altOffsets);
+            emulator.mCheckpointFileId = fileId;
+            return emulator;
+        } catch (RuntimeException e) {
+            throw new IOException("Corrupt terminal checkpoint: " + file, e);
+        }
+    }
+
+    @Override
+    public void close() throws IOException {
+        if (mChannel != null) {
+            mChannel.close();
+            mChannel = null;
+        }
+    }
+
+    /** Open the file, created if missing, taking its id from its header if it is a checkpoint. */
+    private void open() throws IOException {
+        mChannel = new RandomAccessFile(mFile, "rw").getChannel();
+        final ByteBuffer header = ByteBuffer.allocate(HEADER_BYTES);
+        while (header.hasRemaining() && mChannel.read(header, header.position()) > 0) {
+            // Read on until the header is complete or the file ends.
+        }
+        header.flip();
+        if (header.remaining() == HEADER_BYTES && header.getInt() == MAGIC && header.getInt() == VERSION) {
+            mFileId = header.getLong();
+            header.getLong();
+            mRewrittenLength = header.getLong();
+            mEnd = mChannel.size();
+        }
+    }
+
+    /** Write the rows gathered in the staging buffer at an offset, returning the offset following them. */
+    private long flushStaging(FileChannel channel, long offset) throws IOException {
+        mStaging.flip();
+        final int length = mStaging.remaining();
+        writeFully(channel, mStaging, offset);
+        mStaging.clear();
+        return offset + length;
+    }
+
+    private static void writeFully(FileChannel channel, ByteBuffer buffer, long offset) throws IOException {
+        while (buffer.hasRemaining())
+            offset += channel.write(buffer, offset);
+    }
+
+    private static long[] readOffsets(ByteBuffer in) {
+        final int count = in.getInt();
+        if (count < 0 || count > in.remaining() / 8) throw new IllegalArgumentException("Bad row count: " + count);
+        final long[] offsets = new long[count];
+        for (int i = 0; i < count; i++)
+            offsets[i] = in.getLong();
+        return offsets;
+    }
+
+    /** Write a string, which may be null, as its length and chars. Read back by {@link #readString(ByteBuffer)}. */
+    static void writeString(DataOutput out, String string) throws IOException {
+        if (string == null) {
+            out.writeInt(-1);
+        } else {
+            out.writeInt(string.length());
+            out.writeChars(string);
+        }
+    }
+
+    static String readString(ByteBuffer in) {
+        final int length = in.getInt();
+        if (length < 0) return null;
+        if (length > in.remaining() / 2) throw new IllegalArgumentException("Bad string length: " + length);
+        final char[] chars = new char[length];
+        for (int i = 0; i < length; i++)
+            chars[i] = in.getChar();
+        return new String(chars);
+    }
+
+}
@@ -2,6 +2,10 @@ package com.termux.terminal;
 
 import android.util.Base64;
 
+import java.io.DataOutput;
+import java.io.File;
+import java.io.IOException;
+import java.nio.ByteBuffer;
 import java.nio.charset.StandardCharsets;
 import java.util.Arrays;
 import java.util.Locale;
@@ -172,6 +176,8 @@ public final class TerminalEmulator {
     final TerminalBuffer mAltBuffer;
     /** The current screen buffer, pointing at either {@link #mMainBuffer} or {@link #mAltBuffer}. */
     private TerminalBuffer mScreen;
+    /** The id of the {@link TerminalCheckpoint} file the checkpoint offsets of the rows refer to, or 0 if none. */
+    long mCheckpointFileId;
 
     /** The terminal session this emulator is bound to. */
     private final TerminalOutput mSession;
@@ -267,6 +273,10 @@ public final class TerminalEmulator {
 
     private byte mUtf8ToFollow, mUtf8Index;
     private final byte[] mUtf8InputBuffer = new byte[4];
+    /** The result of {@link #decodeUtf8(byte[], int, int)}. */
+    private int mDecodedCodePoint;
+    /** Where {@link #append(ByteBuffer, int, int)} copies bytes to for processing. */
+    private final byte[] mAppendBuffer = new byte[4096];
     private int mLastEmittedCodePoint = -1;
 
     public final TerminalColors mColors = new TerminalColors();
@@ -348,6 +358,10 @@ public final class TerminalEmulator {
         return mScreen;
     }
 
+    TerminalBuffer getMainBuffer() {
+        return mMainBuffer;
+    }
+
     public boolean isAlternateBufferActive() {
         return mScreen == mAltBuffer;
     }
@@ -413,6 +427,115 @@ public final class TerminalEmulator {
         resizeScreen();
     }
 
+    /**
+     * Continue reflowing the transcript left by a resize of the main buffer, by up to about a number of rows. Returns
+     * whether rows are left to reflow. See {@link TerminalBuffer#reflowTranscript(int)}.
+     */
+    public boolean reflowTranscript(int maxRows) {
+        return mMainBuffer.reflowTranscript(maxRows);
+    }
+
+    /**
+     * Keep up to a number of rows scrolled out of the full transcript of the main buffer in memory-mapped files in a
+     * directory, compressed or not, or stop if null. See {@link TerminalBuffer#setScrollbackDirectory(File, int, boolean)}.
+     */
+    public void setScrollbackDirectory(File directory, int maxRows, boolean compress) {
+        mMainBuffer.setScrollbackDirectory(directory, maxRows, compress);
+    }
+
+    /** See {@link TerminalBuffer#releaseScrollbackCompressor()}. */
+    void releaseScrollbackCompressor() {
+        mMainBuffer.releaseScrollbackCompressor();
+    }
+
+    /**
+     * Write the state of this emulator for a {@link TerminalCheckpoint}, but for its buffers and the state of the escape
+     * sequence parser, which starts over on restore. Read back by {@link #readState(ByteBuffer)}.
+     */
+    void writeState(DataOutput out) throws IOException {
+        TerminalCheckpoint.writeString(out, mTitle);
+        out.writeInt(mTitleStack.size());
+        for (String title : mTitleStack)
+            TerminalCheckpoint.writeString(out, title);
+        out.writeInt(mCursorRow);
+        out.writeInt(mCursorCol);
+        out.writeInt(mCursorStyle);
+        out.writeBoolean(isAlternateBufferActive());
+        out.writeInt(mCurrentDecSetFlags);
+        out.writeInt(mSavedDecSetFlags);
+        out.writeBoolean(mInsertMode);
+        for (boolean tabStop : mTabStop)
+            out.writeBoolean(tabStop);
+        out.writeInt(mTopMargin);
+        out.writeInt(mBottomMargin);
+        out.writeInt(mLeftMargin);
+        out.writeInt(mRightMargin);
+        out.writeBoolean(mAboutToAutoWrap);
+        out.writeInt(mForeColor);
+        out.writeInt(mBackColor);
+        out.writeInt(mUnderlineColor);
+        out.writeInt(mEffect);
+        out.writeBoolean(mUseLineDrawingG0);
+        out.writeBoolean(mUseLineDrawingG1);
+        out.writeBoolean(mUseLineDrawingUsesG0);
+        for (SavedScreenState state : new SavedScreenState[]{mSavedStateMain, mSavedStateAlt}) {
+            out.writeInt(state.mSavedCursorRow);
+            out.writeInt(state.mSavedCursorCol);
+            out.writeInt(state.mSavedEffect);
+            out.writeInt(state.mSavedForeColor);
+            out.writeInt(state.mSavedBackColor);
+            out.writeInt(state.mSavedDecFlags);
+            out.writeBoolean(state.mUseLineDrawingG0);
+            out.writeBoolean(state.mUseLineDrawingG1);
+            out.writeBoolean(state.mUseLineDrawingUsesG0);
+        }
+        for (int color : mColors.mCurrentColors)
+            out.writeInt(color);
+    }
+
+    /** Restore the state written by {@link #writeState(DataOutput)} into this emulator, of the same size. */
+    void readState(ByteBuffer in) {
+        setTitle(TerminalCheckpoint.readString(in));
+        mTitleStack.clear();
+        for (int i = in.getInt(); i > 0; i--)
+            mTitleStack.push(TerminalCheckpoint.readString(in));
+        mCursorRow = in.getInt();
+        mCursorCol = in.getInt();
+        mCursorStyle = in.getInt();
+        mScreen = (in.get() != 0) ? mAltBuffer : mMainBuffer;
+        mCurrentDecSetFlags = in.getInt();
+        mSavedDecSetFlags = in.getInt();
+        mInsertMode = in.get() != 0;
+        for (int i = 0; i < mTabStop.length; i++)
+            mTabStop[i] = in.get() != 0;
+        mTopMargin = in.getInt();
+        mBottomMargin = in.getInt();
+        mLeftMargin = in.getInt();
+        mRightMargin = in.getInt();
+        mAboutToAutoWrap = in.get() != 0;
+        mForeColor = in.getInt();
+        mBackColor = in.getInt();
+        mUnderlineColor = in.getInt();
+        mEffect = in.getInt();
+        mUseLineDrawingG0 = in.get() != 0;
+        mUseLineDrawingG1 = in.get() != 0;
+        mUseLineDrawingUsesG0 = in.get() != 0;
+        for (SavedScreenState state : new SavedScreenState[]{mSavedStateMain, mSavedStateAlt}) {
+            state.mSavedCursorRow = in.getInt();
+            state.mSavedCursorCol = in.getInt();
+            state.mSavedEffect = in.getInt();
+            state.mSavedForeColor = in.getInt();
+            state.mSavedBackColor = in.getInt();
+            state.mSavedDecFlags = in.getInt();
+            state.mUseLineDrawingG0 = in.get() != 0;
+            state.mUseLineDrawingG1 = in.get() != 0;
+            state.mUseLineDrawingUsesG0 = in.get() != 0;
+        }
+        for (int i = 0; i < mColors.mCurrentColors.length; i++)
+            mColors.mCurrentColors[i] = in.getInt();
+        mSession.onColorsChanged();
+    }
+
     private void resizeScreen() {
         final int[] cursor = {mCursorCol, mCursorRow};
         int newTotalRows = (mScreen == mAltBuffer) ? mRows : mMainBuffer.mTotalRows;
@@ -498,8 +621,85 @@ public final class TerminalEmulator {
      * @param length the number of bytes in the array to process
      */
     public void append(byte[] buffer, int length) {
-        for (int i = 0; i < length; i++)
-            processByte(buffer[i]);
+        processBytes(buffer, 0, length);
+    }
+
+    /** Process length bytes at offset of a buffer, such as the direct buffer output of the process is read into. */
+    public void append(ByteBuffer buffer, int offset, int length) {
+        // Copied out in bulk, as going through the buffer byte by byte is slow.
+        ByteBuffer view = buffer.duplicate();
+        view.position(offset);
+        while (length > 0) {
+            int chunk = Math.min(length, mAppendBuffer.length);
+            view.get(mAppendBuffer, 0, chunk);
+            processBytes(mAppendBuffer, 0, chunk);
+            length -= chunk;
+        }
+    }
+
+    /**
+     * Process bytes, passing runs of printable ASCII outside of escape sequences to {@link #emitAsciiRun(byte[], int, int)}
+     * at once instead of taking each byte through {@link #processByte(byte)} and {@link #processCodePoint(int)}, and
+     * decoding UTF-8 sequences which are complete in the buffer in one go.
+     * <p/>
+     * Malformed and split sequences are left to processByte(), so that they are handled exactly as before.
+     */
+    private void processBytes(byte[] buffer, int offset, int length) {
+        final int end = offset + length;
+        int i = offset;
+        while (i < end) {
+            if (mUtf8ToFollow == 0) {
+                byte b = buffer[i];
+                if (b >= 32 && mEscapeState == ESC_NONE) {
+                    // As bytes are signed, this is 0x20 to 0x7F, which processCodePoint() would emit as they are.
+                    int runEnd = i + 1;
+                    while (runEnd < end && buffer[runEnd] >= 32)
+                        runEnd++;
+                    emitAsciiRun(buffer, i, runEnd);
+                    i = runEnd;
+                    continue;
+                } else if (b < 0) {
+                    int sequenceLength = decodeUtf8(buffer, i, end);
+                    if (sequenceLength != 0) {
+                        processDecodedCodePoint(mDecodedCodePoint, sequenceLength);
+                        i += sequenceLength;
+                        continue;
+                    }
+                }
+            }
+            processByte(buffer[i++]);
+        }
+    }
+
+    /**
+     * Decode a UTF-8 sequence starting with a lead byte at start into {@link #mDecodedCodePoint}.
+     *
+     * @return the length of the sequence, or 0 if it is invalid or not complete before end.
+     */
+    private int decodeUtf8(byte[] buffer, int start, int end) {
+        int lead = buffer[start] & 0xFF;
+        int sequenceLength;
+        int codePoint;
+        if ((lead & 0b11100000) == 0b11000000) {
+            sequenceLength = 2;
+            codePoint = lead & 0b00011111;
+        } else if ((lead & 0b11110000) == 0b11100000) {
+            sequenceLength = 3;
+            codePoint = lead & 0b00001111;
+        } else if ((lead & 0b11111000) == 0b11110000) {
+            sequenceLength = 4;
+            codePoint = lead & 0b00000111;
+        } else {
+            return 0;
+        }
+        if (start + sequenceLength > end) return 0;
+        for (int i = start + 1; i < start + sequenceLength; i++) {
+            int continuation = buffer[i];
+            if ((continuation & 0b11000000) != 0b10000000) return 0;
+            codePoint = (codePoint << 6) | (continuation & 0b00111111);
+        }
+        mDecodedCodePoint = codePoint;
+        return sequenceLength;
     }
 
     private void processByte(byte byteToProcess) {
@@ -512,28 +712,9 @@ public final class TerminalEmulator {
                     int codePoint = (mUtf8InputBuffer[0] & firstByteMask);
                     for (int i = 1; i < mUtf8Index; i++)
                         codePoint = ((codePoint << 6) | (mUtf8InputBuffer[i] & 0b00111111));
-                    if (((codePoint <= 0b1111111) && mUtf8Index > 1) || (codePoint < 0b11111111111 && mUtf8Index > 2)
-                        || (codePoint < 0b1111111111111111 && mUtf8Index > 3)) {
-                        // Overlong encoding.
-                        codePoint = UNICODE_REPLACEMENT_CHAR;
-                    }
-
+                    int sequenceLength = mUtf8Index;
                     mUtf8Index = mUtf8ToFollow = 0;
-
-                    if (codePoint >= 0x80 && codePoint <= 0x9F) {
-                        // Sequence decoded to a C1 control character which we ignore. They are
-                        // not used nowadays and increases the risk of messing up the terminal state
-                        // on binary input. XTerm does not allow them in utf-8:
-                        // "It is not possible to use a C1 control obtained from decoding the
-                        // UTF-8 text" - http://invisible-island.net/xterm/ctlseqs/ctlseqs.html
-                    } else {
-                        switch (Character.getType(codePoint)) {
-                            case Character.UNASSIGNED:
-                            case Character.SURROGATE:
-                                codePoint = UNICODE_REPLACEMENT_CHAR;
-                        }
-                        processCodePoint(codePoint);
-                    }
+                    processDecodedCodePoint(codePoint, sequenceLength);
                 }
             } else {
                 // Not a UTF-8 continuation byte so replace the entire sequence up to now with the replacement char:
@@ -567,6 +748,30 @@ public final class TerminalEmulator {
         }
     }
 
+    /** Process a code point decoded from a complete UTF-8 sequence of the specified length. */
+    private void processDecodedCodePoint(int codePoint, int sequenceLength) {
+        if (((codePoint <= 0b1111111) && sequenceLength > 1) || (codePoint < 0b11111111111 && sequenceLength > 2)
+            || (codePoint < 0b1111111111111111 && sequenceLength > 3)) {
+            // Overlong encoding.
+            codePoint = UNICODE_REPLACEMENT_CHAR;
+        }
+
+        if (codePoint >= 0x80 && codePoint <= 0x9F) {
+            // Sequence decoded to a C1 control character which we ignore. They are
+            // not used nowadays and increases the risk of messing up the terminal state
+            // on binary input. XTerm does not allow them in utf-8:
+            // "It is not possible to use a C1 control obtained from decoding the
+            // UTF-8 text" - http://invisible-island.net/xterm/ctlseqs/ctlseqs.html
+        } else {
+            switch (Character.getType(codePoint)) {
+                case Character.UNASSIGNED:
+                case Character.SURROGATE:
+                    codePoint = UNICODE_REPLACEMENT_CHAR;
+            }
+            processCodePoint(codePoint);
+        }
+    }
+
     public void processCodePoint(int b) {
         // The Application Program-Control (APC) string might be arbitrary non-printable characters, so handle that early.
         if (mEscapeState == ESC_APC) {
@@ -1462,8 +1667,12 @@ public final class TerminalEmulator {
                 // http://www.vt100.net/docs/vt100-ug/chapter3.html: "Move the active position to the same horizontal
                 // position on the preceding line. If the active position is at the top margin, a scroll down is performed".
                 if (mCursorRow <= mTopMargin) {
-                    mScreen.blockCopy(mLeftMargin, mTopMargin, mRightMargin - mLeftMargin, mBottomMargin - (mTopMargin + 1), mLeftMargin, mTopMargin + 1);
-                    blockClear(mLeftMargin, mTopMargin, mRightMargin - mLeftMargin);
+                    if (mLeftMargin == 0 && mRightMargin == mColumns) {
+                        mScreen.scrollRows(mTopMargin, mBottomMargin, -1, getStyle());
+                    } else {
+                        mScreen.blockCopy(mLeftMargin, mTopMargin, mRightMargin - mLeftMargin, mBottomMargin - (mTopMargin + 1), mLeftMargin, mTopMargin + 1);
+                        blockClear(mLeftMargin, mTopMargin, mRightMargin - mLeftMargin);
+                    }
                 } else {
                     mCursorRow--;
                 }
@@ -1627,9 +1836,7 @@ public final class TerminalEmulator {
             {
                 int linesAfterCursor = mBottomMargin - mCursorRow;
                 int linesToInsert = Math.min(getArg0(1), linesAfterCursor);
-                int linesToMove = linesAfterCursor - linesToInsert;
-                mScreen.blockCopy(0, mCursorRow, mColumns, linesToMove, 0, mCursorRow + linesToInsert);
-                blockClear(0, mCursorRow, mColumns, linesToInsert);
+                if (linesToInsert > 0) mScreen.scrollRows(mCursorRow, mBottomMargin, -linesToInsert, getStyle());
             }
             break;
             case 'M': // "${CSI}${N}M" - delete N lines (DL).
@@ -1637,9 +1844,7 @@ public final class TerminalEmulator {
                 mAboutToAutoWrap = false;
                 int linesAfterCursor = mBottomMargin - mCursorRow;
                 int linesToDelete = Math.min(getArg0(1), linesAfterCursor);
-                int linesToMove = linesAfterCursor - linesToDelete;
-                mScreen.blockCopy(0, mCursorRow + linesToDelete, mColumns, linesToMove, 0, mCursorRow);
-                blockClear(0, mCursorRow + linesToMove, mColumns, linesToDelete);
+                if (linesToDelete > 0) mScreen.scrollRows(mCursorRow, mBottomMargin, linesToDelete, getStyle());
             }
             break;
             case 'P': // "${CSI}{N}P" - delete ${N} characters (DCH).
@@ -1672,8 +1877,12 @@ public final class TerminalEmulator {
                     final int linesToScrollArg = getArg0(1);
                     final int linesBetweenTopAndBottomMargins = mBottomMargin - mTopMargin;
                     final int linesToScroll = Math.min(linesBetweenTopAndBottomMargins, linesToScrollArg);
-                    mScreen.blockCopy(mLeftMargin, mTopMargin, mRightMargin - mLeftMargin, linesBetweenTopAndBottomMargins - linesToScroll, mLeftMargin, mTopMargin + linesToScroll);
-                    blockClear(mLeftMargin, mTopMargin, mRightMargin - mLeftMargin, linesToScroll);
+                    if (mLeftMargin == 0 && mRightMargin == mColumns) {
+                        mScreen.scrollRows(mTopMargin, mBottomMargin, -linesToScroll, getStyle());
+                    } else {
+                        mScreen.blockCopy(mLeftMargin, mTopMargin, mRightMargin - mLeftMargin, linesBetweenTopAndBottomMargins - linesToScroll, mLeftMargin, mTopMargin + linesToScroll);
+                        blockClear(mLeftMargin, mTopMargin, mRightMargin - mLeftMargin, linesToScroll);
+                    }
                 } else {
                     // "${CSI}${func};${startx};${starty};${firstrow};${lastrow}T" - initiate highlight mouse tracking.
                     unimplementedSequence(b);
@@ -2495,6 +2704,49 @@ public final class TerminalEmulator {
         mCursorCol = Math.min(mCursorCol + displayWidth, mRightMargin - 1);
     }
 
+    /**
+     * Send a run of bytes from 0x20 to 0x7F, from start to end (exclusive) of buffer, to the screen.
+     * <p/>
+     * Stretches of characters which fit before the right margin are written to the row at once, with the same effect
+     * as {@link #emitCodePoint(int)} for each. What needs more care - wrapping to the next line, DEL, the line drawing
+     * character set and insert mode - is left to emitCodePoint().
+     */
+    private void emitAsciiRun(byte[] buffer, int start, int end) {
+        if (mInsertMode || (mUseLineDrawingUsesG0 ? mUseLineDrawingG0 : mUseLineDrawingG1)) {
+            for (int i = start; i < end; i++)
+                emitCodePoint(buffer[i]);
+            return;
+        }
+
+        final boolean autoWrap = isDecsetInternalBitSet(DECSET_BIT_AUTOWRAP);
+        final long style = getStyle();
+        while (start < end) {
+            final int room = mRightMargin - mCursorCol;
+            if (buffer[start] == 127 || room <= 0 || (autoWrap && room == 1 && mAboutToAutoWrap)) {
+                emitCodePoint(buffer[start++]);
+                continue;
+            }
+            if (!autoWrap && room == 1) {
+                // Each character overwrites the last column, so only the last before a DEL remains.
+                while (start + 1 < end && buffer[start + 1] != 127)
+                    start++;
+            }
+
+            int spanEnd = start;
+            final int limit = Math.min(end, start + room);
+            while (spanEnd < limit && buffer[spanEnd] != 127)
+                spanEnd++;
+            final int length = spanEnd - start;
+            mScreen.setAsciiChars(mCursorCol, mCursorRow, buffer, start, length, style);
+            mLastEmittedCodePoint = buffer[spanEnd - 1];
+
+            final int lastColumn = mCursorCol + length - 1;
+            if (autoWrap) mAboutToAutoWrap = (lastColumn == mRightMargin - 1);
+            mCursorCol = Math.min(lastColumn + 1, mRightMargin - 1);
+            start = spanEnd;
+        }
+    }
+
     private void setCursorRow(int row) {
         mCursorRow = row;
         mAboutToAutoWrap = false;
@@ -0,0 +1,280 @@
+package com.termux.terminal;
+
+import java.util.ArrayList;
+import java.util.HashMap;
+import java.util.Map;
+import java.util.concurrent.ConcurrentLinkedQueue;
+
+/**
+ * Performs the I/O of all {@link TerminalSession}s on a single thread, which waits on one native epoll instance for
+ * output from, room for input to and exit of every subprocess. The number of threads and wakeups thereby stays constant
+ * as the number of sessions grows, instead of three threads being started per session. Output is read straight into
+ * the {@link DirectByteRing} of each session, from which the emulator processes it in place. The main thread is told
+ * about new output as decided by the {@link OutputCoalescer} of the session.
+ * <p/>
+ * Each session is represented by a {@link Channel}, whose state besides the flags is only touched by the reactor thread.
+ */
+final class TerminalReactor {
+
+    /** Event types reported by {@link JNI#reactorPoll(int[], long[], int)}, matching REACTOR_EVENT_* in termux.c. */
+    private static final int EVENT_INPUT = 1;
+    private static final int EVENT_OUTPUT_READY = 2;
+    private static final int EVENT_EXIT = 3;
+    private static final int EVENT_INTS = 4;
+
+    private static TerminalReactor sInstance;
+
+    /** The reactor, started on first use. */
+    static synchronized TerminalReactor getInstance() {
+        if (sInstance == null) {
+            sInstance = new TerminalReactor();
+            sInstance.mThread.start();
+        }
+        return sInstance;
+    }
+
+    /** The I/O state of a session. */
+    static final class Channel {
+        final TerminalSession mSession;
+        final int mFileDescriptor;
+        final int mToken;
+        /** Whether the exit of the process is reported by the reactor, else it has to be waited for separately. */
+        boolean mExitTracked;
+        /** Set by the reactor thread once the pty has been closed. */
+        boolean mClosed;
+
+        /** Set while reading from the pty is paused because the ring of the session is full. */
+        volatile boolean mInputPaused;
+        /** Set once the slave side of the pty has been closed. */
+        boolean mHungUp;
+
+        /** Set while waiting for the pty to accept more input. */
+        boolean mOutputBlocked;
+
+        final OutputCoalescer mCoalescer = new OutputCoalescer();
+        /** Set while a {@link TerminalSession#MSG_NEW_INPUT} is queued, cleared by the main thread when handling it. */
+        volatile boolean mNewInputQueued;
+
+        Channel(TerminalSession session, int fileDescriptor, int token) {
+            mSession = session;
+            mFileDescriptor = fileDescriptor;
+            mToken = token;
+        }
+    }
+
+    private final Thread mThread = new Thread("TermSessionReactor") {
+        @Override
+        public void run() {
+            runLoop();
+        }
+    };
+
+    /** Channels by token. Guarded by this. */
+    private final Map<Integer, Channel> mChannels = new HashMap<>();
+    private int mNextToken = 1;
+
+    /** Work handed to the reactor thread by other threads. */
+    private final ConcurrentLinkedQueue<Channel> mPendingWrites = new ConcurrentLinkedQueue<>();
+    private final ConcurrentLinkedQueue<Channel> mPendingResumes = new ConcurrentLinkedQueue<>();
+    private final ConcurrentLinkedQueue<Channel> mPendingCloses = new ConcurrentLinkedQueue<>();
+
+    private final int[] mEvents = new int[128 * EVENT_INTS];
+    private final long[] mResourceUsage = new long[64 * ProcessResourceUsage.LONGS];
+    /** Channels whose coalescer holds output the main thread has not been told about yet. */
+    private final ArrayList<Channel> mHoldingChannels = new ArrayList<>();
+
+    private TerminalReactor() {
+        mThread.setDaemon(true);
+    }
+
+    /** Start serving the pty of a session. */
+    Channel register(TerminalSession session, int fileDescriptor, int processId) {
+        Channel channel;
+        synchronized (this) {
+            channel = new Channel(session, fileDescriptor, mNextToken++);
+            mChannels.put(channel.mToken, channel);
+        }
+        channel.mExitTracked = JNI.reactorAdd(fileDescriptor, processId, channel.mToken);
+        return channel;
+    }
+
+    /** Have input queued in {@link TerminalSession#mTerminalToProcessIOQueue} written to the pty. */
+    void requestWrite(Channel channel) {
+        mPendingWrites.add(channel);
+        JNI.reactorWake();
+    }
+
+    /** Called when the session has consumed output, to resume reading if it was paused. */
+    void consumed(Channel channel) {
+        if (channel.mInputPaused) {
+            mPendingResumes.add(channel);
+            JNI.reactorWake();
+        }
+    }
+
+    /** Stop serving the pty of a session and close it. */
+    void close(Channel channel) {
+        mPendingCloses.add(channel);
+        JNI.reactorWake();
+    }
+
+    private void runLoop() {
+        int timeoutMillis = -1;
+        while (true) {
+            int eventCount = JNI.reactorPoll(mEvents, mResourceUsage, timeoutMillis);
+            for (int i = 0; i < eventCount; i++) {
+                int type = mEvents[i * EVENT_INTS];
+                Channel channel;
+                synchronized (this) {
+                    channel = mChannels.get(mEvents[i * EVENT_INTS + 1]);
+                }
+                if (channel == null) continue;
+                switch (type) {
+                    case EVENT_INPUT:
+                        readInput(channel);
+                        break;
+                    case EVENT_OUTPUT_READY:
+                        flushOutput(channel);
+                        break;
+                    case EVENT_EXIT:
+                        // Pick up output which is left before the session stops reading.
+                        readInput(channel);
+                        if (channel.mCoalescer.isHolding()) notifyNewInput(channel);
+                        ProcessResourceUsage usage = new ProcessResourceUsage(mResourceUsage, mEvents[i * EVENT_INTS + 3] * ProcessResourceUsage.LONGS);
+                        channel.mSession.notifyProcessExited(mEvents[i * EVENT_INTS + 2], usage);
+                        break;
+                }
+            }
+
+            Channel channel;
+            while ((channel = mPendingResumes.poll()) != null) {
+                readInput(channel);
+            }
+            while ((channel = mPendingWrites.poll()) != null) {
+                flushOutput(channel);
+            }
+            while ((channel = mPendingCloses.poll()) != null) {
+                synchronized (this) {
+                    if (mChannels.remove(channel.mToken) == null) continue;
+                }
+                channel.mClosed = true;
+                JNI.reactorRemove(channel.mFileDescriptor);
+                JNI.close(channel.mFileDescriptor);
+            }
+
+            timeoutMillis = flushHeldInput();
+        }
+    }
+
+    /**
+     * Tell the main thread about held output whose time has come.
+     *
+     * @return the time until the next channel is due in milliseconds, rounded up, or -1 if none holds output.
+     */
+    private int flushHeldInput() {
+        long now = System.nanoTime();
+        long nextDeadline = Long.MAX_VALUE;
+        for (int i = mHoldingChannels.size() - 1; i >= 0; i--) {
+            Channel channel = mHoldingChannels.get(i);
+            if (channel.mClosed || !channel.mCoalescer.isHolding()) {
+                mHoldingChannels.remove(i);
+                continue;
+            }
+            long deadline = channel.mCoalescer.flushDeadline();
+            if (deadline - now <= 0) {
+                notifyNewInput(channel);
+                mHoldingChannels.remove(i);
+            } else {
+                nextDeadline = Math.min(nextDeadline, deadline - now);
+            }
+        }
+        return nextDeadline == Long.MAX_VALUE ? -1 : (int) ((nextDeadline + 999_999) / 1_000_000);
+    }
+
+    /** Post a {@link TerminalSession#MSG_NEW_INPUT}, unless one is still queued, which will see the output as well. */
+    private void notifyNewInput(Channel channel) {
+        channel.mCoalescer.flushed();
+        if (channel.mNewInputQueued) return;
+        channel.mNewInputQueued = true;
+        channel.mCoalescer.mMessageCount++;
+        channel.mSession.mMainThreadHandler.sendEmptyMessage(TerminalSession.MSG_NEW_INPUT);
+    }
+
+    /** Read output of the process straight into the ring of the session, pausing reading while the ring is full. */
+    private void readInput(Channel channel) {
+        if (channel.mClosed || channel.mHungUp) return;
+        TerminalSession session = channel.mSession;
+        DirectByteRing ring = session.mProcessToTerminalRing;
+        OutputCoalescer coalescer = channel.mCoalescer;
+        boolean wasPaused = channel.mInputPaused;
+        boolean readAny = false;
+
+        while (true) {
+            int length = ring.writableLength();
+            if (length == 0) {
+                if (channel.mInputPaused) break;
+                // Publish the pause before checking for room once more, so that a consumer in between is not missed.
+                channel.mInputPaused = true;
+                continue;
+            }
+            channel.mInputPaused = false;
+
+            int bytesRead = JNI.readPty(channel.mFileDescriptor, ring.mBuffer, ring.writableOffset(), length);
+            if (bytesRead < 0) {
+                // The exit of the process is reported separately.
+                channel.mHungUp = true;
+                setInterest(channel);
+                break;
+            } else if (bytesRead == 0) {
+                break;
+            }
+            ring.commitWrite(bytesRead);
+            coalescer.onRead(bytesRead);
+            readAny = true;
+            // Only read on if the ring wrapped around, to be fair to other sessions.
+            if (bytesRead < length || ring.writableOffset() != 0) break;
+        }
+
+        if (readAny) {
+            boolean wasHolding = coalescer.isHolding();
+            // A full ring is only drained once the main thread is told.
+            if (coalescer.shouldFlush(System.nanoTime()) || channel.mInputPaused) {
+                notifyNewInput(channel);
+            } else if (!wasHolding) {
+                mHoldingChannels.add(channel);
+            }
+        }
+        if (channel.mHungUp && coalescer.isHolding()) notifyNewInput(channel);
+        if (wasPaused != channel.mInputPaused) setInterest(channel);
+    }
+
+    /** Write queued input to the pty, straight from the ring, until it is drained or the pty is full. */
+    private void flushOutput(Channel channel) {
+        if (channel.mClosed) return;
+        ByteRing ring = channel.mSession.mTerminalToProcessIOQueue;
+        int length;
+        while ((length = ring.acquireRead()) > 0) {
+            int written = JNI.reactorWrite(channel.mFileDescriptor, ring.readArray(), ring.readOffset(), length);
+            if (written < 0) {
+                // The process is gone, drop the input as the writer thread used to.
+                written = length;
+            } else if (written == 0) {
+                if (!channel.mOutputBlocked) {
+                    channel.mOutputBlocked = true;
+                    setInterest(channel);
+                }
+                return;
+            }
+            ring.commitRead(written);
+        }
+        if (channel.mOutputBlocked) {
+            channel.mOutputBlocked = false;
+            setInterest(channel);
+        }
+    }
+
+    private void setInterest(Channel channel) {
+        JNI.reactorSetInterest(channel.mFileDescriptor, channel.mToken, !channel.mInputPaused && !channel.mHungUp, channel.mOutputBlocked);
+    }
+
+}
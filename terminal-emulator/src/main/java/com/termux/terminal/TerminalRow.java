@@ -1,16 +1,23 @@
 package com.termux.terminal;
 
+import java.nio.ByteBuffer;
 import java.util.Arrays;
 
 /**
  * A row in a terminal, composed of a fixed number of cells.
  * <p>
  * The text in the row is stored in a char[] array, {@link #mText}, for quick access during rendering.
+ * <p>
+ * Rows scrolled into the transcript are {@link #freeze() frozen} into a compact form, holding only their text up to
+ * the trailing spaces and their styles as runs. They are thawed back when edited, and must be thawed before reading
+ * {@link #mText} or the column positions in it.
  */
 public final class TerminalRow {
 
     private static final float SPARE_CAPACITY_FACTOR = 1.5f;
 
+    private static final char[] NO_TEXT = new char[0];
+
     /**
      * Max combining characters that can exist in a column, that are separate from the base character
      * itself. Any additional combining characters will be ignored and not added to the column.
@@ -39,27 +46,89 @@ public final class TerminalRow {
 
     /** The number of columns in this terminal row. */
     private final int mColumns;
-    /** The text filling this terminal row. */
-    public char[] mText;
+    /** The text filling this terminal row, without the trailing spaces while frozen. See {@link #getText()}. */
+    char[] mText;
     /** The number of java chars used in {@link #mText}. */
     private short mSpaceUsed;
     /** If this row has been line wrapped due to text output at the end of line. */
     boolean mLineWrap;
-    /** The style bits of each cell in the row. See {@link TextStyle}. */
-    final long[] mStyle;
+    /** The style of each cell in the row, as an id in {@link #mStyleTable}, or null while frozen. See {@link TextStyle}. */
+    char[] mStyleIds;
+    /**
+     * The styles of a frozen row as runs, pairs of the column ending a run (exclusive) and the style id of its cells, or
+     * null if the row is not frozen.
+     */
+    private char[] mStyleRuns;
+    /** Where the styles of {@link #mStyleIds} are looked up, shared by the rows of a {@link TerminalBuffer}. */
+    StyleTable mStyleTable;
+    /** Where the full arrays are recycled when freezing and taken from when thawing, or null to always allocate them. */
+    private TerminalRowPool mPool;
     /** If this row might contain chars with width != 1, used for deactivating fast path */
     boolean mHasNonOneWidthOrSurrogateChars;
+    /**
+     * The index in {@link #mText} of the character covering each column, for rows with
+     * {@link #mHasNonOneWidthOrSurrogateChars}, where it cannot be computed from the column. Built on first use and
+     * patched by {@link #setChar(int, int, long)}, so that looking up a column does not scan the row.
+     */
+    private int[] mColumnIndex;
+    /** If {@link #mColumnIndex} is up to date. */
+    private boolean mColumnIndexValid;
+    /**
+     * The offset of the record of this row in the file of a {@link TerminalCheckpoint}, or -1 if it changed since it was
+     * last written there, or never was. Reset by all the methods changing the row.
+     */
+    long mCheckpointOffset = -1;
 
     /** Construct a blank row (containing only whitespace, ' ') with a specified style. */
     public TerminalRow(int columns, long style) {
+        this(columns, null, null, style);
+    }
+
+    /**
+     * Construct a blank row interning its styles in a table, or in one of its own if null, and recycling its arrays
+     * through a pool if not null.
+     */
+    TerminalRow(int columns, StyleTable styleTable, TerminalRowPool pool, long style) {
         mColumns = columns;
-        mText = new char[(int) (SPARE_CAPACITY_FACTOR * columns)];
-        mStyle = new long[columns];
+        mPool = pool;
+        allocateArrays();
+        mStyleTable = styleTable != null ? styleTable : new StyleTable() {
+            @Override
+            TerminalRow[] rows() {
+                return new TerminalRow[]{TerminalRow.this};
+            }
+        };
         clear(style);
     }
 
+    /**
+     * Construct a row to {@link #thawInto(TerminalRow)} a frozen row. Unlike the other constructors, nothing is interned
+     * in the style table of the frozen row, so rows sharing it can be read on several threads at once.
+     */
+    TerminalRow(TerminalRow frozenRow) {
+        mColumns = frozenRow.mColumns;
+        mStyleTable = frozenRow.mStyleTable;
+        allocateArrays();
+    }
+
+    /** Construct a frozen row with no text, for {@link #readFrom(ByteBuffer, StyleTable, TerminalRowPool)} to fill in. */
+    private TerminalRow(int columns, StyleTable styleTable, TerminalRowPool pool) {
+        mColumns = columns;
+        mStyleTable = styleTable;
+        mPool = pool;
+        mText = NO_TEXT;
+    }
+
     /** NOTE: The sourceX2 is exclusive. */
     public void copyInterval(TerminalRow line, int sourceX1, int sourceX2, int destinationX) {
+        if (line.isFrozen()) {
+            // Read a frozen source through a thawed copy, leaving it frozen.
+            TerminalRow thawedLine = new TerminalRow(line);
+            line.thawInto(thawedLine);
+            line = thawedLine;
+        }
+        thaw();
+        mCheckpointOffset = -1;
         mHasNonOneWidthOrSurrogateChars |= line.mHasNonOneWidthOrSurrogateChars;
         final int x1 = line.findStartOfColumn(sourceX1);
         final int x2 = line.findStartOfColumn(sourceX2);
@@ -84,76 +153,119 @@ public final class TerminalRow {
         }
     }
 
+    /**
+     * The text of this row, of which {@link #getSpaceUsed()} chars are used. The text of a row frozen into the transcript
+     * is trimmed, so such rows must be read through {@link TerminalBuffer#getLineForReading(int)}.
+     *
+     * @throws IllegalStateException if this row is frozen.
+     */
+    public char[] getText() {
+        if (mStyleRuns != null) throw new IllegalStateException("Frozen row, read it through TerminalBuffer.getLineForReading()");
+        return mText;
+    }
+
     public int getSpaceUsed() {
         return mSpaceUsed;
     }
 
+    int getColumns() {
+        return mColumns;
+    }
+
     /** Note that the column may end of second half of wide character. */
     public int findStartOfColumn(int column) {
         if (column == mColumns) return getSpaceUsed();
+        // Every column is one java char.
+        if (!mHasNonOneWidthOrSurrogateChars) return column;
+        // Frozen rows are read in place rather than given a column index to keep.
+        if (mStyleRuns != null) return scanForColumn(column);
+        return columnIndex()[column];
+    }
 
-        int currentColumn = 0;
-        int currentCharIndex = 0;
-        while (true) { // 0<2 1 < 2
-            int newCharIndex = currentCharIndex;
-            char c = mText[newCharIndex++]; // cci=1, cci=2
-            boolean isHigh = Character.isHighSurrogate(c);
-            int codePoint = isHigh ? Character.toCodePoint(c, mText[newCharIndex++]) : c;
-            int wcwidth = WcWidth.width(codePoint); // 1, 2
-            if (wcwidth > 0) {
-                currentColumn += wcwidth;
-                if (currentColumn == column) {
-                    while (newCharIndex < mSpaceUsed) {
-                        // Skip combining chars.
-                        if (Character.isHighSurrogate(mText[newCharIndex])) {
-                            if (WcWidth.width(Character.toCodePoint(mText[newCharIndex], mText[newCharIndex + 1])) <= 0) {
-                                newCharIndex += 2;
-                            } else {
-                                break;
-                            }
-                        } else if (WcWidth.width(mText[newCharIndex]) <= 0) {
-                            newCharIndex++;
-                        } else {
-                            break;
-                        }
-                    }
-                    return newCharIndex;
-                } else if (currentColumn > column) {
-                    // Wide column going past end.
-                    return currentCharIndex;
-                }
-            }
-            currentCharIndex = newCharIndex;
+    /** The index of the character covering a column of a frozen row, found by scanning its text from the start. */
+    private int scanForColumn(int column) {
+        int charIndex = 0, currentColumn = 0;
+        while (charIndex < mText.length) {
+            int width = WcWidth.width(mText, charIndex);
+            if (currentColumn + width > column) return charIndex;
+            currentColumn += width;
+            charIndex += Character.isHighSurrogate(mText[charIndex]) ? 2 : 1;
         }
+        // Each column after the text is one of the trailing spaces trimmed off.
+        return charIndex + column - currentColumn;
     }
 
     private boolean wideDisplayCharacterStartingAt(int column) {
-        for (int currentCharIndex = 0, currentColumn = 0; currentCharIndex < mSpaceUsed; ) {
-            char c = mText[currentCharIndex++];
-            int codePoint = Character.isHighSurrogate(c) ? Character.toCodePoint(c, mText[currentCharIndex++]) : c;
-            int wcwidth = WcWidth.width(codePoint);
-            if (wcwidth > 0) {
-                if (currentColumn == column && wcwidth == 2) return true;
-                currentColumn += wcwidth;
-                if (currentColumn > column) return false;
+        if (!mHasNonOneWidthOrSurrogateChars || column >= mColumns) return false;
+        int[] index = columnIndex();
+        int charIndex = index[column];
+        return (column == 0 || index[column - 1] != charIndex) && charIndex < mSpaceUsed && WcWidth.width(mText, charIndex) == 2;
+    }
+
+    /** The column index, rebuilt if it is not up to date. */
+    private int[] columnIndex() {
+        if (!mColumnIndexValid) {
+            if (mColumnIndex == null) mColumnIndex = new int[mColumns];
+            indexColumns(0, 0, mColumns);
+            mColumnIndexValid = true;
+        }
+        return mColumnIndex;
+    }
+
+    /**
+     * Fill {@link #mColumnIndex} by scanning from a column, whose character starts at charIndex, to endColumn
+     * (exclusive). Combining characters belong to the column before them.
+     */
+    private void indexColumns(int column, int charIndex, int endColumn) {
+        final int[] index = mColumnIndex;
+        while (column < endColumn) {
+            if (charIndex >= mSpaceUsed) {
+                index[column++] = mSpaceUsed;
+                continue;
             }
+            int charCount = Character.isHighSurrogate(mText[charIndex]) ? 2 : 1;
+            int width = WcWidth.width(mText, charIndex);
+            for (int i = 0; i < width && column < endColumn; i++)
+                index[column++] = charIndex;
+            charIndex += charCount;
+        }
+    }
+
+    /**
+     * Patch the column index after the character at a column, starting at charIndex, has been set, which changed the
+     * columns up to the one after it and moved the characters of the rest by charDifference.
+     */
+    private void updateColumnIndex(int column, int charIndex, int charDifference) {
+        if (!mColumnIndexValid) return;
+        int endColumn = Math.min(column + 2, mColumns);
+        indexColumns(column, charIndex, endColumn);
+        if (charDifference != 0) {
+            for (int i = endColumn; i < mColumns; i++)
+                mColumnIndex[i] += charDifference;
         }
-        return false;
     }
 
     public void clear(long style) {
+        if (mStyleRuns != null) {
+            allocateArrays();
+            mStyleRuns = null;
+        }
         Arrays.fill(mText, ' ');
-        Arrays.fill(mStyle, style);
+        Arrays.fill(mStyleIds, (char) mStyleTable.intern(style));
         mSpaceUsed = (short) mColumns;
         mHasNonOneWidthOrSurrogateChars = false;
+        mColumnIndexValid = false;
+        mCheckpointOffset = -1;
     }
 
     // https://github.com/steven676/Android-Terminal-Emulator/commit/9a47042620bec87617f0b4f5d50568535668fe26
     public void setChar(int columnToSet, int codePoint, long style) {
-        if (columnToSet  < 0 || columnToSet >= mStyle.length)
+        if (columnToSet  < 0 || columnToSet >= mColumns)
             throw new IllegalArgumentException("TerminalRow.setChar(): columnToSet=" + columnToSet + ", codePoint=" + codePoint + ", style=" + style);
 
-        mStyle[columnToSet] = style;
+        thaw();
+        mCheckpointOffset = -1;
+        mStyleIds[columnToSet] = (char) mStyleTable.intern(style);
 
         final int newCodePointDisplayWidth = WcWidth.width(codePoint);
 
@@ -183,6 +295,7 @@ public final class TerminalRow {
         }
 
         char[] text = mText;
+        final int oldSpaceUsed = mSpaceUsed;
         final int oldStartOfColumnIndex = findStartOfColumn(columnToSet);
         final int oldCodePointDisplayWidth = WcWidth.width(text, oldStartOfColumnIndex);
 
@@ -253,6 +366,7 @@ public final class TerminalRow {
             ++mSpaceUsed;
         } else if (oldCodePointDisplayWidth == 1 && newCodePointDisplayWidth == 2) {
             if (columnToSet == mColumns - 1) {
+                mColumnIndexValid = false;
                 throw new IllegalArgumentException("Cannot put wide character in last column");
             } else if (columnToSet == mColumns - 2) {
                 // Truncate the line to the second part of this wide char:
@@ -268,16 +382,223 @@ public final class TerminalRow {
                 mSpaceUsed -= nextLen;
             }
         }
+
+        updateColumnIndex(columnToSet, oldStartOfColumnIndex, mSpaceUsed - oldSpaceUsed);
+    }
+
+    /**
+     * Write a run of printable ASCII characters (0x20 to 0x7E), which all have width one, with the same style from a
+     * column on. For rows with only such characters this is a plain copy, other rows take each through
+     * {@link #setChar(int, int, long)}.
+     */
+    public void setAsciiChars(int column, byte[] chars, int start, int length, long style) {
+        thaw();
+        mCheckpointOffset = -1;
+        if (mHasNonOneWidthOrSurrogateChars) {
+            for (int i = 0; i < length; i++)
+                setChar(column + i, chars[start + i], style);
+            return;
+        }
+        final char[] text = mText;
+        for (int i = 0; i < length; i++)
+            text[column + i] = (char) chars[start + i];
+        Arrays.fill(mStyleIds, column, column + length, (char) mStyleTable.intern(style));
     }
 
     boolean isBlank() {
+        // A frozen row has no trailing spaces left.
+        if (mStyleRuns != null) return mText.length == 0;
         for (int charIndex = 0, charLen = getSpaceUsed(); charIndex < charLen; charIndex++)
             if (mText[charIndex] != ' ') return false;
         return true;
     }
 
     public final long getStyle(int column) {
-        return mStyle[column];
+        if (mStyleRuns == null) return mStyleTable.get(mStyleIds[column]);
+        // Binary search for the first run ending after the column.
+        final char[] runs = mStyleRuns;
+        int low = 0, high = runs.length / 2 - 1;
+        while (low < high) {
+            int mid = (low + high) >>> 1;
+            if (runs[mid * 2] <= column) low = mid + 1;
+            else high = mid;
+        }
+        return mStyleTable.get(runs[low * 2 + 1]);
+    }
+
+    public void setStyle(int column, long style) {
+        thaw();
+        mCheckpointOffset = -1;
+        mStyleIds[column] = (char) mStyleTable.intern(style);
+    }
+
+    /** Mark the style ids used by this row. */
+    void markStyleIds(boolean[] used) {
+        if (mStyleRuns == null) {
+            for (char id : mStyleIds)
+                used[id] = true;
+        } else {
+            for (int i = 1; i < mStyleRuns.length; i += 2)
+                used[mStyleRuns[i]] = true;
+        }
+    }
+
+    /** Move this row to another style table, giving the new id of each of its old style ids, and to another pool. */
+    void moveTo(StyleTable styleTable, TerminalRowPool pool, char[] newIds) {
+        if (mStyleRuns == null) {
+            for (int column = 0; column < mColumns; column++)
+                mStyleIds[column] = newIds[mStyleIds[column]];
+        } else {
+            for (int i = 1; i < mStyleRuns.length; i += 2)
+                mStyleRuns[i] = newIds[mStyleRuns[i]];
+        }
+        mStyleTable = styleTable;
+        mPool = pool;
+    }
+
+    boolean isFrozen() {
+        return mStyleRuns != null;
+    }
+
+    /**
+     * Compact this row, done when it scrolls into the transcript: the text is trimmed of its trailing spaces and spare
+     * capacity, and the styles are stored as runs of equal ones. Rows of a log typically shrink several-fold.
+     */
+    void freeze() {
+        if (mStyleRuns != null) return;
+        final int length = getTrimmedLength();
+
+        final char[] styleIds = mStyleIds;
+        final char[] runs = new char[getStyleRunCount() * 2];
+        int run = 0;
+        for (int column = 1; column <= mColumns; column++) {
+            if (column == mColumns || styleIds[column] != styleIds[column - 1]) {
+                runs[run++] = (char) column;
+                runs[run++] = styleIds[column - 1];
+            }
+        }
+
+        final char[] text = (length == 0) ? NO_TEXT : Arrays.copyOf(mText, length);
+        if (mPool != null) mPool.recycle(mText, styleIds);
+        mText = text;
+        mStyleIds = null;
+        mStyleRuns = runs;
+        mColumnIndex = null;
+        mColumnIndexValid = false;
+    }
+
+    /** The length of the text of this row without its trailing spaces. */
+    private int getTrimmedLength() {
+        if (mStyleRuns != null) return mText.length;
+        int length = mSpaceUsed;
+        while (length > 0 && mText[length - 1] == ' ')
+            length--;
+        return length;
+    }
+
+    /** The number of runs of equal styles in this row. */
+    private int getStyleRunCount() {
+        if (mStyleRuns != null) return mStyleRuns.length / 2;
+        int runCount = 1;
+        for (int column = 1; column < mColumns; column++)
+            if (mStyleIds[column] != mStyleIds[column - 1]) runCount++;
+        return runCount;
+    }
+
+    /** Restore a frozen row to its full form. Does nothing if it is not frozen. */
+    void thaw() {
+        if (mStyleRuns == null) return;
+        final char[] frozenText = mText;
+        allocateArrays();
+        if (mText.length < mSpaceUsed) mText = new char[mSpaceUsed];
+        thawArrays(frozenText, mText, mStyleIds);
+        mStyleRuns = null;
+    }
+
+    /**
+     * Copy this frozen row, thawed, into a row of the same width and style table, to read it without keeping it thawed.
+     */
+    void thawInto(TerminalRow row) {
+        row.thaw();
+        if (row.mText.length < mSpaceUsed) row.mText = new char[mSpaceUsed];
+        thawArrays(mText, row.mText, row.mStyleIds);
+        row.mSpaceUsed = mSpaceUsed;
+        row.mLineWrap = mLineWrap;
+        row.mHasNonOneWidthOrSurrogateChars = mHasNonOneWidthOrSurrogateChars;
+        row.mColumnIndexValid = false;
+    }
+
+    /** The number of bytes {@link #writeTo(ByteBuffer)} writes for this row. */
+    int getEncodedLength() {
+        return 9 + 2 * getTrimmedLength() + 10 * getStyleRunCount();
+    }
+
+    /**
+     * Write this row to a buffer as if frozen, with the styles themselves rather than their ids, as these are only valid
+     * in its style table. Read back by {@link #readFrom(ByteBuffer, StyleTable, TerminalRowPool)}.
+     */
+    void writeTo(ByteBuffer buffer) {
+        buffer.putChar((char) mColumns);
+        buffer.putShort(mSpaceUsed);
+        buffer.put((byte) ((mLineWrap ? 1 : 0) | (mHasNonOneWidthOrSurrogateChars ? 2 : 0)));
+        final int length = getTrimmedLength();
+        buffer.putChar((char) length);
+        for (int i = 0; i < length; i++)
+            buffer.putChar(mText[i]);
+        buffer.putChar((char) getStyleRunCount());
+        if (mStyleRuns != null) {
+            for (int i = 0; i < mStyleRuns.length; i += 2) {
+                buffer.putChar(mStyleRuns[i]);
+                buffer.putLong(mStyleTable.get(mStyleRuns[i + 1]));
+            }
+        } else {
+            for (int column = 1; column <= mColumns; column++) {
+                if (column == mColumns || mStyleIds[column] != mStyleIds[column - 1]) {
+                    buffer.putChar((char) column);
+                    buffer.putLong(mStyleTable.get(mStyleIds[column - 1]));
+                }
+            }
+        }
+    }
+
+    /** Read a row written by {@link #writeTo(ByteBuffer)}, frozen, interning its styles in a table. */
+    static TerminalRow readFrom(ByteBuffer buffer, StyleTable styleTable, TerminalRowPool pool) {
+        TerminalRow row = new TerminalRow(buffer.getChar(), styleTable, pool);
+        row.mSpaceUsed = buffer.getShort();
+        final int flags = buffer.get();
+        row.mLineWrap = (flags & 1) != 0;
+        row.mHasNonOneWidthOrSurrogateChars = (flags & 2) != 0;
+        final int textLength = buffer.getChar();
+        if (textLength > 0) {
+            row.mText = new char[textLength];
+            buffer.asCharBuffer().get(row.mText);
+            buffer.position(buffer.position() + 2 * textLength);
+        }
+        final char[] runs = new char[2 * buffer.getChar()];
+        for (int i = 0; i < runs.length; i += 2) {
+            runs[i] = buffer.getChar();
+            runs[i + 1] = (char) styleTable.intern(buffer.getLong());
+        }
+        row.mStyleRuns = runs;
+        return row;
+    }
+
+    /** Set {@link #mText} and {@link #mStyleIds} to full arrays, taken from the pool if it has some. */
+    private void allocateArrays() {
+        if (mPool == null || !mPool.take(this, mColumns)) {
+            mText = new char[(int) (SPARE_CAPACITY_FACTOR * mColumns)];
+            mStyleIds = new char[mColumns];
+        }
+    }
+
+    private void thawArrays(char[] frozenText, char[] text, char[] styleIds) {
+        System.arraycopy(frozenText, 0, text, 0, frozenText.length);
+        Arrays.fill(text, frozenText.length, mSpaceUsed, ' ');
+        int start = 0;
+        for (int i = 0; i < mStyleRuns.length; i += 2) {
+            Arrays.fill(styleIds, start, mStyleRuns[i], mStyleRuns[i + 1]);
+            start = mStyleRuns[i];
+        }
     }
 
 }
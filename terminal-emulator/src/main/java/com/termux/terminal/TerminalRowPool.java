@@ -0,0 +1,58 @@
+package com.termux.terminal;
+
+/**
+ * Recycles the text and style arrays of the rows in a {@link TerminalBuffer}. Once the transcript is full, every line
+ * scrolled freezes the row leaving the screen, which releases its arrays, and clears the oldest transcript row for reuse
+ * as the new bottom line, which needs them again. The pool hands the arrays from one to the other instead of allocating
+ * a fresh set for every line.
+ */
+final class TerminalRowPool {
+
+    /** The most array sets kept, enough for the rows released by scrolling a screen at once. */
+    private static final int MAX_POOLED = 16;
+
+    private final char[][] mTexts = new char[MAX_POOLED][];
+    private final char[][] mStyleIds = new char[MAX_POOLED][];
+    private int mSize;
+
+    /** The number of rows given pooled arrays. */
+    private long mHits;
+    /** The number of rows given newly allocated arrays. */
+    private long mAllocations;
+
+    /** Give a row of a number of columns the pooled arrays last recycled, returning false if there are none. */
+    boolean take(TerminalRow row, int columns) {
+        // Arrays of another width are left over from before a resize.
+        while (mSize > 0 && mStyleIds[mSize - 1].length != columns) {
+            mSize--;
+            mTexts[mSize] = mStyleIds[mSize] = null;
+        }
+        if (mSize == 0) {
+            mAllocations++;
+            return false;
+        }
+        mSize--;
+        row.mText = mTexts[mSize];
+        row.mStyleIds = mStyleIds[mSize];
+        mTexts[mSize] = mStyleIds[mSize] = null;
+        mHits++;
+        return true;
+    }
+
+    /** Keep the arrays of a row being frozen for reuse, if there is room. */
+    void recycle(char[] text, char[] styleIds) {
+        if (mSize == MAX_POOLED) return;
+        mTexts[mSize] = text;
+        mStyleIds[mSize] = styleIds;
+        mSize++;
+    }
+
+    long getHits() {
+        return mHits;
+    }
+
+    long getAllocations() {
+        return mAllocations;
+    }
+
+}
@@ -8,20 +8,18 @@ import android.system.Os;
 import android.system.OsConstants;
 
 import java.io.File;
-import java.io.FileDescriptor;
-import java.io.FileInputStream;
-import java.io.FileOutputStream;
 import java.io.IOException;
-import java.io.InputStream;
-import java.lang.reflect.Field;
 import java.nio.charset.StandardCharsets;
+import java.util.ArrayList;
+import java.util.List;
 import java.util.UUID;
 
 /**
  * A terminal session, consisting of a process coupled to a terminal interface.
  * <p>
  * The subprocess will be executed by the constructor, and when the size is made known by a call to
- * {@link #updateSize(int, int, int, int)} terminal emulation will begin and threads will be spawned to handle the subprocess I/O.
+ * {@link #updateSize(int, int, int, int)} terminal emulation will begin and the subprocess I/O will be handled by the
+ * {@link TerminalReactor}.
  * All terminal emulation and callback methods will be performed on the main thread.
  * <p>
  * The child process may be exited forcefully by using the {@link #finishIfRunning()} method.
@@ -30,23 +28,37 @@ import java.util.UUID;
  */
 public final class TerminalSession extends TerminalOutput {
 
-    private static final int MSG_NEW_INPUT = 1;
-    private static final int MSG_PROCESS_EXITED = 4;
+    static final int MSG_NEW_INPUT = 1;
+    static final int MSG_PROCESS_EXITED = 4;
+    static final int MSG_REFLOW_TRANSCRIPT = 5;
+
+    /** The rows of transcript reflowed per message after a resize, so that the main thread stays responsive. */
+    private static final int REFLOW_ROWS_PER_MESSAGE = 1000;
 
     public final String mHandle = UUID.randomUUID().toString();
 
     TerminalEmulator mEmulator;
 
     /**
-     * A queue written to from a separate thread when the process outputs, and read by main thread to process by
-     * terminal emulator.
+     * A ring which the {@link TerminalReactor} thread reads output of the process into, and which is processed in
+     * place by the terminal emulator on the main thread.
+     */
+    final DirectByteRing mProcessToTerminalRing = new DirectByteRing(16 * 1024);
+    /**
+     * A queue written to from the main thread due to user interaction, and read by the {@link TerminalReactor} thread
+     * which forwards by writing to the {@link #mTerminalFileDescriptor}.
      */
-    final ByteQueue mProcessToTerminalIOQueue = new ByteQueue(4096);
+    final ByteRing mTerminalToProcessIOQueue = new ByteRing(4096, 64 * 1024);
     /**
-     * A queue written to from the main thread due to user interaction, and read by another thread which forwards by
-     * writing to the {@link #mTerminalFileDescriptor}.
+     * Has the {@link TerminalReactor} drain {@link #mTerminalToProcessIOQueue}, which it only does when asked to, so
+     * this is also run before waiting on the queue when full. Replaced in tests.
      */
-    final ByteQueue mTerminalToProcessIOQueue = new ByteQueue(4096);
+    Runnable mRequestFlush = new Runnable() {
+        @Override
+        public void run() {
+            TerminalReactor.getInstance().requestWrite(mReactorChannel);
+        }
+    };
     /** Buffer to write translate code points into utf8 before writing to mTerminalToProcessIOQueue */
     private final byte[] mUtf8InputBuffer = new byte[5];
 
@@ -59,12 +71,18 @@ public final class TerminalSession extends TerminalOutput {
     /** The exit status of the shell process. Only valid if ${@link #mShellPid} is -1. */
     int mShellExitStatus;
 
+    /** The resources used by the shell process, if known. Only valid if ${@link #mShellPid} is -1. */
+    ProcessResourceUsage mShellResourceUsage;
+
     /**
      * The file descriptor referencing the master half of a pseudo-terminal pair, resulting from calling
      * {@link JNI#createSubprocess(String, String, String[], String[], int[], int, int, int, int)}.
      */
     private int mTerminalFileDescriptor;
 
+    /** The I/O state of this session on the {@link TerminalReactor}, set when the subprocess has been started. */
+    private TerminalReactor.Channel mReactorChannel;
+
     /** Set by the application for user identification of session, not by terminal. */
     public String mSessionName;
 
@@ -75,6 +93,14 @@ public final class TerminalSession extends TerminalOutput {
     private final String[] mArgs;
     private final String[] mEnv;
     private final Integer mTranscriptRows;
+    /** The template the subprocess is started from, or null. */
+    private final SpawnTemplate mSpawnTemplate;
+    /** Where rows scrolled out of the transcript are kept, up to mScrollbackMaxRows of them, or null to drop them. */
+    private File mScrollbackDirectory;
+    private int mScrollbackMaxRows;
+    private boolean mCompressScrollback;
+    /** Where the emulator is written by {@link #checkpoint()} and restored from when initialized, or null. */
+    private TerminalCheckpoint mCheckpoint;
 
 
     private static final String LOG_TAG = "TerminalSession";
@@ -86,6 +112,22 @@ public final class TerminalSession extends TerminalOutput {
         this.mEnv = env;
         this.mTranscriptRows = transcriptRows;
         this.mClient = client;
+        this.mSpawnTemplate = null;
+    }
+
+    /**
+     * Create a session whose subprocess is started from a {@link SpawnTemplate}.
+     *
+     * @param args The arguments to use instead of those of the template, or null to keep them.
+     */
+    public TerminalSession(SpawnTemplate template, String[] args, Integer transcriptRows, TerminalSessionClient client) {
+        this.mShellPath = template.mShellPath;
+        this.mCwd = template.mCwd;
+        this.mArgs = (args == null) ? template.mArgs : args;
+        this.mEnv = template.mEnv;
+        this.mTranscriptRows = transcriptRows;
+        this.mClient = client;
+        this.mSpawnTemplate = template;
     }
 
     /**
@@ -99,6 +141,49 @@ public final class TerminalSession extends TerminalOutput {
             mEmulator.updateTerminalSessionClient(client);
     }
 
+    /**
+     * Keep up to a number of rows scrolled out of the transcript in memory-mapped files in a directory, such as the cache
+     * directory of the app, instead of dropping them, or stop if null. Compressing them suits sessions running for days.
+     * See {@link TerminalEmulator#setScrollbackDirectory(File, int, boolean)}.
+     */
+    public void setScrollbackDirectory(File directory, int maxRows, boolean compress) {
+        mScrollbackDirectory = directory;
+        mScrollbackMaxRows = maxRows;
+        mCompressScrollback = compress;
+        if (mEmulator != null) mEmulator.setScrollbackDirectory(directory, maxRows, compress);
+    }
+
+    /**
+     * Write the emulator to a file on each {@link #checkpoint()}, such as when the app goes to the background, and
+     * restore it from there when the emulator is initialized if it was written before, so that the screen and
+     * transcript of a session killed with the app come back, the new shell starting below them. Stop if null.
+     * See {@link TerminalCheckpoint}.
+     */
+    public void setCheckpointFile(File file) {
+        closeCheckpoint();
+        if (file != null) mCheckpoint = new TerminalCheckpoint(file);
+    }
+
+    /** Write what changed in the emulator since the last checkpoint to the checkpoint file, if any. */
+    public void checkpoint() {
+        if (mCheckpoint == null || mEmulator == null) return;
+        try {
+            mCheckpoint.write(mEmulator);
+        } catch (IOException e) {
+            Logger.logStackTraceWithMessage(mClient, LOG_TAG, "Error writing checkpoint to " + mCheckpoint.getFile(), e);
+        }
+    }
+
+    private void closeCheckpoint() {
+        if (mCheckpoint == null) return;
+        try {
+            mCheckpoint.close();
+        } catch (IOException e) {
+            Logger.logStackTraceWithMessage(mClient, LOG_TAG, "Error closing checkpoint " + mCheckpoint.getFile(), e);
+        }
+        mCheckpoint = null;
+    }
+
     /** Inform the attached pty of the new size and reflow or initialize the emulator. */
     public void updateSize(int columns, int rows, int cellWidthPixels, int cellHeightPixels) {
         if (mEmulator == null) {
@@ -106,9 +191,16 @@ public final class TerminalSession extends TerminalOutput {
         } else {
             JNI.setPtyWindowSize(mTerminalFileDescriptor, rows, columns, cellWidthPixels, cellHeightPixels);
             mEmulator.resize(columns, rows, cellWidthPixels, cellHeightPixels);
+            scheduleTranscriptReflow();
         }
     }
 
+    /** Reflow the rest of the transcript left by a resize in steps on the main thread, if any. */
+    private void scheduleTranscriptReflow() {
+        if (mEmulator.getMainBuffer().hasRowsToReflow() && !mMainThreadHandler.hasMessages(MSG_REFLOW_TRANSCRIPT))
+            mMainThreadHandler.sendEmptyMessage(MSG_REFLOW_TRANSCRIPT);
+    }
+
     /** The terminal title as set through escape sequences or null if none set. */
     public String getTitle() {
         return (mEmulator == null) ? null : mEmulator.getTitle();
@@ -121,62 +213,121 @@ public final class TerminalSession extends TerminalOutput {
      * @param rows    The number of rows in the terminal window.
      */
     public void initializeEmulator(int columns, int rows, int cellWidthPixels, int cellHeightPixels) {
-        mEmulator = new TerminalEmulator(this, columns, rows, cellWidthPixels, cellHeightPixels, mTranscriptRows, mClient);
+        mEmulator = newEmulator(columns, rows, cellWidthPixels, cellHeightPixels);
+        scheduleTranscriptReflow();
 
         int[] processId = new int[1];
-        mTerminalFileDescriptor = JNI.createSubprocess(mShellPath, mCwd, mArgs, mEnv, processId, rows, columns, cellWidthPixels, cellHeightPixels);
-        mShellPid = processId[0];
-        mClient.setTerminalShellPid(this, mShellPid);
+        int terminalFileDescriptor;
+        if (mSpawnTemplate != null) {
+            String[] argsOverride = (mArgs == mSpawnTemplate.mArgs) ? null : mArgs;
+            terminalFileDescriptor = JNI.createSubprocessFromTemplate(mSpawnTemplate.getId(), argsOverride, processId, rows, columns, cellWidthPixels, cellHeightPixels);
+        } else {
+            terminalFileDescriptor = JNI.createSubprocess(mShellPath, mCwd, mArgs, mEnv, processId, rows, columns, cellWidthPixels, cellHeightPixels);
+        }
+        startProcessIO(terminalFileDescriptor, processId[0]);
+    }
 
-        final FileDescriptor terminalFileDescriptorWrapped = wrapFileDescriptor(mTerminalFileDescriptor, mClient);
+    /**
+     * Start the helper process that subprocesses of sessions are spawned from, instead of from the app process. It is
+     * forked from the app and keeps a copy of its memory as it is now, so call this first thing in
+     * {@link android.app.Application#onCreate()}. Without it subprocesses are spawned from the app process.
+     */
+    public static void startSpawnHelper() {
+        JNI.startSpawnHelper();
+    }
 
-        new Thread("TermSessionInputReader[pid=" + mShellPid + "]") {
-            @Override
-            public void run() {
-                try (InputStream termIn = new FileInputStream(terminalFileDescriptorWrapped)) {
-                    final byte[] buffer = new byte[4096];
-                    while (true) {
-                        int read = termIn.read(buffer);
-                        if (read == -1) return;
-                        if (!mProcessToTerminalIOQueue.write(buffer, 0, read)) return;
-                        mMainThreadHandler.sendEmptyMessage(MSG_NEW_INPUT);
-                    }
-                } catch (Exception e) {
-                    // Ignore, just shutting down.
-                }
-            }
-        }.start();
+    /**
+     * Initialize the emulators of several sessions of the same size at once, like calling
+     * {@link #initializeEmulator(int, int, int, int)} on each of them but starting all the subprocesses with a single
+     * native call. Sessions which are already initialized are skipped. Sessions whose subprocess could not be started
+     * are left uninitialized, so that a later {@link #updateSize(int, int, int, int)} retries them one by one.
+     */
+    public static void initializeEmulators(List<TerminalSession> sessions, int columns, int rows, int cellWidthPixels, int cellHeightPixels) {
+        List<TerminalSession> pending = new ArrayList<>();
+        for (TerminalSession session : sessions)
+            if (session.mEmulator == null) pending.add(session);
+        if (pending.isEmpty()) return;
+
+        int count = pending.size();
+        String[] cmds = new String[count];
+        String[] cwds = new String[count];
+        String[][] args = new String[count][];
+        String[][] envVars = new String[count][];
+        for (int i = 0; i < count; i++) {
+            TerminalSession session = pending.get(i);
+            cmds[i] = session.mShellPath;
+            cwds[i] = session.mCwd;
+            args[i] = session.mArgs;
+            envVars[i] = session.mEnv;
+        }
 
-        new Thread("TermSessionOutputWriter[pid=" + mShellPid + "]") {
-            @Override
-            public void run() {
-                final byte[] buffer = new byte[4096];
-                try (FileOutputStream termOut = new FileOutputStream(terminalFileDescriptorWrapped)) {
-                    while (true) {
-                        int bytesToWrite = mTerminalToProcessIOQueue.read(buffer, true);
-                        if (bytesToWrite == -1) return;
-                        termOut.write(buffer, 0, bytesToWrite);
-                    }
-                } catch (IOException e) {
-                    // Ignore.
-                }
-            }
-        }.start();
+        int[] processIds = new int[count];
+        int[] terminalFileDescriptors = JNI.createSubprocesses(cmds, cwds, args, envVars, processIds, rows, columns, cellWidthPixels, cellHeightPixels);
+        for (int i = 0; i < count; i++) {
+            if (terminalFileDescriptors[i] < 0) continue;
+            TerminalSession session = pending.get(i);
+            session.mEmulator = session.newEmulator(columns, rows, cellWidthPixels, cellHeightPixels);
+            session.scheduleTranscriptReflow();
+            session.startProcessIO(terminalFileDescriptors[i], processIds[i]);
+        }
+    }
+
+    private TerminalEmulator newEmulator(int columns, int rows, int cellWidthPixels, int cellHeightPixels) {
+        TerminalEmulator emulator = restoreCheckpoint(columns, rows, cellWidthPixels, cellHeightPixels);
+        if (emulator == null) emulator = new TerminalEmulator(this, columns, rows, cellWidthPixels, cellHeightPixels, mTranscriptRows, mClient);
+        if (mScrollbackDirectory != null) emulator.setScrollbackDirectory(mScrollbackDirectory, mScrollbackMaxRows, mCompressScrollback);
+        return emulator;
+    }
 
+    /** The emulator restored from the checkpoint file, resized, or null if there is none or it cannot be read. */
+    private TerminalEmulator restoreCheckpoint(int columns, int rows, int cellWidthPixels, int cellHeightPixels) {
+        if (mCheckpoint == null || !mCheckpoint.getFile().isFile()) return null;
+        final TerminalEmulator emulator;
+        try {
+            emulator = TerminalCheckpoint.restore(mCheckpoint.getFile(), this, cellWidthPixels, cellHeightPixels, mClient);
+        } catch (IOException e) {
+            Logger.logStackTraceWithMessage(mClient, LOG_TAG, "Error restoring checkpoint " + mCheckpoint.getFile(), e);
+            return null;
+        }
+        if (emulator.isAlternateBufferActive()) {
+            // The program which had the alternate buffer is gone, leave it for the new shell:
+            byte[] leaveAlternateBuffer = "\033[?1049l".getBytes(StandardCharsets.US_ASCII);
+            emulator.append(leaveAlternateBuffer, leaveAlternateBuffer.length);
+        }
+        emulator.resize(columns, rows, cellWidthPixels, cellHeightPixels);
+        return emulator;
+    }
+
+    /** Start handling I/O with the subprocess which has been created for this session on the {@link TerminalReactor}. */
+    private void startProcessIO(int terminalFileDescriptor, int shellPid) {
+        mTerminalFileDescriptor = terminalFileDescriptor;
+        mShellPid = shellPid;
+        mClient.setTerminalShellPid(this, mShellPid);
+
+        mReactorChannel = TerminalReactor.getInstance().register(this, mTerminalFileDescriptor, mShellPid);
+        if (mReactorChannel.mExitTracked) return;
+
+        // No exit file descriptor could be set up for the reactor to watch.
         new Thread("TermSessionWaiter[pid=" + mShellPid + "]") {
             @Override
             public void run() {
-                int processExitCode = JNI.waitFor(mShellPid);
-                mMainThreadHandler.sendMessage(mMainThreadHandler.obtainMessage(MSG_PROCESS_EXITED, processExitCode));
+                int[] processExitCode = new int[1];
+                long[] resourceUsage = new long[ProcessResourceUsage.LONGS];
+                JNI.waitForExit(mShellPid, -1, processExitCode, resourceUsage);
+                notifyProcessExited(processExitCode[0], new ProcessResourceUsage(resourceUsage, 0));
             }
         }.start();
+    }
 
+    /** Called from another thread when the shell process has exited. */
+    void notifyProcessExited(int exitCode, ProcessResourceUsage resourceUsage) {
+        mMainThreadHandler.sendMessage(mMainThreadHandler.obtainMessage(MSG_PROCESS_EXITED, exitCode, 0, resourceUsage));
     }
 
     /** Write data to the shell process. */
     @Override
     public void write(byte[] data, int offset, int count) {
-        if (mShellPid > 0) mTerminalToProcessIOQueue.write(data, offset, count);
+        if (mShellPid > 0 && mTerminalToProcessIOQueue.write(data, offset, count, mRequestFlush)) mRequestFlush.run();
     }
 
     /** Write the Unicode code point to the terminal encoded in UTF-8. */
@@ -243,16 +394,18 @@ public final class TerminalSession extends TerminalOutput {
     }
 
     /** Cleanup resources when the process exits. */
-    void cleanupResources(int exitStatus) {
+    void cleanupResources(int exitStatus, ProcessResourceUsage resourceUsage) {
         synchronized (this) {
             mShellPid = -1;
             mShellExitStatus = exitStatus;
+            mShellResourceUsage = resourceUsage;
         }
 
-        // Stop the reader and writer threads, and close the I/O streams
+        // Stop I/O with the process, the reactor closes the pty.
         mTerminalToProcessIOQueue.close();
-        mProcessToTerminalIOQueue.close();
-        JNI.close(mTerminalFileDescriptor);
+        TerminalReactor.getInstance().close(mReactorChannel);
+        // The session stays on screen with its scrollback, so keep the rows but free the compressor.
+        if (mEmulator != null) mEmulator.releaseScrollbackCompressor();
     }
 
     @Override
@@ -269,6 +422,29 @@ public final class TerminalSession extends TerminalOutput {
         return mShellExitStatus;
     }
 
+    /**
+     * The CPU time, memory, page faults and context switches of the shell process and the descendants it waited for,
+     * or null if unknown. Only valid if not {@link #isRunning()}.
+     */
+    public synchronized ProcessResourceUsage getResourceUsage() {
+        return mShellResourceUsage;
+    }
+
+    /**
+     * The number of reads of output from the process, each of which would have woken the main thread without
+     * coalescing. Together with {@link #getOutputMessageCount()} this shows how much wakeups were reduced.
+     */
+    public long getOutputReadCount() {
+        TerminalReactor.Channel channel = mReactorChannel;
+        return channel == null ? 0 : channel.mCoalescer.mReadCount;
+    }
+
+    /** The number of times the main thread has been woken to process output from the process. */
+    public long getOutputMessageCount() {
+        TerminalReactor.Channel channel = mReactorChannel;
+        return channel == null ? 0 : channel.mCoalescer.mMessageCount;
+    }
+
     @Override
     public void onCopyTextToClipboard(String text) {
         mClient.onCopyTextToClipboard(this, text);
@@ -314,41 +490,38 @@ public final class TerminalSession extends TerminalOutput {
         return null;
     }
 
-    private static FileDescriptor wrapFileDescriptor(int fileDescriptor, TerminalSessionClient client) {
-        FileDescriptor result = new FileDescriptor();
-        try {
-            Field descriptorField;
-            try {
-                descriptorField = FileDescriptor.class.getDeclaredField("descriptor");
-            } catch (NoSuchFieldException e) {
-                // For desktop java:
-                descriptorField = FileDescriptor.class.getDeclaredField("fd");
-            }
-            descriptorField.setAccessible(true);
-            descriptorField.set(result, fileDescriptor);
-        } catch (NoSuchFieldException | IllegalAccessException | IllegalArgumentException e) {
-            Logger.logStackTraceWithMessage(client, LOG_TAG, "Error accessing FileDescriptor#descriptor private field", e);
-            System.exit(1);
-        }
-        return result;
-    }
-
     @SuppressLint("HandlerLeak")
     class MainThreadHandler extends Handler {
 
-        final byte[] mReceiveBuffer = new byte[4 * 1024];
-
         @Override
         public void handleMessage(Message msg) {
-            int bytesRead = mProcessToTerminalIOQueue.read(mReceiveBuffer, false);
-            if (bytesRead > 0) {
-                mEmulator.append(mReceiveBuffer, bytesRead);
+            if (msg.what == MSG_REFLOW_TRANSCRIPT) {
+                if (mEmulator.reflowTranscript(REFLOW_ROWS_PER_MESSAGE)) sendEmptyMessage(MSG_REFLOW_TRANSCRIPT);
+                notifyScreenUpdate();
+                return;
+            }
+
+            // Cleared before reading the ring, so that output committed after the read is notified again.
+            if (msg.what == MSG_NEW_INPUT) mReactorChannel.mNewInputQueued = false;
+            // Process at most a ring full at a time, so that a flood of output does not block the main thread.
+            DirectByteRing ring = mProcessToTerminalRing;
+            int budget = ring.capacity();
+            int length;
+            while (budget > 0 && (length = Math.min(ring.readableLength(), budget)) > 0) {
+                mEmulator.append(ring.mBuffer, ring.readableOffset(), length);
+                ring.commitRead(length);
+                budget -= length;
+            }
+            if (budget < ring.capacity()) {
+                TerminalReactor.getInstance().consumed(mReactorChannel);
                 notifyScreenUpdate();
+                // Leaving the alternate buffer may have resized the main one.
+                scheduleTranscriptReflow();
             }
 
             if (msg.what == MSG_PROCESS_EXITED) {
-                int exitCode = (Integer) msg.obj;
-                cleanupResources(exitCode);
+                int exitCode = msg.arg1;
+                cleanupResources(exitCode, (ProcessResourceUsage) msg.obj);
 
                 String exitDescription = "\r\n[Process completed";
                 if (exitCode > 0) {
@@ -3,7 +3,7 @@ package com.termux.terminal;
 /**
  * <p>
  * Encodes effects, foreground and background colors into a 64 bit long, which are stored for each cell in a terminal
- * row in {@link TerminalRow#mStyle}.
+ * row in {@link TerminalRow#mStyleIds} through a {@link StyleTable}.
  * </p>
  * <p>
  * The bit layout is:
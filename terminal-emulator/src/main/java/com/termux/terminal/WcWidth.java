@@ -10,6 +10,10 @@ package com.termux.terminal;
  * https://github.com/termux/wcwidth
  * https://github.com/termux/libandroid-support
  * https://github.com/termux/termux-packages/tree/master/packages/libandroid-support
+ *
+ * The interval tables below are the source of {@link WcWidthTable} and jni/wcwidth_table.h, which answer lookups in
+ * constant time and have to be regenerated with terminal-emulator/scripts/generate-wcwidth-table.py after changing
+ * them.
  */
 public final class WcWidth {
 
@@ -512,6 +516,13 @@ public final class WcWidth {
 
     /** Return the terminal display width of a code point: 0, 1 || 2. */
     public static int width(int ucs) {
+        if (ucs < 0) return 0;
+        if (ucs > 0x10FFFF) return 1;
+        return WcWidthTable.width(ucs);
+    }
+
+    /** The width of a code point computed from the interval tables, which {@link WcWidthTable} is generated from. */
+    static int widthFromIntervals(int ucs) {
         if (ucs == 0 ||
             ucs == 0x034F ||
             (0x200B <= ucs && ucs <= 0x200F) ||
@@ -0,0 +1,154 @@
+package com.termux.terminal;
+
+// Generated by terminal-emulator/scripts/generate-wcwidth-table.py from WcWidth.java, do not edit.
+
+/**
+ * Three-stage lookup table of {@link WcWidth#width(int)}, answering it with three array loads. The stages are encoded
+ * as hex strings to keep the class initializer small.
+ */
+final class WcWidthTable {
+
+    private static final byte[] STAGE1 = decode(
+        "000102030405060708090a0b0c0d0d0d0d0d0d0e0d0d0d0d0d0d0d0d0d0d0d0d0d0d0d0d0d0d0d0d0d0f100d0d0d0d0d0d0d0d0d0d111212"
+        + "12121212121213141512161718191a1b12121212121c1212121212121212121212121d1e0d0d0d0d0d1f0d20121212121212122122121223"
+        + "1212122425122612272829122a2b2c120d0d0d0d0d0d0d0d0d0d0d0d0d0d0d0d0d0d0d0d0d0d0d0d0d0d0d0d0d0d0d0d0d0d0d0d0d0d0d0d"
+        + "0d0d0d0d0d0d0d0d0d0d0d0d0d0d0d0d0d0d0d0d0d0d0d2d0d0d0d0d0d0d0d0d0d0d0d0d0d0d0d0d0d0d0d0d0d0d0d0d0d0d0d0d0d0d0d0d"
+        + "0d0d0d0d0d0d0d0d0d0d0d0d0d0d0d0d0d0d0d0d0d0d0d0d0d0d0d0d0d0d0d2d121212121212121212121212121212121212121212121212"
+        + "1212121212121212121212121212121212121212121212121212121212121212121212121212121212121212121212121212121212121212"
+        + "1212121212121212121212121212121212121212121212121212121212121212121212121212121212121212121212121212121212121212"
+        + "1212121212121212121212121212121212121212121212121212121212121212121212121212121212121212121212121212121212121212"
+        + "1212121212121212121212121212121212121212121212121212121212121212121212121212121212121212121212121212121212121212"
+        + "1212121212121212121212121212121212121212121212121212121212121212121212121212121212121212121212121212121212121212"
+        + "1212121212121212121212121212121212121212121212121212121212121212121212121212121212121212121212121212121212121212"
+        + "1212121212121212121212121212121212121212121212121212121212121212121212121212121212121212121212121212121212121212"
+        + "1212121212121212121212121212121212121212121212121212121212121212121212121212121212121212121212121212121212121212"
+        + "1212121212121212121212121212121212121212121212121212121212121212121212121212121212121212121212121212121212121212"
+        + "1212121212121212121212121212121212121212121212121212121212121212121212121212121212121212121212121212121212121212"
+        + "1212121212121212121212121212121212121212121212121212121212121212121212121212121212121212121212121212121212121212"
+        + "2e12121212121212121212121212121212121212121212121212121212121212121212121212121212121212121212121212121212121212"
+        + "1212121212121212121212121212121212121212121212121212121212121212121212121212121212121212121212121212121212121212"
+        + "1212121212121212121212121212121212121212121212121212121212121212121212121212121212121212121212121212121212121212"
+        + "121212121212121212121212121212121212121212121212", 2);
+
+    private static final byte[] STAGE2 = decode(
+        "0001010200010101010101010101010101010101010101010000000301010101010101010401010101010101050607010801090a01010b0c"
+        + "0d0e0f0101100111121314011501161718191a1b1c1d1e1f201d2122201d23241c25261b27012801292a2b1b1c252c1b2d2e1e1b1c012f01"
+        + "01303101013233013435013637383901013a3b3c3d0101013e3e3e0101010101010101010101010101013f01010101010101010101010101"
+        + "010101010101010101010101010101014041414101424301440101014546010101470101010101014801494a010e4b014c4d274e2d4f0150"
+        + "01510101010152530101010101010000010101010101010101010101010101015433014c01010e5501010101010101010101010101010101"
+        + "5657010101010158010101010101010101010101010101595a015b5c5d5e5f60616263016465010101010101010101010101010101010101"
+        + "010101010101010166016701010101010101010101010168010101020101010001010101693e3e6a3e3e3e3e3e3e6b6c3e6d6e3e6f3e3e3e"
+        + "70713e3e723e3e73743e753e3e3e3e3e3e3e3e3e3e3e3e3e3e3e3e3e3e3e3e3e3e3e3e3e3e3e3e3e3e3e3e3e3e3e3e3e3e3e3e3e3e3e3e3e"
+        + "3e3e3e3e3e3e3e3e3e3e3e3e3e3e01013e3e3e3e3e3e3e3e3e3e3e3e3e3e3e3e3e3e3e3e763e77010101010101010101010101787901017a"
+        + "01010101010101017b7c010101017d7e017f8081188201830184851d01861c8701010101010101883e3e3e3e3e3e3e3e3e3e3e3e3e3e3e3e"
+        + "3e3e3e3e3e3e3e3e3e3e3e3e3e89010101010101010101010101010101010101010101010101010101010101010101010101010101010101"
+        + "3e3e3e3e3e3e3e3e3e3e3e3e3e3e3e3e8a01010101010101010101010101010101010101010101018b8c8d8e010101016e3e3e8f01010177"
+        + "0101010101010101010101010101019001010101010101910101019201010101010101010101010101010101010101019394010101010145"
+        + "010101010101010101010101010101010195010101010101010101010196013f01011001970101011c1598992d9a2701189b019c2d9d9e01"
+        + "019f1c01010102a02d2e91a1010101010115a20101a3a4010101010101a5a60101a7910101a801013fa901010101010101aa010101010101"
+        + "01abac010101ad91aeafb001b1010101010101010101010101b20101b3b4010101b5b601b701010101010101010101b82d92b90101010101"
+        + "0101ba01010101010101010101010101010101010101010101010101010101010101010101010101010101010101010101010101010101bb"
+        + "01bc0101010101010101010101010101010101010101010101010101010101010101bd01be0101bf3e3e3e3e3e3e3e3e3e3e3e3e3e3e3e3e"
+        + "3e3e3e3e3e3e3e3e3e3e3e3e3e3e3ec03e3e3e3e3e3e6b01c101010101010101010101010101010101010101010101010101010101010101"
+        + "0101010101010101010101010101010101010101010101c23e3e3e3e3e3e3e3e3ec3c4c53e3e3e3e3e3e3e3e3e3e3ec60101010101010101"
+        + "01010101c7010101010101010101010101010101010101010101010101010101010101010101010101010101010101010101010101010101"
+        + "00c89801010101010101010101010101010101c9cacb01010101cc0101010101010101010101010101010101010101010101010101010101"
+        + "00cd00cecfd001010101010101010101d1d20101bd01010101bc0101010101010101010101d301d4010101010101010101010101010101d4"
+        + "010101010101010101010101010101010101010101010101010101010101bc010101d5010101010101010101010101010101010101010101"
+        + "d60101010101d70101010101d8010101d9c6dadb010101013edc3edd6a3ededf3e74e03e3e3e3ee13ee2e3e4e5d601e63e3ee7013e3ee8e9"
+        + "01010101010101ea0101010101010101ebeced3e3e3e3e3e010101eeeff0f1f201010101010101013e3e3e3e3e3e3e3e3e3e3e3e3e3e3e3e"
+        + "3e3e3e3e3e3e3e3e3e3e3e3e3e3e3ee20101010101010101000000000000000301010101010101010101010101010101", 2);
+
+    private static final byte[] STAGE3 = decode(
+        "0000000000000000000000000000000011111111111111111111111111111111111111111111111111111111111111100000000000000000"
+        + "1111111111111111111000000011111111111111111111111111111111111111100000000000000000000000000000000000000000000010"
+        + "1001001011111111111111111111111111111111111111110000000000011111111111111110000000000000000000001111111111111111"
+        + "0111111111111111111111111111111111111100000001100000011001000011111111111111111111111111111111111011111111111111"
+        + "1111111111111111000000000000000000000000000111111111111111111111111111000000000001111111111111111111111111100000"
+        + "0000111111111011111111111111111111111100001000000000100010000011111111111111111111111111111111111111111110001111"
+        + "1111111111111111111111110000000011111111110000000000000000000000001000000000000000000000000000000001111111111111"
+        + "1111111111111111111111111111111111111111110101111000000001111011100000001111111111001111111111111111111111111111"
+        + "1011111111111111111111111111111111111111111111111111111111110111100001111111101111111111111111111100111111111111"
+        + "1111111111111101100111111111111111111111111111111001111001100011101111111111111111111111111111110011101111111111"
+        + "1000001001111011111111111111111111001111111111111111111111000000111111111111111111111111111101101000011111111011"
+        + "1111100111111111110111111111111111111111111111110111111111111011111111111111111101110111111111111111111111111111"
+        + "1111111111111111111111111111010001111100010000111111100111111111111111011111001111111111111111110011111111111111"
+        + "1111111111111111111111111111111111111111111001111111111111011111110001011111111111111111111111111011000000011111"
+        + "1111111000000001111111111111111111111111111111111011000000000111111111110000000111111111111111111111111111111111"
+        + "1111111100111111111111111111111111111010101111111111111111111111100000000000000100000100111110000000000010000000"
+        + "0000000000000000000000000000011111111101111111111111111111111111111111111111100001000000100110011111111111111111"
+        + "1111111100111100011111111111111110000111111111111101100111111011111111111111101122222222222222222222222222222222"
+        + "1111111111111111111111111111100011111111111111111100011111111111111111111111111111001111111111111111111111111111"
+        + "1111001000000011111111011000000000001111111110111111111111100010111111111111111111111001111111111111111111111111"
+        + "1111111110111111111111111111111100011110011111111101111110001111111111111111111111111110011011111111111111111111"
+        + "1111110100000001010110000000011111100000000001100000000000000001111111111111111100001111111111111111111111111111"
+        + "1111111111111111111101000001011111111111111000000000111111111111110000110010001111111111111111111111110100111010"
+        + "0011111111111111111111111111000000001100111111111111111111111111000100000000000001000000011110111111011100111111"
+        + "1111111111100000111111111111111100000000000000000111111111111111111111111111111111111111112211111111111112211111"
+        + "1111111111111111111111111222211121121111111111111111111111111111111111111111122111111111111111111111221111111111"
+        + "1111111122222222222211111111111111111111111111111111111111111112111111111111111111121111111111111211111111221111"
+        + "1111111111111221111122111111112111112111111111111111111111211111112212111121121111111211112211111111111111111111"
+        + "1111111121111111111111111111111111111111111121211112221211111111111111111111111111111222111111111111111111111111"
+        + "2111111111111112111111111111111111111111111221111111111111111111211112111111111111111111111111100011111111111111"
+        + "2222222222222222222222222212222222222222222222222222111111111111222222222222222222222211111111111111111111111111"
+        + "2222222222221111222222222200002222222222222222211222222222222222222222222222222222222222222222222222222110022222"
+        + "1111122222222222222222222222222222222222222222221222222222222222222222222222222122222222222222222222111111111111"
+        + "2222222222222222222222222222222222222222222222212222222211111111222222222222222222222222222221112222222222222222"
+        + "2222222111111111111111111111111111111111111111100001000000000011111111111111111111111111111111001111111111111111"
+        + "0011111111111111110111011110111111111111111111111111100111110111111111111111111111110011111111111111111111111111"
+        + "0000000000000000001111111111111011111100000000111111111111111111111111100000000000111111111111112222222222222222"
+        + "2222222222222111111111111111111111101100001100111111101111111111111111111111111111111111100000011001100111111111"
+        + "1110111111110111111111111111111111111111111111110100011001111100111111111111001111111101111111111111101101111011"
+        + "1111111111111111222211111111111111111111111111111111111111111111111111111111110100000000000000002222222222111111"
+        + "0000000000000000222222222222222222222222222222222221222222222222222222212222111111111111111111112111111111111111"
+        + "1111111111111111111111111111111111111111111110110111111111111111111111111111111111111111111111111111110000011111"
+        + "1000100111110000111111111111111111111111111111111111111100011110111100001111111111111111111111111111111111100111"
+        + "1111111111111111110000111111111111111111111111110000000111111111111111111111111111111111111111110110011111111110"
+        + "1111111111111111111000011001111111111110000010000000011111111111111111111111111111101111111111111111111111111111"
+        + "1111110000000001111111111000011011111111111111111111111111111110001101001111110111100000000111111111111111111111"
+        + "1111110000000111000001111111111111000101111111111111111111111101111111111111111111100000010111100100111111111111"
+        + "1111111111111111111111111111111111000011111100100111111111111111111111111111001111111111111111111110000000011010"
+        + "1111111111101011000000101111111111000010000011111111111111111111111111111111111000000000100111111111111111111111"
+        + "1111111111100101111011111111111111111111111111111111111111111111111100001100111110000000000111111111111111111111"
+        + "1111111111111111111000000110000111111110111111111000000110001111111111111100000000000001001111111111111111111111"
+        + "0000000100000010111111111111111111000000000000000000000011000000010010011111111111111111111111111000000111010010"
+        + "0000001011111111111111111111111111111111111111110011101011111111111111111111111111100111111111110101111111111111"
+        + "1111111111111111011111100000000000000011111111111111111111111111000001111111111111111111111111110000000111111111"
+        + "1111111111111110111111111111111111111111111111100001111111111111222201111111111122111111111111112222222222222222"
+        + "2222222211111111222222222111111111111111111111111111111111111111222212222222122122211111111111111121111111111111"
+        + "1111111111111111222112111111111111112222111111112222222222222222222222222222222222222222222211111111111111111111"
+        + "1111111111111001000000000000001100000000000000001111111000111111111111111110000000011000000011111111111111111111"
+        + "1111111111000011111111111111111111000111111111111111111111111111000000000000000000000001111000000000000000000111"
+        + "1111101111111111111101111111111111111111111000001000000000000000111111111111111100000001000000000000000001100000"
+        + "0010010000011111111111111111111111111111111111011111111111111111111111111111000011111111111111111111000000011111"
+        + "1111111111111111111121111111111111111111111111111111111111111112111111111111111111111111111111211222222222211111"
+        + "2221111111111111222222222222222222222222211111112211111111111111222222111111111111111111111111112111111111111222"
+        + "2222221222222222222222222222222222222222222221222222222222211112222211111111111122222222222222222111211122222222"
+        + "2122222222222222222222222222222222222222222222222222222222222112222222222222222222222222222222111111111111122221"
+        + "2222222222222222222222221111111111111111112111111111111111111111111112211111111111111111111111111111111111122222"
+        + "2222222222222222111111111111111122222211111121112221122211112222111111111112211111112222222221112222222222221111"
+        + "2111111111111111111111111111222222222222222222222222222222222222222222222221222222222212222222222222222222222222"
+        + "1111111111111111222222222222211122222222211111112222222222222222222222222222222222222222222222122222221111111122"
+        + "222222222222111122222222211111112222222221111111", 1);
+
+    private WcWidthTable() {
+    }
+
+    private static byte[] decode(String hex, int digits) {
+        byte[] values = new byte[hex.length() / digits];
+        for (int i = 0; i < values.length; i++) {
+            int value = 0;
+            for (int j = 0; j < digits; j++)
+                value = (value << 4) | Character.digit(hex.charAt(i * digits + j), 16);
+            values[i] = (byte) value;
+        }
+        return values;
+    }
+
+    /** The width of a code point from 0 to 0x10FFFF. */
+    static int width(int codePoint) {
+        int block = STAGE2[((STAGE1[codePoint >> 10] & 0xFF) << 5) | ((codePoint >> 5) & 31)] & 0xFF;
+        return STAGE3[(block << 5) | (codePoint & 31)];
+    }
+
+}
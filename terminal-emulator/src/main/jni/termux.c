@@ -1,15 +1,35 @@
-#include <dirent.h>
+#define _GNU_SOURCE
+#include <errno.h>
 #include <fcntl.h>
 #include <jni.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
 #include <signal.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/resource.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
 #include <sys/wait.h>
 #include <termios.h>
+#include <time.h>
 #include <unistd.h>
 
+#ifdef __ANDROID__
+# include <sys/system_properties.h>
+#endif
+
 #define TERMUX_UNUSED(x) x __attribute__((__unused__))
 #ifdef __APPLE__
 # define LACKS_PTSNAME_R
@@ -22,33 +42,268 @@ static int throw_runtime_exception(JNIEnv* env, char const* message)
     return -1;
 }
 
-static int create_subprocess(JNIEnv* env,
-        char const* cmd,
-        char const* cwd,
-        char* const argv[],
-        char** envp,
-        int* pProcessId,
-        jint rows,
-        jint columns,
-        jint cell_width,
-        jint cell_height)
+/*
+ * File descriptor hygiene for spawned children. All descriptors above stdio inherited from the app have to be closed
+ * between fork()/clone() and exec(), where nothing may allocate. The cheapest available strategy is picked by the
+ * parent with prepare_fd_sweep() and carried out by the child with sweep_fds():
+ *
+ * - close_range(2), a single system call (Linux 5.9, and for apps allowed by seccomp from Android 14).
+ * - Closing every fd below RLIMIT_NOFILE, when that limit is small enough for a loop to be cheap.
+ * - Listing /proc/self/fd as a last resort.
+ */
+
+/** The highest RLIMIT_NOFILE for which closing every possible fd in a loop is preferred over listing /proc. */
+#define FD_SWEEP_MAX_LOOP_LIMIT 65536
+
+enum fd_sweep_strategy { FD_SWEEP_CLOSE_RANGE, FD_SWEEP_LOOP, FD_SWEEP_PROC };
+
+struct fd_sweep {
+    enum fd_sweep_strategy strategy;
+    /** The soft RLIMIT_NOFILE, only used by FD_SWEEP_LOOP. */
+    int limit;
+};
+
+static int close_range_supported;
+static pthread_once_t close_range_probe_once = PTHREAD_ONCE_INIT;
+
+static void probe_close_range(void)
+{
+#ifdef __NR_close_range
+# ifdef __ANDROID__
+    // Before Android 14 close_range(2) is not in the seccomp allowlist of apps, and calling it would raise SIGSYS.
+    char sdk_version[PROP_VALUE_MAX];
+    if (__system_property_get("ro.build.version.sdk", sdk_version) <= 0 || atoi(sdk_version) < 34) return;
+# endif
+    // Closing the one fd UINT_MAX closes nothing, as no fd can be that high, but fails with ENOSYS on kernels without
+    // close_range(2).
+    close_range_supported = syscall(__NR_close_range, ~0U, ~0U, 0) == 0;
+#endif
+}
+
+static struct fd_sweep prepare_fd_sweep(void)
+{
+    pthread_once(&close_range_probe_once, probe_close_range);
+    if (close_range_supported) return (struct fd_sweep) { .strategy = FD_SWEEP_CLOSE_RANGE };
+
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY && limit.rlim_cur <= FD_SWEEP_MAX_LOOP_LIMIT)
+        return (struct fd_sweep) { .strategy = FD_SWEEP_LOOP, .limit = (int) limit.rlim_cur };
+
+    return (struct fd_sweep) { .strategy = FD_SWEEP_PROC };
+}
+
+/** Close all file descriptors >= lowest_fd by listing /proc/self/fd with getdents64(2) into a stack buffer. */
+static void close_fds_from_proc(int lowest_fd)
+{
+    int dir_fd = open("/proc/self/fd", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dir_fd < 0) return;
+
+    char buffer[1024] __attribute__((aligned(8)));
+    long bytes_read;
+    while ((bytes_read = syscall(SYS_getdents64, dir_fd, buffer, sizeof(buffer))) > 0) {
+        int closed_any = 0;
+        for (long offset = 0; offset < bytes_read; ) {
+            // struct linux_dirent64: u64 d_ino, s64 d_off, u16 d_reclen, u8 d_type, char d_name[].
+            unsigned short record_length;
+            memcpy(&record_length, buffer + offset + 16, sizeof(record_length));
+            char const* name = buffer + offset + 19;
+            offset += record_length;
+
+            int fd = 0;
+            if (*name < '0' || *name > '9') continue;
+            for (; *name >= '0' && *name <= '9'; name++) fd = fd * 10 + (*name - '0');
+            if (fd >= lowest_fd && fd != dir_fd) {
+                close(fd);
+                closed_any = 1;
+            }
+        }
+        // The listing changes under us as we close, so start over until a full pass closes nothing.
+        if (closed_any) lseek(dir_fd, 0, SEEK_SET);
+    }
+    close(dir_fd);
+}
+
+/** Close all file descriptors >= lowest_fd. Async-signal-safe, to be called in the child. */
+static void sweep_fds(struct fd_sweep const* sweep, int lowest_fd)
+{
+    switch (sweep->strategy) {
+        case FD_SWEEP_CLOSE_RANGE:
+#ifdef __NR_close_range
+            if (syscall(__NR_close_range, (unsigned int) lowest_fd, ~0U, 0) == 0) return;
+#endif
+            close_fds_from_proc(lowest_fd);
+            break;
+        case FD_SWEEP_LOOP:
+            for (int fd = lowest_fd; fd < sweep->limit; fd++) close(fd);
+            break;
+        case FD_SWEEP_PROC:
+            close_fds_from_proc(lowest_fd);
+            break;
+    }
+}
+
+/** Size of the stack the clone()d child runs on until it has called execve(). */
+#define SPAWN_CHILD_STACK_SIZE (64 * 1024)
+
+/** Everything the clone()d child needs, prepared by the parent so that the child never has to allocate. */
+struct spawn_request {
+    char const* path;
+    char const* cmd;
+    char const* cwd;
+    char const* devname;
+    char* const* argv;
+    char* const* envp;
+    struct fd_sweep sweep;
+};
+
+/**
+ * Resolve cmd the way execvp() would after the environment has been replaced by envp. Returns a malloc()ed path, or
+ * NULL if the lookup cannot be done up front (no PATH in envp, relative PATH entries or no executable found), in which
+ * case the caller falls back to fork() so that the child reports the failure as before.
+ */
+static char* resolve_executable(char const* cmd, char* const* envp)
+{
+    if (strchr(cmd, '/')) return strdup(cmd);
+
+    char const* path = NULL;
+    if (envp) for (char* const* e = envp; *e; ++e) if (strncmp(*e, "PATH=", 5) == 0) path = *e + 5;
+    if (path == NULL) return NULL;
+
+    size_t cmd_length = strlen(cmd);
+    while (*path) {
+        char const* end = strchrnul(path, ':');
+        size_t dir_length = (size_t) (end - path);
+        // Relative entries would have to be resolved against cwd in the child.
+        if (dir_length == 0 || path[0] != '/') return NULL;
+
+        char* candidate = malloc(dir_length + cmd_length + 2);
+        if (!candidate) return NULL;
+        memcpy(candidate, path, dir_length);
+        candidate[dir_length] = '/';
+        memcpy(candidate + dir_length + 1, cmd, cmd_length + 1);
+        if (access(candidate, X_OK) == 0) return candidate;
+        free(candidate);
+
+        path = *end ? end + 1 : end;
+    }
+    return NULL;
+}
+
+/** Write "call("arg"): error" to stderr like perror() does, but without allocating. */
+static void write_child_error(char const* call, char const* arg, int error)
+{
+    char const* description = strerror(error);
+    struct iovec iov[] = {
+        { (void*) call, strlen(call) }, { "(\"", 2 }, { (void*) arg, strlen(arg) }, { "\"): ", 4 },
+        { (void*) description, strlen(description) }, { "\n", 1 }
+    };
+    writev(STDERR_FILENO, iov, sizeof(iov) / sizeof(iov[0]));
+}
+
+/** Reset all signals with a handler installed (by the runtime) to the default action. */
+static void reset_signal_handlers(void)
+{
+    for (int sig = 1; sig < NSIG; sig++) {
+        struct sigaction action;
+        if (sigaction(sig, NULL, &action) != 0) continue;
+        if (action.sa_handler == SIG_DFL || action.sa_handler == SIG_IGN) continue;
+        memset(&action, 0, sizeof(action));
+        action.sa_handler = SIG_DFL;
+        sigaction(sig, &action, NULL);
+    }
+}
+
+/**
+ * Entry point of the clone(CLONE_VM | CLONE_VFORK) child. It shares memory with the suspended parent thread (and the
+ * still running other threads of the app), so it may only use async-signal-safe calls and must end in execve() or
+ * _exit().
+ */
+static int spawn_child(void* arg)
+{
+    struct spawn_request const* request = arg;
+
+    // Handlers installed by the runtime must not run in this address space, so reset them before unblocking the
+    // signals blocked by clone_subprocess() and the ones the Android java process may have blocked.
+    reset_signal_handlers();
+    sigset_t signals_to_unblock;
+    sigfillset(&signals_to_unblock);
+    sigprocmask(SIG_UNBLOCK, &signals_to_unblock, 0);
+
+    setsid();
+
+    int pts = open(request->devname, O_RDWR);
+    if (pts < 0) _exit(-1);
+
+    dup2(pts, 0);
+    dup2(pts, 1);
+    dup2(pts, 2);
+
+    sweep_fds(&request->sweep, 3);
+
+    if (chdir(request->cwd) != 0) write_child_error("chdir", request->cwd, errno);
+
+    char* const empty_envp[] = { NULL };
+    execve(request->path, request->argv, request->envp ? request->envp : empty_envp);
+    // Show terminal output about failing exec() call:
+    write_child_error("exec", request->cmd, errno);
+    _exit(1);
+}
+
+/**
+ * Spawn the child with clone(CLONE_VM | CLONE_VFORK), which unlike fork() does not have to copy the page tables of the
+ * (large) app process. Returns the pid of the child, or -1 if the fast path is not possible and fork() should be used.
+ */
+static pid_t clone_subprocess(char const* cmd, char const* cwd, char const* devname, char* const argv[], char* const envp[])
+{
+    struct spawn_request request = { .cmd = cmd, .cwd = cwd, .devname = devname, .argv = argv, .envp = envp, .sweep = prepare_fd_sweep() };
+    char* path = resolve_executable(cmd, envp);
+    if (!path) return -1;
+    request.path = path;
+
+    void* stack = mmap(NULL, SPAWN_CHILD_STACK_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0);
+    if (stack == MAP_FAILED) {
+        free(path);
+        return -1;
+    }
+
+    // Block all signals so that no handler runs in the child before it has reset them.
+    sigset_t all_signals, old_signals;
+    sigfillset(&all_signals);
+    pthread_sigmask(SIG_BLOCK, &all_signals, &old_signals);
+    // The stack grows downwards on all supported ABIs. The parent thread is suspended until the child has exec'd.
+    pid_t pid = clone(spawn_child, (char*) stack + SPAWN_CHILD_STACK_SIZE, CLONE_VM | CLONE_VFORK | SIGCHLD, &request);
+    pthread_sigmask(SIG_SETMASK, &old_signals, NULL);
+
+    munmap(stack, SPAWN_CHILD_STACK_SIZE);
+    free(path);
+    return pid;
+}
+
+/**
+ * Open a new pseudoterminal master with UTF-8 mode and the initial window size set, storing the name of the slave
+ * device in devname. Returns the master fd, or -1 with *error set to a description of the failure.
+ */
+static int open_pty_master(char* devname, size_t devname_size, int rows, int columns, int cell_width, int cell_height, char const** error)
 {
     int ptm = open("/dev/ptmx", O_RDWR | O_CLOEXEC);
-    if (ptm < 0) return throw_runtime_exception(env, "Cannot open /dev/ptmx");
+    if (ptm < 0) {
+        *error = "Cannot open /dev/ptmx";
+        return -1;
+    }
 
 #ifdef LACKS_PTSNAME_R
-    char* devname;
-#else
-    char devname[64];
+    char* name;
 #endif
     if (grantpt(ptm) || unlockpt(ptm) ||
 #ifdef LACKS_PTSNAME_R
-            (devname = ptsname(ptm)) == NULL
+            (name = ptsname(ptm)) == NULL || strlcpy(devname, name, devname_size) >= devname_size
 #else
-            ptsname_r(ptm, devname, sizeof(devname))
+            ptsname_r(ptm, devname, devname_size)
 #endif
        ) {
-        return throw_runtime_exception(env, "Cannot grantpt()/unlockpt()/ptsname_r() on /dev/ptmx");
+        close(ptm);
+        *error = "Cannot grantpt()/unlockpt()/ptsname_r() on /dev/ptmx";
+        return -1;
     }
 
     // Enable UTF-8 mode and disable flow control to prevent Ctrl+S from locking up the display.
@@ -61,13 +316,23 @@ static int create_subprocess(JNIEnv* env,
     /** Set initial winsize. */
     struct winsize sz = { .ws_row = (unsigned short) rows, .ws_col = (unsigned short) columns, .ws_xpixel = (unsigned short) (columns * cell_width), .ws_ypixel = (unsigned short) (rows * cell_height)};
     ioctl(ptm, TIOCSWINSZ, &sz);
+    return ptm;
+}
 
-    pid_t pid = fork();
-    if (pid < 0) {
-        return throw_runtime_exception(env, "Fork failed");
-    } else if (pid > 0) {
-        *pProcessId = (int) pid;
-        return ptm;
+/**
+ * Start cmd as a session leader with the slave side of the pseudoterminal ptm as its controlling terminal. Returns the
+ * pid of the child or -1 if it could not be started.
+ */
+static pid_t spawn_on_pty(int ptm, char const* devname, char const* cmd, char const* cwd, char* const argv[], char* const envp[])
+{
+    pid_t pid = clone_subprocess(cmd, cwd, devname, argv, envp);
+    if (pid > 0) return pid;
+
+    // Fall back to fork() when the clone() fast path could not be used.
+    struct fd_sweep sweep = prepare_fd_sweep();
+    pid = fork();
+    if (pid != 0) {
+        return pid;
     } else {
         // Clear signals which the Android java process may have blocked:
         sigset_t signals_to_unblock;
@@ -84,16 +349,7 @@ static int create_subprocess(JNIEnv* env,
         dup2(pts, 1);
         dup2(pts, 2);
 
-        DIR* self_dir = opendir("/proc/self/fd");
-        if (self_dir != NULL) {
-            int self_dir_fd = dirfd(self_dir);
-            struct dirent* entry;
-            while ((entry = readdir(self_dir)) != NULL) {
-                int fd = atoi(entry->d_name);
-                if (fd > 2 && fd != self_dir_fd) close(fd);
-            }
-            closedir(self_dir);
-        }
+        sweep_fds(&sweep, 3);
 
         clearenv();
         if (envp) for (; *envp; ++envp) putenv(*envp);
@@ -114,6 +370,745 @@ static int create_subprocess(JNIEnv* env,
     }
 }
 
+/** A session to be started by create_subprocesses(). */
+struct subprocess_spec {
+    char const* cmd;
+    char const* cwd;
+    char* const* argv;
+    char* const* envp;
+    int rows, columns, cell_width, cell_height;
+    /**
+     * Optionally cmd, cwd, argv and envp already encoded in sections as the strings of a spawn helper request, so that
+     * they need not be serialized for every launch. See struct spawn_template.
+     */
+    struct iovec const* encoded;
+    int encoded_count;
+};
+
+/** A list of child pids, each with an associated file descriptor. */
+struct pid_fd_table {
+    struct pid_fd_entry { pid_t pid; int fd; }* entries;
+    size_t count;
+    size_t capacity;
+};
+
+static int pid_fd_table_add(struct pid_fd_table* table, pid_t pid, int fd)
+{
+    if (table->count == table->capacity) {
+        size_t new_capacity = table->capacity ? table->capacity * 2 : 16;
+        struct pid_fd_entry* new_entries = realloc(table->entries, new_capacity * sizeof(struct pid_fd_entry));
+        if (!new_entries) return -1;
+        table->entries = new_entries;
+        table->capacity = new_capacity;
+    }
+    table->entries[table->count].pid = pid;
+    table->entries[table->count].fd = fd;
+    table->count++;
+    return 0;
+}
+
+/** Return the fd of the entry for pid, or -1 if there is none. */
+static int pid_fd_table_find(struct pid_fd_table const* table, pid_t pid)
+{
+    for (size_t i = 0; i < table->count; i++) {
+        if (table->entries[i].pid == pid) return table->entries[i].fd;
+    }
+    return -1;
+}
+
+/** Remove the entry for pid, returning its fd or -1 if there was none. */
+static int pid_fd_table_remove(struct pid_fd_table* table, pid_t pid)
+{
+    for (size_t i = 0; i < table->count; i++) {
+        if (table->entries[i].pid == pid) {
+            int fd = table->entries[i].fd;
+            table->entries[i] = table->entries[--table->count];
+            return fd;
+        }
+    }
+    return -1;
+}
+
+/*
+ * The spawn helper is a process forked from the app by JNI.startSpawnHelper(), which apps call as early as they can,
+ * from Application.onCreate(). It spawns terminal sessions on request so that they are not forked from the app process
+ * once its heap has grown. The helper does not exec, so it keeps a copy-on-write image of everything the app had mapped
+ * when it was forked: every page the app writes to afterwards is duplicated, and the copy stays with the helper. Forking
+ * it early keeps that image close to the one shared with the zygote, which is why it is not forked lazily when the
+ * library is first loaded, and sessions are spawned from the app process itself if it was never started.
+ *
+ * Requests are single SOCK_SEQPACKET messages: a struct spawn_helper_request followed by cmd, cwd, argv and envp as
+ * consecutive NUL terminated strings. The reply is a struct spawn_helper_response which on success carries the
+ * pseudoterminal master and the read end of an exit pipe as SCM_RIGHTS. Since the session is a child of the helper and
+ * not of the app, the helper reaps it and writes a struct exit_report to the exit pipe, from which JNI.waitFor() reads.
+ */
+
+/** Largest request sent to the spawn helper, larger ones are spawned from the app process instead. */
+#define SPAWN_HELPER_MAX_REQUEST (64 * 1024)
+
+/** Returned by spawn_helper_create_subprocess() if the caller should spawn from the app process instead. */
+#define SPAWN_HELPER_UNAVAILABLE (-1)
+/** Sent by the spawn helper instead of a pid when the session could not be started. */
+#define SPAWN_HELPER_PTY_FAILED (-2)
+#define SPAWN_HELPER_FORK_FAILED (-3)
+
+struct spawn_helper_request {
+    int32_t rows, columns, cell_width, cell_height;
+    int32_t argc, envc;
+};
+
+struct spawn_helper_response {
+    int32_t pid;
+};
+
+/** What is known of a process once it has been reaped, as written to exit pipes: its wait status and wait4() usage. */
+struct exit_report {
+    int status;
+    struct rusage usage;
+};
+
+/** Socket to the spawn helper, or -1 if it is not running. Guarded by spawn_helper_mutex. */
+static int spawn_helper_socket = -1;
+static pthread_mutex_t spawn_helper_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t spawn_helper_once = PTHREAD_ONCE_INIT;
+
+/** Exit pipes of sessions, see exit tracking below. Guarded by exit_fds_mutex. */
+static struct pid_fd_table exit_fds;
+static pthread_mutex_t exit_fds_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/** Return the next NUL terminated string at *position before end and advance past it, or NULL if there is none. */
+static char* next_request_string(char** position, char* end)
+{
+    char* string = *position;
+    char* terminator = memchr(string, 0, (size_t) (end - string));
+    if (!terminator) return NULL;
+    *position = terminator + 1;
+    return string;
+}
+
+static void spawn_helper_handle_request(int sock, char* message, size_t length, struct pid_fd_table* children)
+{
+    // A malformed request is still answered, as the app waits for the response holding spawn_helper_mutex.
+    struct spawn_helper_request request = { 0 };
+    int malformed = length < sizeof(request);
+    if (!malformed) memcpy(&request, message, sizeof(request));
+    malformed = malformed || request.argc < 0 || request.envc < 0;
+
+    char* end = message + length;
+    char* position = malformed ? end : message + sizeof(request);
+    char* cmd = next_request_string(&position, end);
+    char* cwd = next_request_string(&position, end);
+    char** argv = (!malformed && request.argc) ? calloc((size_t) request.argc + 1, sizeof(char*)) : NULL;
+    char** envp = (!malformed && request.envc) ? calloc((size_t) request.envc + 1, sizeof(char*)) : NULL;
+
+    struct spawn_helper_response response = { .pid = SPAWN_HELPER_FORK_FAILED };
+    int fds[2] = { -1, -1 };
+    malformed = malformed || !cmd || !cwd || (request.argc && !argv) || (request.envc && !envp);
+    for (int i = 0; !malformed && i < request.argc; i++) malformed = !(argv[i] = next_request_string(&position, end));
+    for (int i = 0; !malformed && i < request.envc; i++) malformed = !(envp[i] = next_request_string(&position, end));
+
+    if (!malformed) {
+        char devname[64];
+        char const* error;
+        int exit_pipe[2];
+        int ptm = open_pty_master(devname, sizeof(devname), request.rows, request.columns, request.cell_width, request.cell_height, &error);
+        if (ptm < 0) {
+            response.pid = SPAWN_HELPER_PTY_FAILED;
+        } else if (pipe2(exit_pipe, O_CLOEXEC) != 0) {
+            close(ptm);
+        } else {
+            pid_t pid = spawn_on_pty(ptm, devname, cmd, cwd, argv, envp);
+            if (pid > 0 && pid_fd_table_add(children, pid, exit_pipe[1]) == 0) {
+                response.pid = pid;
+                fds[0] = ptm;
+                fds[1] = exit_pipe[0];
+            } else {
+                // Without a pid the child is reaped and forgotten, and the app sees "Fork failed".
+                close(ptm);
+                close(exit_pipe[0]);
+                close(exit_pipe[1]);
+            }
+        }
+    }
+    free(argv);
+    free(envp);
+
+    struct iovec iov = { &response, sizeof(response) };
+    char control[CMSG_SPACE(sizeof(fds))];
+    struct msghdr msg = { .msg_iov = &iov, .msg_iovlen = 1 };
+    if (response.pid > 0) {
+        memset(control, 0, sizeof(control));
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+        memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+    }
+    while (sendmsg(sock, &msg, MSG_NOSIGNAL) < 0 && errno == EINTR);
+    // The app now holds its own references, or has gone away and the session will get SIGHUP.
+    if (fds[0] >= 0) close(fds[0]);
+    if (fds[1] >= 0) close(fds[1]);
+}
+
+/** Reap exited sessions and pass their wait status and resource usage on through their exit pipes. */
+static void spawn_helper_reap_children(struct pid_fd_table* children)
+{
+    struct exit_report report;
+    pid_t pid;
+    while ((pid = wait4(-1, &report.status, WNOHANG, &report.usage)) > 0) {
+        int fd = pid_fd_table_remove(children, pid);
+        if (fd >= 0) {
+            while (write(fd, &report, sizeof(report)) < 0 && errno == EINTR);
+            close(fd);
+        }
+    }
+}
+
+__attribute__((noreturn)) static void spawn_helper_main(int sock)
+{
+    prctl(PR_SET_NAME, "termux-spawn");
+    reset_signal_handlers();
+
+    sigset_t signals;
+    sigfillset(&signals);
+    sigprocmask(SIG_UNBLOCK, &signals, NULL);
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &signals, NULL);
+
+    // Keep nothing from the app process but stdio and the socket.
+    if (sock != 3) {
+        if (dup3(sock, 3, O_CLOEXEC) < 0) _exit(1);
+        sock = 3;
+    }
+    struct fd_sweep sweep = prepare_fd_sweep();
+    sweep_fds(&sweep, 4);
+
+    int signal_fd = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+    char* message = malloc(SPAWN_HELPER_MAX_REQUEST);
+    if (signal_fd < 0 || !message) _exit(1);
+
+    struct pid_fd_table children = { 0 };
+    struct pollfd poll_fds[] = { { .fd = sock, .events = POLLIN }, { .fd = signal_fd, .events = POLLIN } };
+    while (1) {
+        if (poll(poll_fds, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            _exit(1);
+        }
+
+        if (poll_fds[1].revents) {
+            struct signalfd_siginfo info;
+            while (read(signal_fd, &info, sizeof(info)) > 0);
+            spawn_helper_reap_children(&children);
+        }
+
+        if (poll_fds[0].revents) {
+            ssize_t length = recv(sock, message, SPAWN_HELPER_MAX_REQUEST, 0);
+            if (length < 0 && errno == EINTR) continue;
+            // The app process has gone away.
+            if (length <= 0) _exit(0);
+            spawn_helper_handle_request(sock, message, (size_t) length, &children);
+        }
+    }
+}
+
+/** Fork the spawn helper. Called once, through spawn_helper_once, by JNI.startSpawnHelper(). */
+static void start_spawn_helper(void)
+{
+    int sockets[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sockets) != 0) return;
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(sockets[0]);
+        close(sockets[1]);
+    } else if (pid == 0) {
+        close(sockets[0]);
+        spawn_helper_main(sockets[1]);
+    } else {
+        close(sockets[1]);
+        pthread_mutex_lock(&spawn_helper_mutex);
+        spawn_helper_socket = sockets[0];
+        pthread_mutex_unlock(&spawn_helper_mutex);
+    }
+}
+
+/** The most sections a pre-encoded spawn request, see struct subprocess_spec, may consist of. */
+#define SPAWN_HELPER_MAX_ENCODED_SECTIONS 3
+
+/** Append the strings to position, each NUL terminated, returning the new end. */
+static char* encode_strings(char* position, char* const* strings)
+{
+    if (strings) for (; *strings; ++strings) position = stpcpy(position, *strings) + 1;
+    return position;
+}
+
+static size_t encoded_strings_length(char* const* strings)
+{
+    size_t length = 0;
+    if (strings) for (; *strings; ++strings) length += strlen(*strings) + 1;
+    return length;
+}
+
+/** Send the spawn request for spec. Returns 0 if sent, 1 if it is too large for the helper or -1 if the helper has gone away. */
+static int spawn_helper_send_request(int sock, struct subprocess_spec const* spec)
+{
+    struct spawn_helper_request request = { .rows = spec->rows, .columns = spec->columns, .cell_width = spec->cell_width, .cell_height = spec->cell_height };
+    if (spec->argv) while (spec->argv[request.argc]) request.argc++;
+    if (spec->envp) while (spec->envp[request.envc]) request.envc++;
+
+    struct iovec iov[1 + SPAWN_HELPER_MAX_ENCODED_SECTIONS] = { { &request, sizeof(request) } };
+    int iov_count = 1;
+    size_t length = sizeof(request);
+    char* strings = NULL;
+    if (spec->encoded) {
+        for (int i = 0; i < spec->encoded_count; i++) {
+            iov[iov_count++] = spec->encoded[i];
+            length += spec->encoded[i].iov_len;
+        }
+        if (length > SPAWN_HELPER_MAX_REQUEST) return 1;
+    } else {
+        size_t strings_length = strlen(spec->cmd) + 1 + strlen(spec->cwd) + 1 + encoded_strings_length(spec->argv) + encoded_strings_length(spec->envp);
+        length += strings_length;
+        if (length > SPAWN_HELPER_MAX_REQUEST || !(strings = malloc(strings_length))) return 1;
+        char* position = stpcpy(strings, spec->cmd) + 1;
+        position = stpcpy(position, spec->cwd) + 1;
+        encode_strings(encode_strings(position, spec->argv), spec->envp);
+        iov[iov_count++] = (struct iovec) { strings, strings_length };
+    }
+
+    struct msghdr msg = { .msg_iov = iov, .msg_iovlen = (size_t) iov_count };
+    ssize_t sent;
+    while ((sent = sendmsg(sock, &msg, MSG_NOSIGNAL)) < 0 && errno == EINTR);
+    free(strings);
+    return (sent == (ssize_t) length) ? 0 : -1;
+}
+
+/**
+ * Receive the reply to a spawn request, storing the pseudoterminal master in *pPtm and the pid in *pPid. *pPtm is set
+ * to SPAWN_HELPER_PTY_FAILED or SPAWN_HELPER_FORK_FAILED if the helper could not start the session. Returns -1 if the
+ * helper has gone away.
+ */
+static int spawn_helper_receive(int sock, int* pPtm, int* pPid)
+{
+    struct spawn_helper_response response;
+    int fds[2];
+    size_t fds_received = 0;
+
+    struct iovec iov = { &response, sizeof(response) };
+    char control[CMSG_SPACE(sizeof(fds))];
+    struct msghdr msg = { .msg_iov = &iov, .msg_iovlen = 1, .msg_control = control, .msg_controllen = sizeof(control) };
+    ssize_t received;
+    while ((received = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC)) < 0 && errno == EINTR);
+    for (struct cmsghdr* cmsg = received > 0 ? CMSG_FIRSTHDR(&msg) : NULL; cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+            fds_received = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            if (fds_received > 2) fds_received = 2;
+            memcpy(fds, CMSG_DATA(cmsg), fds_received * sizeof(int));
+        }
+    }
+
+    if (received != sizeof(response) || (response.pid > 0 && fds_received != 2)) {
+        for (size_t i = 0; i < fds_received; i++) close(fds[i]);
+        return -1;
+    }
+    if (response.pid < 0) {
+        *pPtm = response.pid;
+        return 0;
+    }
+
+    pthread_mutex_lock(&exit_fds_mutex);
+    int added = pid_fd_table_add(&exit_fds, response.pid, fds[1]);
+    pthread_mutex_unlock(&exit_fds_mutex);
+    if (added != 0) {
+        // Without an exit pipe JNI.waitFor() could never return, so rather have the session killed by SIGHUP.
+        close(fds[0]);
+        close(fds[1]);
+        *pPtm = SPAWN_HELPER_FORK_FAILED;
+        return 0;
+    }
+    *pPtm = fds[0];
+    *pPid = response.pid;
+    return 0;
+}
+
+/** The number of spawn requests sent to the helper before waiting for their replies. */
+#define SPAWN_HELPER_WINDOW 16
+
+/**
+ * Ask the spawn helper to start count sessions, sending the requests back to back. For each session ptms[i] is set to
+ * the pseudoterminal master and pids[i] to the pid, or ptms[i] is SPAWN_HELPER_UNAVAILABLE if the session should be
+ * spawned from the app process instead, or SPAWN_HELPER_PTY_FAILED/SPAWN_HELPER_FORK_FAILED.
+ */
+static void spawn_helper_create_subprocesses(struct subprocess_spec const* specs, int count, int* ptms, int* pids)
+{
+    for (int i = 0; i < count; i++) ptms[i] = SPAWN_HELPER_UNAVAILABLE;
+
+    pthread_mutex_lock(&spawn_helper_mutex);
+    for (int start = 0; start < count && spawn_helper_socket >= 0; start += SPAWN_HELPER_WINDOW) {
+        int in_flight[SPAWN_HELPER_WINDOW];
+        int in_flight_count = 0;
+        int helper_gone = 0;
+
+        for (int i = start; i < count && i < start + SPAWN_HELPER_WINDOW && !helper_gone; i++) {
+            int sent = spawn_helper_send_request(spawn_helper_socket, &specs[i]);
+            if (sent == 0) in_flight[in_flight_count++] = i; else if (sent < 0) helper_gone = 1;
+        }
+
+        for (int j = 0; j < in_flight_count && !helper_gone; j++)
+            helper_gone = spawn_helper_receive(spawn_helper_socket, &ptms[in_flight[j]], &pids[in_flight[j]]) != 0;
+
+        if (helper_gone) {
+            // Do not try it again, the remaining sessions are spawned from the app process.
+            close(spawn_helper_socket);
+            spawn_helper_socket = -1;
+        }
+    }
+    pthread_mutex_unlock(&spawn_helper_mutex);
+}
+
+/*
+ * Exit tracking. Every session process gets an exit watch, a file descriptor which becomes readable once it has exited,
+ * so that exits can be waited for with a timeout, polled without blocking or watched from an event loop such as the
+ * reactor, instead of each needing a thread blocked in waitpid(). The watch is one of:
+ *
+ * - The exit pipe of a session of the spawn helper, to which the helper writes the exit report (in exit_fds).
+ * - A pidfd of a child of this process (Linux 5.3, and for apps allowed by seccomp from Android 12), after which the
+ *   child is reaped with wait4() (in exit_pidfds).
+ * - Otherwise an exit pipe written with the exit report by the reaper thread of this process, which a SIGCHLD handler
+ *   wakes (in exit_fds, with the write end in reaper_children).
+ *
+ * As with waitpid(), a process may only be waited for by one thread at a time.
+ */
+
+/** Pidfds of children of this process. Guarded by exit_fds_mutex. */
+static struct pid_fd_table exit_pidfds;
+
+static int pidfd_supported;
+static pthread_once_t pidfd_probe_once = PTHREAD_ONCE_INIT;
+
+static void probe_pidfd(void)
+{
+#ifdef __NR_pidfd_open
+# ifdef __ANDROID__
+    // Before Android 12 pidfd_open(2) is not in the seccomp allowlist of apps, and calling it would raise SIGSYS.
+    char sdk_version[PROP_VALUE_MAX];
+    if (__system_property_get("ro.build.version.sdk", sdk_version) <= 0 || atoi(sdk_version) < 31) return;
+# endif
+    int fd = (int) syscall(__NR_pidfd_open, getpid(), 0);
+    if (fd >= 0) {
+        pidfd_supported = 1;
+        close(fd);
+    }
+#endif
+}
+
+/** Write ends of the exit pipes of children of this process without a pidfd. Guarded by reaper_mutex. */
+static struct pid_fd_table reaper_children;
+static pthread_mutex_t reaper_mutex = PTHREAD_MUTEX_INITIALIZER;
+/** Pipe through which the SIGCHLD handler wakes the reaper thread, -1 if it could not be started. */
+static int reaper_wake_fds[2] = { -1, -1 };
+static struct sigaction reaper_previous_action;
+static pthread_once_t reaper_once = PTHREAD_ONCE_INIT;
+
+static void reaper_wake(void)
+{
+    char byte = 0;
+    // Non-blocking, a full pipe already wakes the reaper.
+    while (write(reaper_wake_fds[1], &byte, 1) < 0 && errno == EINTR);
+}
+
+static void reaper_sigchld_handler(int signal, siginfo_t* info, void* context)
+{
+    int saved_errno = errno;
+    reaper_wake();
+    errno = saved_errno;
+
+    // Chain to the handler installed before, if any.
+    if (reaper_previous_action.sa_flags & SA_SIGINFO) {
+        if (reaper_previous_action.sa_sigaction) reaper_previous_action.sa_sigaction(signal, info, context);
+    } else if (reaper_previous_action.sa_handler != SIG_DFL && reaper_previous_action.sa_handler != SIG_IGN) {
+        reaper_previous_action.sa_handler(signal);
+    }
+}
+
+static void* reaper_main(void* TERMUX_UNUSED(arg))
+{
+    char buffer[64];
+    while (1) {
+        if (read(reaper_wake_fds[0], buffer, sizeof(buffer)) < 0 && errno == EINTR) continue;
+
+        pthread_mutex_lock(&reaper_mutex);
+        for (size_t i = 0; i < reaper_children.count;) {
+            struct pid_fd_entry* entry = &reaper_children.entries[i];
+            struct exit_report report = { 0 };
+            pid_t result = wait4(entry->pid, &report.status, WNOHANG, &report.usage);
+            if (result == 0 || (result < 0 && errno == EINTR)) {
+                i++;
+                continue;
+            }
+            // Reaped, or reaped by someone else (ECHILD) in which case the report stays empty as for JNI.waitFor().
+            while (write(entry->fd, &report, sizeof(report)) < 0 && errno == EINTR);
+            close(entry->fd);
+            *entry = reaper_children.entries[--reaper_children.count];
+        }
+        pthread_mutex_unlock(&reaper_mutex);
+    }
+    return NULL;
+}
+
+static void start_reaper(void)
+{
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) != 0) return;
+    fcntl(fds[1], F_SETFL, O_NONBLOCK);
+    pthread_t thread;
+    reaper_wake_fds[0] = fds[0];
+    reaper_wake_fds[1] = fds[1];
+    if (pthread_create(&thread, NULL, reaper_main, NULL) != 0) {
+        close(fds[0]);
+        close(fds[1]);
+        reaper_wake_fds[0] = reaper_wake_fds[1] = -1;
+        return;
+    }
+    pthread_detach(thread);
+
+    struct sigaction action = { .sa_sigaction = reaper_sigchld_handler, .sa_flags = SA_SIGINFO | SA_RESTART };
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGCHLD, &action, &reaper_previous_action);
+}
+
+/** Give a child of this process an exit watch. Returns -1 if none could be set up, leaving it to waitpid(). */
+static int exit_watch_add_child(pid_t pid)
+{
+    int added;
+#ifdef __NR_pidfd_open
+    pthread_once(&pidfd_probe_once, probe_pidfd);
+    if (pidfd_supported) {
+        int pidfd = (int) syscall(__NR_pidfd_open, pid, 0);
+        if (pidfd >= 0) {
+            pthread_mutex_lock(&exit_fds_mutex);
+            added = pid_fd_table_add(&exit_pidfds, pid, pidfd);
+            pthread_mutex_unlock(&exit_fds_mutex);
+            if (added == 0) return 0;
+            close(pidfd);
+            return -1;
+        }
+    }
+#endif
+
+    pthread_once(&reaper_once, start_reaper);
+    int exit_pipe[2];
+    if (reaper_wake_fds[1] < 0 || pipe2(exit_pipe, O_CLOEXEC) != 0) return -1;
+    pthread_mutex_lock(&exit_fds_mutex);
+    added = pid_fd_table_add(&exit_fds, pid, exit_pipe[0]);
+    pthread_mutex_unlock(&exit_fds_mutex);
+    if (added == 0) {
+        pthread_mutex_lock(&reaper_mutex);
+        added = pid_fd_table_add(&reaper_children, pid, exit_pipe[1]);
+        pthread_mutex_unlock(&reaper_mutex);
+        if (added != 0) {
+            pthread_mutex_lock(&exit_fds_mutex);
+            pid_fd_table_remove(&exit_fds, pid);
+            pthread_mutex_unlock(&exit_fds_mutex);
+        }
+    }
+    if (added != 0) {
+        close(exit_pipe[0]);
+        close(exit_pipe[1]);
+        return -1;
+    }
+    // The child may have exited before it was added.
+    reaper_wake();
+    return 0;
+}
+
+/** Return the fd of the exit watch of pid, without releasing it, or -1 if the process has none. */
+static int exit_watch_find(pid_t pid)
+{
+    pthread_mutex_lock(&exit_fds_mutex);
+    int fd = pid_fd_table_find(&exit_fds, pid);
+    if (fd < 0) fd = pid_fd_table_find(&exit_pidfds, pid);
+    pthread_mutex_unlock(&exit_fds_mutex);
+    return fd;
+}
+
+/**
+ * Add the fd of the exit watch of pid to an epoll instance, or remove it, under the lock for the fd not to be collected
+ * and closed meanwhile. Returns -1 if the process has no exit watch.
+ */
+static int exit_watch_epoll_ctl(pid_t pid, int epoll_fd, int op, struct epoll_event* event)
+{
+    pthread_mutex_lock(&exit_fds_mutex);
+    int fd = pid_fd_table_find(&exit_fds, pid);
+    if (fd < 0) fd = pid_fd_table_find(&exit_pidfds, pid);
+    int result = (fd < 0) ? -1 : epoll_ctl(epoll_fd, op, fd, event);
+    pthread_mutex_unlock(&exit_fds_mutex);
+    return result;
+}
+
+/**
+ * Return a duplicate of the fd of the exit watch of pid, for the caller to poll and close, -1 if the process has none or
+ * -2 if it could not be duplicated. Duplicated under the lock, as once it is released another thread may collect the
+ * watch and close its fd, which could then be reused for anything.
+ */
+static int exit_watch_dup(pid_t pid)
+{
+    pthread_mutex_lock(&exit_fds_mutex);
+    int fd = pid_fd_table_find(&exit_fds, pid);
+    if (fd < 0) fd = pid_fd_table_find(&exit_pidfds, pid);
+    if (fd >= 0 && (fd = fcntl(fd, F_DUPFD_CLOEXEC, 0)) < 0) fd = -2;
+    pthread_mutex_unlock(&exit_fds_mutex);
+    return fd;
+}
+
+/**
+ * Collect the exit report of pid once its exit watch has become readable, and release the watch. Returns -1 if the
+ * process has no exit watch.
+ */
+static int exit_watch_collect(pid_t pid, struct exit_report* report)
+{
+    pthread_mutex_lock(&exit_fds_mutex);
+    int is_pidfd = 0;
+    int fd = pid_fd_table_remove(&exit_fds, pid);
+    if (fd < 0 && (fd = pid_fd_table_remove(&exit_pidfds, pid)) >= 0) is_pidfd = 1;
+    pthread_mutex_unlock(&exit_fds_mutex);
+    if (fd < 0) return -1;
+
+    memset(report, 0, sizeof(*report));
+    if (is_pidfd) {
+        while (wait4(pid, &report->status, 0, &report->usage) < 0 && errno == EINTR);
+    } else {
+        // Stays empty if the spawn helper died first.
+        while (read(fd, report, sizeof(*report)) < 0 && errno == EINTR);
+    }
+    close(fd);
+    return 0;
+}
+
+static int64_t monotonic_millis(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t) now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+/**
+ * Wait up to timeout_millis, or without limit if negative, for pid to exit. Returns 1 with *report filled in if it has,
+ * 0 if it is still running, or -1 if its exit cannot be collected here, as when it was already collected by the reactor
+ * or another waiter.
+ */
+static int exit_watch_wait(pid_t pid, int timeout_millis, struct exit_report* report)
+{
+    int64_t deadline = monotonic_millis() + timeout_millis;
+    int fd = exit_watch_dup(pid);
+    memset(report, 0, sizeof(*report));
+    if (fd == -2) return -1;
+    if (fd < 0) {
+        // Without a watch the process can only be waited for by polling wait4().
+        while (1) {
+            pid_t result = wait4(pid, &report->status, timeout_millis < 0 ? 0 : WNOHANG, &report->usage);
+            if (result < 0 && errno == EINTR) continue;
+            // Not a child (any more), as when its watch was collected since.
+            if (result < 0) return -1;
+            if (result != 0) return 1;
+            int64_t remaining = deadline - monotonic_millis();
+            if (remaining <= 0) return 0;
+            struct timespec pause = { 0, (remaining < 10 ? remaining : 10) * 1000000 };
+            nanosleep(&pause, NULL);
+        }
+    }
+
+    struct pollfd pfd = { .fd = fd, .events = POLLIN };
+    while (1) {
+        int remaining = (timeout_millis < 0) ? -1 : (int) (deadline - monotonic_millis());
+        if (timeout_millis >= 0 && remaining < 0) remaining = 0;
+        int ready = poll(&pfd, 1, remaining);
+        if (ready < 0 && errno == EINTR) continue;
+        close(fd);
+        if (ready == 0) return 0;
+        break;
+    }
+    return (exit_watch_collect(pid, report) == 0) ? 1 : -1;
+}
+
+/**
+ * Start count sessions, through the spawn helper if possible. For each session ptms[i] is set to the pseudoterminal
+ * master and pids[i] to the pid, or both are set to -1 and errors[i] describes why the session could not be started.
+ */
+static void create_subprocesses(struct subprocess_spec const* specs, int count, int* ptms, int* pids, char const** errors)
+{
+    spawn_helper_create_subprocesses(specs, count, ptms, pids);
+
+    for (int i = 0; i < count; i++) {
+        if (ptms[i] >= 0) continue;
+        pids[i] = -1;
+        if (ptms[i] != SPAWN_HELPER_UNAVAILABLE) {
+            errors[i] = (ptms[i] == SPAWN_HELPER_PTY_FAILED) ? "Cannot open /dev/ptmx" : "Fork failed";
+            ptms[i] = -1;
+            continue;
+        }
+
+        // No spawn helper available, spawn from this process.
+        struct subprocess_spec const* spec = &specs[i];
+        char devname[64];
+        int ptm = open_pty_master(devname, sizeof(devname), spec->rows, spec->columns, spec->cell_width, spec->cell_height, &errors[i]);
+        if (ptm < 0) continue;
+
+        pid_t pid = spawn_on_pty(ptm, devname, spec->cmd, spec->cwd, spec->argv, spec->envp);
+        if (pid < 0) {
+            close(ptm);
+            errors[i] = "Fork failed";
+            continue;
+        }
+        exit_watch_add_child(pid);
+        ptms[i] = ptm;
+        pids[i] = (int) pid;
+    }
+}
+
+static void free_string_array(char** array)
+{
+    if (!array) return;
+    for (char** tmp = array; *tmp; ++tmp) free(*tmp);
+    free(array);
+}
+
+/**
+ * Copy a java String[] into a NULL terminated array of malloc()ed strings, or NULL if it is null or empty. Returns -1
+ * with an exception thrown on failure.
+ */
+static int java_string_array_to_c(JNIEnv* env, jobjectArray java_array, char const* name, char*** pArray)
+{
+    *pArray = NULL;
+    jsize size = java_array ? (*env)->GetArrayLength(env, java_array) : 0;
+    if (size == 0) return 0;
+
+    char** array = (char**) calloc((size_t) size + 1, sizeof(char*));
+    if (!array) {
+        char message[64];
+        snprintf(message, sizeof(message), "Couldn't allocate %s array", name);
+        return throw_runtime_exception(env, message);
+    }
+    for (int i = 0; i < size; ++i) {
+        jstring java_string = (jstring) (*env)->GetObjectArrayElement(env, java_array, i);
+        char const* utf8 = java_string ? (*env)->GetStringUTFChars(env, java_string, NULL) : NULL;
+        if (utf8) array[i] = strdup(utf8);
+        if (utf8) (*env)->ReleaseStringUTFChars(env, java_string, utf8);
+        (*env)->DeleteLocalRef(env, java_string);
+        if (!array[i]) {
+            free_string_array(array);
+            char message[64];
+            snprintf(message, sizeof(message), "GetStringUTFChars() failed for %s", name);
+            return throw_runtime_exception(env, message);
+        }
+    }
+    *pArray = array;
+    return 0;
+}
+
 JNIEXPORT jint JNICALL Java_com_termux_terminal_JNI_createSubprocess(
         JNIEnv* env,
         jclass TERMUX_UNUSED(clazz),
@@ -127,53 +1122,304 @@ JNIEXPORT jint JNICALL Java_com_termux_terminal_JNI_createSubprocess(
         jint cell_width,
         jint cell_height)
 {
-    jsize size = args ? (*env)->GetArrayLength(env, args) : 0;
-    char** argv = NULL;
-    if (size > 0) {
-        argv = (char**) malloc((size + 1) * sizeof(char*));
-        if (!argv) return throw_runtime_exception(env, "Couldn't allocate argv array");
-        for (int i = 0; i < size; ++i) {
-            jstring arg_java_string = (jstring) (*env)->GetObjectArrayElement(env, args, i);
-            char const* arg_utf8 = (*env)->GetStringUTFChars(env, arg_java_string, NULL);
-            if (!arg_utf8) return throw_runtime_exception(env, "GetStringUTFChars() failed for argv");
-            argv[i] = strdup(arg_utf8);
-            (*env)->ReleaseStringUTFChars(env, arg_java_string, arg_utf8);
-        }
-        argv[size] = NULL;
-    }
-
-    size = envVars ? (*env)->GetArrayLength(env, envVars) : 0;
-    char** envp = NULL;
-    if (size > 0) {
-        envp = (char**) malloc((size + 1) * sizeof(char *));
-        if (!envp) return throw_runtime_exception(env, "malloc() for envp array failed");
-        for (int i = 0; i < size; ++i) {
-            jstring env_java_string = (jstring) (*env)->GetObjectArrayElement(env, envVars, i);
-            char const* env_utf8 = (*env)->GetStringUTFChars(env, env_java_string, 0);
-            if (!env_utf8) return throw_runtime_exception(env, "GetStringUTFChars() failed for env");
-            envp[i] = strdup(env_utf8);
-            (*env)->ReleaseStringUTFChars(env, env_java_string, env_utf8);
-        }
-        envp[size] = NULL;
-    }
-
-    int procId = 0;
+    char** argv;
+    if (java_string_array_to_c(env, args, "argv", &argv) != 0) return -1;
+    char** envp;
+    if (java_string_array_to_c(env, envVars, "env", &envp) != 0) {
+        free_string_array(argv);
+        return -1;
+    }
+
     char const* cmd_cwd = (*env)->GetStringUTFChars(env, cwd, NULL);
     char const* cmd_utf8 = (*env)->GetStringUTFChars(env, cmd, NULL);
-    int ptm = create_subprocess(env, cmd_utf8, cmd_cwd, argv, envp, &procId, rows, columns, cell_width, cell_height);
-    
+    struct subprocess_spec spec = { .cmd = cmd_utf8, .cwd = cmd_cwd, .argv = argv, .envp = envp,
+        .rows = rows, .columns = columns, .cell_width = cell_width, .cell_height = cell_height };
+    int ptm, procId;
+    char const* error = NULL;
+    create_subprocesses(&spec, 1, &ptm, &procId, &error);
+
     (*env)->ReleaseStringUTFChars(env, cmd, cmd_utf8);
     (*env)->ReleaseStringUTFChars(env, cwd, cmd_cwd);
+    free_string_array(argv);
+    free_string_array(envp);
+
+    if (ptm < 0) return throw_runtime_exception(env, error);
+
+    int* pProcId = (int*) (*env)->GetPrimitiveArrayCritical(env, processIdArray, NULL);
+    if (!pProcId) return throw_runtime_exception(env, "JNI call GetPrimitiveArrayCritical(processIdArray, &isCopy) failed");
+
+    *pProcId = procId;
+    (*env)->ReleasePrimitiveArrayCritical(env, processIdArray, pProcId, 0);
+
+    return ptm;
+}
+
+JNIEXPORT jintArray JNICALL Java_com_termux_terminal_JNI_createSubprocesses(
+        JNIEnv* env,
+        jclass TERMUX_UNUSED(clazz),
+        jobjectArray cmds,
+        jobjectArray cwds,
+        jobjectArray argsArray,
+        jobjectArray envVarsArray,
+        jintArray processIdArray,
+        jint rows,
+        jint columns,
+        jint cell_width,
+        jint cell_height)
+{
+    jsize count = (*env)->GetArrayLength(env, cmds);
+    struct subprocess_spec* specs = calloc((size_t) count + 1, sizeof(struct subprocess_spec));
+    int* ptms = calloc((size_t) count + 1, sizeof(int));
+    int* pids = calloc((size_t) count + 1, sizeof(int));
+    char const** errors = calloc((size_t) count + 1, sizeof(char*));
+    jintArray result = NULL;
+    jobject previous_env_vars = NULL;
+    if (!specs || !ptms || !pids || !errors) {
+        throw_runtime_exception(env, "malloc() for createSubprocesses() failed");
+        goto cleanup;
+    }
+
+    for (jsize i = 0; i < count; i++) {
+        struct subprocess_spec* spec = &specs[i];
+        spec->rows = rows;
+        spec->columns = columns;
+        spec->cell_width = cell_width;
+        spec->cell_height = cell_height;
+
+        jstring cmd = (jstring) (*env)->GetObjectArrayElement(env, cmds, i);
+        jstring cwd = (jstring) (*env)->GetObjectArrayElement(env, cwds, i);
+        char const* cmd_utf8 = (*env)->GetStringUTFChars(env, cmd, NULL);
+        char const* cwd_utf8 = (*env)->GetStringUTFChars(env, cwd, NULL);
+        spec->cmd = cmd_utf8 ? strdup(cmd_utf8) : NULL;
+        spec->cwd = cwd_utf8 ? strdup(cwd_utf8) : NULL;
+        if (cmd_utf8) (*env)->ReleaseStringUTFChars(env, cmd, cmd_utf8);
+        if (cwd_utf8) (*env)->ReleaseStringUTFChars(env, cwd, cwd_utf8);
+        (*env)->DeleteLocalRef(env, cmd);
+        (*env)->DeleteLocalRef(env, cwd);
+        if (!spec->cmd || !spec->cwd) {
+            throw_runtime_exception(env, "GetStringUTFChars() failed for cmd or cwd");
+            goto cleanup;
+        }
+
+        jobjectArray args = (jobjectArray) (*env)->GetObjectArrayElement(env, argsArray, i);
+        char** argv;
+        int failed = java_string_array_to_c(env, args, "argv", &argv);
+        (*env)->DeleteLocalRef(env, args);
+        spec->argv = argv;
+        if (failed) goto cleanup;
+
+        // Sessions restored together usually share one environment, so only convert it once.
+        jobjectArray env_vars = (jobjectArray) (*env)->GetObjectArrayElement(env, envVarsArray, i);
+        if (i > 0 && (*env)->IsSameObject(env, env_vars, previous_env_vars)) {
+            spec->envp = specs[i - 1].envp;
+            (*env)->DeleteLocalRef(env, env_vars);
+        } else {
+            char** envp;
+            failed = java_string_array_to_c(env, env_vars, "env", &envp);
+            spec->envp = envp;
+            if (previous_env_vars) (*env)->DeleteLocalRef(env, previous_env_vars);
+            previous_env_vars = env_vars;
+            if (failed) goto cleanup;
+        }
+    }
+
+    create_subprocesses(specs, count, ptms, pids, errors);
+
+    (*env)->SetIntArrayRegion(env, processIdArray, 0, count, pids);
+    result = (*env)->NewIntArray(env, count);
+    if (result) (*env)->SetIntArrayRegion(env, result, 0, count, ptms);
+
+cleanup:
+    for (jsize i = 0; specs && i < count; i++) {
+        free((char*) specs[i].cmd);
+        free((char*) specs[i].cwd);
+        free_string_array((char**) specs[i].argv);
+        if (i == 0 || specs[i].envp != specs[i - 1].envp) free_string_array((char**) specs[i].envp);
+    }
+    free(specs);
+    free(ptms);
+    free(pids);
+    free(errors);
+    return result;
+}
+
+/*
+ * Spawn templates hold a command which is launched over and over in native memory: cmd, cwd, argv and envp are
+ * encoded once, both as the arrays handed to execve() and as the strings of a spawn helper request. A launch from a
+ * template then only has to marshal its optional argv override. Templates are referenced from java by id.
+ */
+struct spawn_template {
+    char const* cmd;
+    char const* cwd;
+    /** NULL terminated arrays pointing into the strings, or NULL if empty. */
+    char** argv;
+    char** envp;
+    /** The strings as encoded for the spawn helper: cmd and cwd, argv and envp. */
+    struct iovec sections[3];
+    /** One for the table of templates and one for each launch in progress. Guarded by spawn_templates_mutex. */
+    int references;
+    // Followed in the same allocation by the argv and envp arrays and then the strings.
+};
+
+/** Templates indexed by id - 1, with NULL for free slots. Guarded by spawn_templates_mutex. */
+static struct spawn_template** spawn_templates;
+static int spawn_templates_capacity;
+static pthread_mutex_t spawn_templates_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static size_t string_array_length(char* const* strings)
+{
+    size_t count = 0;
+    if (strings) while (strings[count]) count++;
+    return count;
+}
+
+/** Encode a template into a single allocation, to be released with free(). */
+static struct spawn_template* encode_spawn_template(char const* cmd, char const* cwd, char* const* argv, char* const* envp)
+{
+    size_t argc = string_array_length(argv);
+    size_t envc = string_array_length(envp);
+    size_t cmd_cwd_length = strlen(cmd) + 1 + strlen(cwd) + 1;
+    size_t argv_length = encoded_strings_length(argv);
+    size_t envp_length = encoded_strings_length(envp);
+
+    size_t pointers = (argc + 1) + (envc + 1);
+    struct spawn_template* template = malloc(sizeof(struct spawn_template) + pointers * sizeof(char*) + cmd_cwd_length + argv_length + envp_length);
+    if (!template) return NULL;
+
+    char** arrays = (char**) (template + 1);
+    char* strings = (char*) (arrays + pointers);
+    template->cmd = strings;
+    template->cwd = stpcpy(strings, cmd) + 1;
+    char* position = stpcpy((char*) template->cwd, cwd) + 1;
+
+    template->argv = argc ? arrays : NULL;
+    for (size_t i = 0; i < argc; i++) {
+        arrays[i] = position;
+        position = stpcpy(position, argv[i]) + 1;
+    }
+    arrays[argc] = NULL;
+
+    template->envp = envc ? arrays + argc + 1 : NULL;
+    for (size_t i = 0; i < envc; i++) {
+        arrays[argc + 1 + i] = position;
+        position = stpcpy(position, envp[i]) + 1;
+    }
+    arrays[argc + 1 + envc] = NULL;
+
+    template->sections[0] = (struct iovec) { strings, cmd_cwd_length };
+    template->sections[1] = (struct iovec) { strings + cmd_cwd_length, argv_length };
+    template->sections[2] = (struct iovec) { strings + cmd_cwd_length + argv_length, envp_length };
+    template->references = 1;
+    return template;
+}
+
+/** Drop a reference to a template, freeing it with the last one. Called with spawn_templates_mutex held. */
+static void release_spawn_template(struct spawn_template* template)
+{
+    if (--template->references == 0) free(template);
+}
 
-    if (argv) {
-        for (char** tmp = argv; *tmp; ++tmp) free(*tmp);
-        free(argv);
+/** Register a template, returning its id or -1 if out of memory. */
+static int add_spawn_template(struct spawn_template* template)
+{
+    pthread_mutex_lock(&spawn_templates_mutex);
+    int index = 0;
+    while (index < spawn_templates_capacity && spawn_templates[index]) index++;
+    if (index == spawn_templates_capacity) {
+        int new_capacity = spawn_templates_capacity ? spawn_templates_capacity * 2 : 8;
+        struct spawn_template** new_templates = realloc(spawn_templates, (size_t) new_capacity * sizeof(struct spawn_template*));
+        if (!new_templates) {
+            pthread_mutex_unlock(&spawn_templates_mutex);
+            return -1;
+        }
+        memset(new_templates + spawn_templates_capacity, 0, (size_t) (new_capacity - spawn_templates_capacity) * sizeof(struct spawn_template*));
+        spawn_templates = new_templates;
+        spawn_templates_capacity = new_capacity;
     }
-    if (envp) {
-        for (char** tmp = envp; *tmp; ++tmp) free(*tmp);
-        free(envp);
+    spawn_templates[index] = template;
+    pthread_mutex_unlock(&spawn_templates_mutex);
+    return index + 1;
+}
+
+JNIEXPORT jint JNICALL Java_com_termux_terminal_JNI_createSpawnTemplate(
+        JNIEnv* env,
+        jclass TERMUX_UNUSED(clazz),
+        jstring cmd,
+        jstring cwd,
+        jobjectArray args,
+        jobjectArray envVars)
+{
+    char** argv;
+    if (java_string_array_to_c(env, args, "argv", &argv) != 0) return -1;
+    char** envp;
+    if (java_string_array_to_c(env, envVars, "env", &envp) != 0) {
+        free_string_array(argv);
+        return -1;
     }
 
+    char const* cwd_utf8 = (*env)->GetStringUTFChars(env, cwd, NULL);
+    char const* cmd_utf8 = (*env)->GetStringUTFChars(env, cmd, NULL);
+    struct spawn_template* template = encode_spawn_template(cmd_utf8, cwd_utf8, argv, envp);
+    (*env)->ReleaseStringUTFChars(env, cmd, cmd_utf8);
+    (*env)->ReleaseStringUTFChars(env, cwd, cwd_utf8);
+    free_string_array(argv);
+    free_string_array(envp);
+
+    int id = template ? add_spawn_template(template) : -1;
+    if (id < 0) {
+        free(template);
+        return throw_runtime_exception(env, "malloc() for spawn template failed");
+    }
+    return id;
+}
+
+JNIEXPORT jint JNICALL Java_com_termux_terminal_JNI_createSubprocessFromTemplate(
+        JNIEnv* env,
+        jclass TERMUX_UNUSED(clazz),
+        jint templateId,
+        jobjectArray args,
+        jintArray processIdArray,
+        jint rows,
+        jint columns,
+        jint cell_width,
+        jint cell_height)
+{
+    char** argv_override = NULL;
+    if (args && java_string_array_to_c(env, args, "argv", &argv_override) != 0) return -1;
+
+    // Only encoded when overriding, the template has the rest.
+    size_t override_length = encoded_strings_length(argv_override);
+    char* override_strings = override_length ? malloc(override_length) : NULL;
+    if (override_length && !override_strings) {
+        free_string_array(argv_override);
+        return throw_runtime_exception(env, "malloc() for argv override failed");
+    }
+    encode_strings(override_strings, argv_override);
+
+    int ptm = -1, procId = -1;
+    char const* error = "Invalid spawn template";
+    // The reference keeps the template from being freed while in use, without holding the lock over the launch.
+    pthread_mutex_lock(&spawn_templates_mutex);
+    struct spawn_template* template = (templateId > 0 && templateId <= spawn_templates_capacity) ? spawn_templates[templateId - 1] : NULL;
+    if (template) template->references++;
+    pthread_mutex_unlock(&spawn_templates_mutex);
+    if (template) {
+        struct iovec sections[3] = { template->sections[0], template->sections[1], template->sections[2] };
+        if (args) sections[1] = (struct iovec) { override_strings, override_length };
+        struct subprocess_spec spec = { .cmd = template->cmd, .cwd = template->cwd, .argv = args ? argv_override : template->argv,
+            .envp = template->envp, .rows = rows, .columns = columns, .cell_width = cell_width, .cell_height = cell_height,
+            .encoded = sections, .encoded_count = 3 };
+        create_subprocesses(&spec, 1, &ptm, &procId, &error);
+
+        pthread_mutex_lock(&spawn_templates_mutex);
+        release_spawn_template(template);
+        pthread_mutex_unlock(&spawn_templates_mutex);
+    }
+    free(override_strings);
+    free_string_array(argv_override);
+
+    if (ptm < 0) return throw_runtime_exception(env, error);
+
     int* pProcId = (int*) (*env)->GetPrimitiveArrayCritical(env, processIdArray, NULL);
     if (!pProcId) return throw_runtime_exception(env, "JNI call GetPrimitiveArrayCritical(processIdArray, &isCopy) failed");
 
@@ -183,6 +1429,21 @@ JNIEXPORT jint JNICALL Java_com_termux_terminal_JNI_createSubprocess(
     return ptm;
 }
 
+JNIEXPORT void JNICALL Java_com_termux_terminal_JNI_destroySpawnTemplate(JNIEnv* TERMUX_UNUSED(env), jclass TERMUX_UNUSED(clazz), jint templateId)
+{
+    pthread_mutex_lock(&spawn_templates_mutex);
+    if (templateId > 0 && templateId <= spawn_templates_capacity && spawn_templates[templateId - 1]) {
+        release_spawn_template(spawn_templates[templateId - 1]);
+        spawn_templates[templateId - 1] = NULL;
+    }
+    pthread_mutex_unlock(&spawn_templates_mutex);
+}
+
+JNIEXPORT void JNICALL Java_com_termux_terminal_JNI_startSpawnHelper(JNIEnv* TERMUX_UNUSED(env), jclass TERMUX_UNUSED(clazz))
+{
+    pthread_once(&spawn_helper_once, start_spawn_helper);
+}
+
 JNIEXPORT void JNICALL Java_com_termux_terminal_JNI_setPtyWindowSize(JNIEnv* TERMUX_UNUSED(env), jclass TERMUX_UNUSED(clazz), jint fd, jint rows, jint cols, jint cell_width, jint cell_height)
 {
     struct winsize sz = { .ws_row = (unsigned short) rows, .ws_col = (unsigned short) cols, .ws_xpixel = (unsigned short) (cols * cell_width), .ws_ypixel = (unsigned short) (rows * cell_height) };
@@ -199,10 +1460,9 @@ JNIEXPORT void JNICALL Java_com_termux_terminal_JNI_setPtyUTF8Mode(JNIEnv* TERMU
     }
 }
 
-JNIEXPORT jint JNICALL Java_com_termux_terminal_JNI_waitFor(JNIEnv* TERMUX_UNUSED(env), jclass TERMUX_UNUSED(clazz), jint pid)
+/** The exit code as returned by JNI.waitFor(): the exit status, or the signal which killed the process negated. */
+static int exit_code_from_status(int status)
 {
-    int status;
-    waitpid(pid, &status, 0);
     if (WIFEXITED(status)) {
         return WEXITSTATUS(status);
     } else if (WIFSIGNALED(status)) {
@@ -213,7 +1473,246 @@ JNIEXPORT jint JNICALL Java_com_termux_terminal_JNI_waitFor(JNIEnv* TERMUX_UNUSE
     }
 }
 
+/** The number of longs a resource usage is reported in, see ProcessResourceUsage. */
+#define RESOURCE_USAGE_LONGS 7
+
+static void resource_usage_to_longs(struct rusage const* usage, jlong* longs)
+{
+    longs[0] = (jlong) usage->ru_utime.tv_sec * 1000000 + usage->ru_utime.tv_usec;
+    longs[1] = (jlong) usage->ru_stime.tv_sec * 1000000 + usage->ru_stime.tv_usec;
+    longs[2] = usage->ru_maxrss;
+    longs[3] = usage->ru_minflt;
+    longs[4] = usage->ru_majflt;
+    longs[5] = usage->ru_nvcsw;
+    longs[6] = usage->ru_nivcsw;
+}
+
+JNIEXPORT jint JNICALL Java_com_termux_terminal_JNI_waitFor(JNIEnv* TERMUX_UNUSED(env), jclass TERMUX_UNUSED(clazz), jint pid)
+{
+    struct exit_report report;
+    // As with waitpid() before, 0 if the exit cannot be collected here.
+    if (exit_watch_wait(pid, -1, &report) < 0) return 0;
+    return exit_code_from_status(report.status);
+}
+
+JNIEXPORT jint JNICALL Java_com_termux_terminal_JNI_waitForExit(JNIEnv* env, jclass TERMUX_UNUSED(clazz), jint pid, jint timeoutMillis, jintArray exitCode, jlongArray resourceUsage)
+{
+    struct exit_report report;
+    int exited = exit_watch_wait(pid, timeoutMillis, &report);
+    if (exited != 1) return exited;
+    jint code = exit_code_from_status(report.status);
+    (*env)->SetIntArrayRegion(env, exitCode, 0, 1, &code);
+    if (resourceUsage) {
+        jlong longs[RESOURCE_USAGE_LONGS];
+        resource_usage_to_longs(&report.usage, longs);
+        (*env)->SetLongArrayRegion(env, resourceUsage, 0, RESOURCE_USAGE_LONGS, longs);
+    }
+    return 1;
+}
+
+JNIEXPORT jint JNICALL Java_com_termux_terminal_JNI_getExitFd(JNIEnv* TERMUX_UNUSED(env), jclass TERMUX_UNUSED(clazz), jint pid)
+{
+    return exit_watch_find(pid);
+}
+
 JNIEXPORT void JNICALL Java_com_termux_terminal_JNI_close(JNIEnv* TERMUX_UNUSED(env), jclass TERMUX_UNUSED(clazz), jint fileDescriptor)
 {
     close(fileDescriptor);
 }
+
+/*
+ * The I/O reactor: a single epoll instance which all pty masters, and the exit pipes of their processes, are registered
+ * with, so that one thread can serve every session. The thread calls JNI.reactorPoll(), which waits for readiness and
+ * returns everything that happened as a batch of events, and then reads ready ptys with JNI.readPty() straight into
+ * the DirectByteRing of their session. Sources are tagged in the epoll data with the java token of
+ * their session and their kind, so no lookup table is needed here.
+ */
+
+/** Kinds of reactor sources, stored in the low bits of the epoll data. */
+#define REACTOR_SOURCE_PTY 0
+#define REACTOR_SOURCE_EXIT 1
+#define REACTOR_SOURCE_WAKE 2
+
+/** Event types reported to java, see TerminalReactor. */
+#define REACTOR_EVENT_INPUT 1
+#define REACTOR_EVENT_OUTPUT_READY 2
+#define REACTOR_EVENT_EXIT 3
+
+/** Ints per event in the events array: type, token, exit code, index of the resource usage. */
+#define REACTOR_EVENT_INTS 4
+
+static int reactor_epoll_fd = -1;
+static int reactor_wake_fd = -1;
+static pthread_once_t reactor_once = PTHREAD_ONCE_INIT;
+
+static void reactor_init(void)
+{
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd < 0) return;
+    int wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    struct epoll_event event = { .events = EPOLLIN, .data.u64 = REACTOR_SOURCE_WAKE };
+    if (wake_fd < 0 || epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wake_fd, &event) != 0) {
+        if (wake_fd >= 0) close(wake_fd);
+        close(epoll_fd);
+        return;
+    }
+    reactor_wake_fd = wake_fd;
+    reactor_epoll_fd = epoll_fd;
+}
+
+/** The epoll data of a source: its token, its fd or for exit sources its pid, and its kind. */
+static uint64_t reactor_source(int token, int id, int kind)
+{
+    return ((uint64_t) (uint32_t) token << 32) | ((uint64_t) (uint32_t) id << 2) | (uint64_t) kind;
+}
+
+/**
+ * Register a pty master, made non-blocking, and the exit watch of its process if it has one.
+ *
+ * @return whether the exit of the process will be reported by the reactor. If not, JNI.waitFor() has to be used.
+ */
+JNIEXPORT jboolean JNICALL Java_com_termux_terminal_JNI_reactorAdd(JNIEnv* env, jclass TERMUX_UNUSED(clazz), jint fd, jint pid, jint token)
+{
+    pthread_once(&reactor_once, reactor_init);
+    if (reactor_epoll_fd < 0) return throw_runtime_exception(env, "Creating the reactor epoll instance failed") != 0;
+
+    int flags = fcntl(fd, F_GETFL);
+    struct epoll_event event = { .events = EPOLLIN, .data.u64 = reactor_source(token, fd, REACTOR_SOURCE_PTY) };
+    if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) != 0 || epoll_ctl(reactor_epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0) {
+        return throw_runtime_exception(env, "Adding pty to the reactor failed") != 0;
+    }
+
+    event = (struct epoll_event) { .events = EPOLLIN, .data.u64 = reactor_source(token, pid, REACTOR_SOURCE_EXIT) };
+    return exit_watch_epoll_ctl(pid, reactor_epoll_fd, EPOLL_CTL_ADD, &event) == 0;
+}
+
+/**
+ * Change which of input and output readiness of a registered pty is waited for. With neither the pty is taken out of
+ * the epoll instance, as a hangup would otherwise keep being reported.
+ */
+JNIEXPORT void JNICALL Java_com_termux_terminal_JNI_reactorSetInterest(JNIEnv* TERMUX_UNUSED(env), jclass TERMUX_UNUSED(clazz), jint fd, jint token, jboolean input, jboolean output)
+{
+    if (!input && !output) {
+        epoll_ctl(reactor_epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+        return;
+    }
+    struct epoll_event event = { .events = (input ? EPOLLIN : 0) | (output ? EPOLLOUT : 0), .data.u64 = reactor_source(token, fd, REACTOR_SOURCE_PTY) };
+    if (epoll_ctl(reactor_epoll_fd, EPOLL_CTL_MOD, fd, &event) != 0 && errno == ENOENT) {
+        epoll_ctl(reactor_epoll_fd, EPOLL_CTL_ADD, fd, &event);
+    }
+}
+
+/** Unregister a pty from the reactor. Must be called before it is closed. */
+JNIEXPORT void JNICALL Java_com_termux_terminal_JNI_reactorRemove(JNIEnv* TERMUX_UNUSED(env), jclass TERMUX_UNUSED(clazz), jint fd)
+{
+    epoll_ctl(reactor_epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+}
+
+/** Make a JNI.reactorPoll() in progress, or the next one, return. */
+JNIEXPORT void JNICALL Java_com_termux_terminal_JNI_reactorWake(JNIEnv* TERMUX_UNUSED(env), jclass TERMUX_UNUSED(clazz))
+{
+    pthread_once(&reactor_once, reactor_init);
+    uint64_t one = 1;
+    while (write(reactor_wake_fd, &one, sizeof(one)) < 0 && errno == EINTR);
+}
+
+/**
+ * Wait until a registered source is ready, JNI.reactorWake() is called or timeoutMillis has passed, if not negative,
+ * and report what happened.
+ *
+ * @return the number of events written to the events array, REACTOR_EVENT_INTS ints each.
+ */
+JNIEXPORT jint JNICALL Java_com_termux_terminal_JNI_reactorPoll(JNIEnv* env, jclass TERMUX_UNUSED(clazz), jintArray events, jlongArray resourceUsage, jint timeoutMillis)
+{
+    pthread_once(&reactor_once, reactor_init);
+    if (reactor_epoll_fd < 0) return throw_runtime_exception(env, "Creating the reactor epoll instance failed");
+
+    // A pty may report both output readiness and input, so room for two events per ready source is needed.
+    int max_events = (*env)->GetArrayLength(env, events) / (2 * REACTOR_EVENT_INTS);
+    if (max_events > 64) max_events = 64;
+    // And each may be an exit, with its resource usage.
+    int max_exits = (*env)->GetArrayLength(env, resourceUsage) / RESOURCE_USAGE_LONGS;
+    if (max_events > max_exits) max_events = max_exits;
+    if (max_events < 1) return throw_runtime_exception(env, "Too small events array");
+    struct epoll_event ready[64];
+    int ready_count;
+    while ((ready_count = epoll_wait(reactor_epoll_fd, ready, max_events, timeoutMillis)) < 0 && errno == EINTR);
+    if (ready_count < 0) return throw_runtime_exception(env, "epoll_wait() failed");
+
+    jint reported[64 * 2 * REACTOR_EVENT_INTS];
+    int event_count = 0;
+    jlong usage_longs[64 * RESOURCE_USAGE_LONGS];
+    int exit_count = 0;
+
+    for (int i = 0; i < ready_count; i++) {
+        uint64_t source = ready[i].data.u64;
+        int kind = (int) (source & 3);
+        // The pid for exit sources.
+        int fd = (int) ((uint32_t) source >> 2);
+        jint token = (jint) (source >> 32);
+        jint* event = reported + event_count * REACTOR_EVENT_INTS;
+
+        if (kind == REACTOR_SOURCE_WAKE) {
+            uint64_t count;
+            while (read(reactor_wake_fd, &count, sizeof(count)) < 0 && errno == EINTR);
+        } else if (kind == REACTOR_SOURCE_EXIT) {
+            pid_t pid = (pid_t) fd;
+            exit_watch_epoll_ctl(pid, reactor_epoll_fd, EPOLL_CTL_DEL, NULL);
+            struct exit_report report;
+            // Already collected if waited for elsewhere.
+            if (exit_watch_collect(pid, &report) != 0) continue;
+            resource_usage_to_longs(&report.usage, usage_longs + exit_count * RESOURCE_USAGE_LONGS);
+            event[0] = REACTOR_EVENT_EXIT;
+            event[1] = token;
+            event[2] = exit_code_from_status(report.status);
+            event[3] = exit_count++;
+            event_count++;
+        } else {
+            if (ready[i].events & EPOLLOUT) {
+                event[0] = REACTOR_EVENT_OUTPUT_READY;
+                event[1] = token;
+                event[2] = event[3] = 0;
+                event += REACTOR_EVENT_INTS;
+                event_count++;
+            }
+            if (ready[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                event[0] = REACTOR_EVENT_INPUT;
+                event[1] = token;
+                event[2] = event[3] = 0;
+                event_count++;
+            }
+        }
+    }
+
+    (*env)->SetIntArrayRegion(env, events, 0, event_count * REACTOR_EVENT_INTS, reported);
+    if (exit_count > 0) (*env)->SetLongArrayRegion(env, resourceUsage, 0, exit_count * RESOURCE_USAGE_LONGS, usage_longs);
+    return event_count;
+}
+
+/**
+ * Read from a non-blocking pty into a direct ByteBuffer at offset. Returns the number of bytes read, 0 if there is
+ * nothing to read or -1 once the slave side has been closed.
+ */
+JNIEXPORT jint JNICALL Java_com_termux_terminal_JNI_readPty(JNIEnv* env, jclass TERMUX_UNUSED(clazz), jint fd, jobject buffer, jint offset, jint length)
+{
+    char* bytes = (*env)->GetDirectBufferAddress(env, buffer);
+    if (!bytes) return throw_runtime_exception(env, "JNI call GetDirectBufferAddress(buffer) failed");
+    ssize_t bytes_read;
+    while ((bytes_read = read(fd, bytes + offset, (size_t) length)) < 0 && errno == EINTR);
+    if (bytes_read < 0) return (errno == EAGAIN) ? 0 : -1;
+    // 0 as end of file, or EIO, both mean the slave side has been closed.
+    return bytes_read == 0 ? -1 : (jint) bytes_read;
+}
+
+/** Write to a non-blocking pty, returning the number of bytes written, 0 if it is full or -1 on error. */
+JNIEXPORT jint JNICALL Java_com_termux_terminal_JNI_reactorWrite(JNIEnv* env, jclass TERMUX_UNUSED(clazz), jint fd, jbyteArray data, jint offset, jint length)
+{
+    jbyte* bytes = (*env)->GetPrimitiveArrayCritical(env, data, NULL);
+    if (!bytes) return throw_runtime_exception(env, "JNI call GetPrimitiveArrayCritical(data, &isCopy) failed");
+    ssize_t written;
+    while ((written = write(fd, bytes + offset, (size_t) length)) < 0 && errno == EINTR);
+    (*env)->ReleasePrimitiveArrayCritical(env, data, bytes, JNI_ABORT);
+    if (written < 0) return (errno == EAGAIN) ? 0 : -1;
+    return (jint) written;
+}
+
@@ -0,0 +1,125 @@
+package com.termux.terminal;
+
+import java.nio.ByteBuffer;
+import java.nio.charset.StandardCharsets;
+
+/** Checks that processing whole buffers at once behaves as processing them byte by byte. See AppendBenchmark for throughput. */
+public class BulkAppendTest extends TerminalTestCase {
+
+	private static final String MIXED_OUTPUT = "plain ascii text\r\n"
+		+ "\033[1;31mbold red\033[0m and \033[4munderlined\033[24m\r\n"
+		+ "\033]0;a title\007after osc\r\n"
+		+ "wide 日本語 and combining é and emoji 😀\r\n"
+		+ "\033(0lqqk\033(B line drawing\r\n"
+		+ "tab\there\bback\033[5Gcolumn five\033[2K\r\n"
+		+ "a line long enough to wrap around the right edge of the terminal at least once\r\n"
+		+ "\033[?7lno autowrap for this line which is also too long for the terminal\033[?7h\r\n"
+		+ "del\177 and y with diaeresis \377\r\n";
+
+	private static TerminalEmulator newTerminal() {
+		return new TerminalEmulator(new MockTerminalOutput(), 30, 10, INITIAL_CELL_WIDTH_PIXELS, INITIAL_CELL_HEIGHT_PIXELS, 100, null);
+	}
+
+	private static void assertSameState(TerminalEmulator expected, TerminalEmulator actual) {
+		assertEquals(expected.getScreen().getTranscriptText(), actual.getScreen().getTranscriptText());
+		assertEquals(expected.getCursorRow(), actual.getCursorRow());
+		assertEquals(expected.getCursorCol(), actual.getCursorCol());
+		assertEquals(expected.getTitle(), actual.getTitle());
+		for (int row = -expected.getScreen().getActiveTranscriptRows(); row < 10; row++) {
+			for (int col = 0; col < 30; col++) {
+				assertEquals("Style at " + row + "," + col, expected.getScreen().getStyleAt(row, col), actual.getScreen().getStyleAt(row, col));
+			}
+		}
+	}
+
+	public void testBulkAppendMatchesBytewise() {
+		assertBulkAppendMatchesBytewise(MIXED_OUTPUT.getBytes(StandardCharsets.UTF_8));
+	}
+
+	public void testMalformedUtf8MatchesBytewise() {
+		assertBulkAppendMatchesBytewise(new byte[]{
+			'a', (byte) 0xC0, (byte) 0xAF, // Overlong slash.
+			'b', (byte) 0xE0, (byte) 0x80, (byte) 0xAF, // Overlong slash in three bytes.
+			'c', (byte) 0xE6, (byte) 0x97, 'd', // Truncated sequence followed by ASCII.
+			(byte) 0xE6, (byte) 0x97, (byte) 0xE6, (byte) 0x97, (byte) 0xA5, // Truncated sequence followed by a valid one.
+			(byte) 0xED, (byte) 0xA0, (byte) 0x80, // Surrogate.
+			(byte) 0xF4, (byte) 0x90, (byte) 0x80, (byte) 0x80, // Above U+10FFFF.
+			(byte) 0xC2, (byte) 0x85, // C1 control, ignored.
+			(byte) 0x80, (byte) 0xBF, // Lone continuation bytes.
+			(byte) 0xF8, (byte) 0x88, (byte) 0x80, (byte) 0x80, (byte) 0x80, // Five byte sequence.
+			(byte) 0xE2, '\033', '[', '3', '1', 'm', 'e', // Truncated sequence followed by an escape sequence.
+			'\033', ']', '0', ';', (byte) 0xCF, (byte) 0x80, '\007', // Title with a two byte character.
+			(byte) 0xF0, (byte) 0x9F, (byte) 0x98, // Truncated at the end.
+		});
+	}
+
+	private static void assertBulkAppendMatchesBytewise(byte[] bytes) {
+		TerminalEmulator bytewise = newTerminal();
+		for (byte b : bytes)
+			bytewise.append(new byte[]{b}, 1);
+
+		TerminalEmulator bulk = newTerminal();
+		bulk.append(bytes, bytes.length);
+		assertSameState(bytewise, bulk);
+
+		// Split at every position, which also splits escape sequences and UTF-8 sequences.
+		for (int split = 1; split < bytes.length; split++) {
+			TerminalEmulator splitTerminal = newTerminal();
+			byte[] first = new byte[split];
+			byte[] second = new byte[bytes.length - split];
+			System.arraycopy(bytes, 0, first, 0, split);
+			System.arraycopy(bytes, split, second, 0, second.length);
+			splitTerminal.append(first, first.length);
+			splitTerminal.append(second, second.length);
+			assertSameState(bytewise, splitTerminal);
+		}
+	}
+
+	public void testDirectBufferAppend() {
+		byte[] bytes = MIXED_OUTPUT.getBytes(StandardCharsets.UTF_8);
+		TerminalEmulator expected = newTerminal();
+		expected.append(bytes, bytes.length);
+
+		ByteBuffer buffer = ByteBuffer.allocateDirect(bytes.length + 10);
+		buffer.position(10);
+		buffer.put(bytes);
+		TerminalEmulator actual = newTerminal();
+		actual.append(buffer, 10, bytes.length);
+		assertSameState(expected, actual);
+	}
+
+	public void testPrintableRunsAtEdges() {
+		withTerminalSized(5, 3).enterString("abcdefg\r\nhi\033[2;4Hxy").assertLinesAre("abcde", "fg xy", "hi   ");
+	}
+
+	public void testSpanWithoutAutowrapKeepsLastCharacter() {
+		withTerminalSized(5, 3).enterString("\033[?7labcdefgh").assertLinesAre("abcdh", "     ", "     ").assertCursorAt(0, 4);
+		enterString("\033[?7h\rxyz").assertLinesAre("xyzdh", "     ", "     ").assertCursorAt(0, 3);
+	}
+
+	public void testSpanWrapsWithinMargins() {
+		withTerminalSized(5, 3).enterString("\033[?69h\033[2;4s\033[1;2Habcdefg").assertLinesAre(" abc ", " def ", " g   ");
+	}
+
+	public void testSpanInInsertMode() {
+		withTerminalSized(5, 2).enterString("abc\r\033[4hXY").assertLinesAre("XYabc", "     ");
+	}
+
+	public void testSpanWithLineDrawing() {
+		withTerminalSized(5, 2).enterString("\033(0lqk\033(Bqk").assertLinesAre("┌─┐qk", "     ");
+	}
+
+	public void testSpanOverWideCharacters() {
+		withTerminalSized(6, 2).enterString("日本語\r\033[Cab").assertLinesAre(" ab 語", "      ");
+	}
+
+	public void testSpanKeepsStyle() {
+		withTerminalSized(5, 2).enterString("\033[31mab\033[0mcd");
+		long red = mTerminal.getScreen().getStyleAt(0, 0);
+		assertEquals(red, mTerminal.getScreen().getStyleAt(0, 1));
+		assertEquals(TextStyle.NORMAL, mTerminal.getScreen().getStyleAt(0, 2));
+		assertEquals(TextStyle.NORMAL, mTerminal.getScreen().getStyleAt(0, 3));
+		assertFalse(red == TextStyle.NORMAL);
+	}
+
+}
@@ -0,0 +1,157 @@
+package com.termux.terminal;
+
+import junit.framework.TestCase;
+
+import java.util.concurrent.Semaphore;
+import java.util.concurrent.TimeUnit;
+
+public class ByteRingTest extends TestCase {
+
+	private static void assertArrayEquals(byte[] expected, byte[] actual) {
+		assertEquals(expected.length, actual.length);
+		for (int i = 0; i < expected.length; i++) {
+			if (expected[i] != actual[i]) {
+				fail("Inequals at index=" + i + ", expected=" + (int) expected[i] + ", actual=" + (int) actual[i]);
+			}
+		}
+	}
+
+	public void testCompleteWrites() {
+		ByteRing ring = new ByteRing(16, 16);
+		assertTrue(ring.write(new byte[]{1, 2, 3}, 0, 3));
+
+		byte[] arr = new byte[10];
+		assertEquals(3, ring.read(arr, true));
+		assertArrayEquals(new byte[]{1, 2, 3}, new byte[]{arr[0], arr[1], arr[2]});
+
+		assertTrue(ring.write(new byte[]{1, 2, 3, 4, 5, 6, 7, 8, 9, 10}, 0, 10));
+		assertEquals(10, ring.read(arr, true));
+		assertArrayEquals(new byte[]{1, 2, 3, 4, 5, 6, 7, 8, 9, 10}, arr);
+	}
+
+	public void testWraparound() {
+		ByteRing ring = new ByteRing(8, 8);
+		byte[] origArray = new byte[]{1, 2, 3, 4, 5, 6};
+		byte[] readArray = new byte[origArray.length];
+		for (int i = 0; i < 20; i++) {
+			assertTrue(ring.write(origArray, 0, origArray.length));
+			assertEquals(origArray.length, ring.read(readArray, true));
+			assertArrayEquals(origArray, readArray);
+		}
+	}
+
+	public void testWriteNotesClosing() {
+		ByteRing ring = new ByteRing(8, 8);
+		ring.close();
+		assertFalse(ring.write(new byte[]{1, 2, 3}, 0, 3));
+		assertEquals(-1, ring.read(new byte[8], false));
+	}
+
+	public void testReadNonBlocking() {
+		ByteRing ring = new ByteRing(8, 8);
+		assertEquals(0, ring.read(new byte[128], false));
+	}
+
+	public void testGrowsInsteadOfBlocking() {
+		ByteRing ring = new ByteRing(4, 64);
+		byte[] bytes = new byte[50];
+		for (int i = 0; i < bytes.length; i++)
+			bytes[i] = (byte) i;
+		// Would block forever if the ring did not grow, as nothing reads.
+		assertTrue(ring.write(bytes, 0, bytes.length));
+		assertEquals(64, ring.capacity());
+
+		byte[] readBytes = new byte[bytes.length];
+		assertEquals(bytes.length, ring.read(readBytes, false));
+		assertArrayEquals(bytes, readBytes);
+		assertEquals(0, ring.read(readBytes, false));
+	}
+
+	public void testAsksConsumerToDrainBeforeWaiting() throws InterruptedException {
+		ByteRing ring = new ByteRing(16, 64);
+		byte[] bytes = new byte[1000];
+		for (int i = 0; i < bytes.length; i++)
+			bytes[i] = (byte) i;
+		Semaphore drainRequests = new Semaphore(0);
+		Thread producer = new Thread(() -> {
+			ring.write(bytes, 0, bytes.length, drainRequests::release);
+			drainRequests.release();
+		});
+		producer.setDaemon(true);
+		producer.start();
+		try {
+			// Like the reactor, only drain when asked to:
+			byte[] received = new byte[bytes.length];
+			byte[] buffer = new byte[64];
+			int total = 0;
+			while (total < bytes.length) {
+				assertTrue(drainRequests.tryAcquire(10, TimeUnit.SECONDS));
+				int read;
+				while ((read = ring.read(buffer, false)) > 0) {
+					System.arraycopy(buffer, 0, received, total, read);
+					total += read;
+				}
+			}
+			producer.join(10_000);
+			assertFalse(producer.isAlive());
+			assertArrayEquals(bytes, received);
+		} finally {
+			ring.close();
+		}
+	}
+
+	public void testBatchAcquireAndCommit() {
+		ByteRing ring = new ByteRing(8, 8);
+		assertEquals(8, ring.acquireWrite());
+		byte[] array = ring.writeArray();
+		int offset = ring.writeOffset();
+		for (int i = 0; i < 5; i++)
+			array[offset + i] = (byte) (10 + i);
+		ring.commitWrite(5);
+
+		assertEquals(5, ring.acquireRead());
+		assertEquals(10, ring.readArray()[ring.readOffset()]);
+		ring.commitRead(3);
+		assertEquals(2, ring.acquireRead());
+		assertEquals(13, ring.readArray()[ring.readOffset()]);
+
+		// Three bytes to the end of the array are contiguous.
+		assertEquals(3, ring.acquireWrite());
+	}
+
+	/** Stream count bytes from a producer thread through the ring and return the sum read by the consumer. */
+	private static long transfer(ByteRing ring, int count) throws InterruptedException {
+		Thread producer = new Thread(() -> {
+			byte[] chunk = new byte[1000];
+			for (int i = 0; i < chunk.length; i++)
+				chunk[i] = (byte) i;
+			for (int written = 0; written < count; written += chunk.length)
+				ring.write(chunk, 0, Math.min(chunk.length, count - written));
+		});
+		producer.start();
+		long sum = 0;
+		byte[] buffer = new byte[4096];
+		for (int read = 0; read < count; ) {
+			int bytes = ring.read(buffer, true);
+			for (int i = 0; i < bytes; i++)
+				sum += buffer[i] & 0xFF;
+			read += bytes;
+		}
+		producer.join();
+		return sum;
+	}
+
+	private static long expectedSum(int count) {
+		long sum = 0;
+		for (int i = 0; i < count; i++)
+			sum += (i % 1000) & 0xFF;
+		return sum;
+	}
+
+	public void testConcurrentTransfer() throws InterruptedException {
+		int count = 1_000_000;
+		assertEquals(expectedSum(count), transfer(new ByteRing(64, 64), count));
+		assertEquals(expectedSum(count), transfer(new ByteRing(64, 64 * 1024), count));
+	}
+
+}
@@ -0,0 +1,85 @@
+package com.termux.terminal;
+
+import junit.framework.TestCase;
+
+public class DirectByteRingTest extends TestCase {
+
+	private static void write(DirectByteRing ring, byte... bytes) {
+		int written = 0;
+		while (written < bytes.length) {
+			int offset = ring.writableOffset();
+			int length = Math.min(ring.writableLength(), bytes.length - written);
+			assertTrue(length > 0);
+			for (int i = 0; i < length; i++)
+				ring.mBuffer.put(offset + i, bytes[written + i]);
+			ring.commitWrite(length);
+			written += length;
+		}
+	}
+
+	private static byte[] read(DirectByteRing ring) {
+		byte[] result = new byte[ring.size()];
+		int read = 0;
+		while (ring.readableLength() > 0) {
+			int offset = ring.readableOffset();
+			int length = ring.readableLength();
+			for (int i = 0; i < length; i++)
+				result[read + i] = ring.mBuffer.get(offset + i);
+			ring.commitRead(length);
+			read += length;
+		}
+		return result;
+	}
+
+	public void testRejectsCapacityNotPowerOfTwo() {
+		try {
+			new DirectByteRing(10);
+			fail();
+		} catch (IllegalArgumentException e) {
+			// Expected.
+		}
+	}
+
+	public void testEmptyAndFull() {
+		DirectByteRing ring = new DirectByteRing(8);
+		assertEquals(0, ring.readableLength());
+		assertEquals(8, ring.writableLength());
+		write(ring, new byte[]{1, 2, 3, 4, 5, 6, 7, 8});
+		assertEquals(0, ring.writableLength());
+		assertEquals(8, ring.size());
+		assertEquals(8, read(ring).length);
+		assertEquals(0, ring.size());
+	}
+
+	public void testRegionsAreContiguousAcrossWraparound() {
+		DirectByteRing ring = new DirectByteRing(8);
+		write(ring, new byte[]{1, 2, 3, 4, 5, 6});
+		ring.commitRead(4);
+		// Only the two bytes to the end of the buffer are contiguous.
+		assertEquals(6, ring.writableOffset());
+		assertEquals(2, ring.writableLength());
+		write(ring, new byte[]{7, 8, 9, 10});
+		assertEquals(4, ring.readableOffset());
+		assertEquals(4, ring.readableLength());
+		byte[] bytes = read(ring);
+		assertEquals(6, bytes.length);
+		for (int i = 0; i < bytes.length; i++)
+			assertEquals(5 + i, bytes[i]);
+	}
+
+	public void testManyWraparounds() {
+		DirectByteRing ring = new DirectByteRing(16);
+		byte value = 0;
+		for (int round = 0; round < 100; round++) {
+			byte[] bytes = new byte[1 + round % 13];
+			for (int i = 0; i < bytes.length; i++)
+				bytes[i] = value++;
+			write(ring, bytes);
+			byte[] readBytes = read(ring);
+			assertEquals(bytes.length, readBytes.length);
+			for (int i = 0; i < bytes.length; i++)
+				assertEquals(bytes[i], readBytes[i]);
+		}
+	}
+
+}
@@ -30,4 +30,52 @@ public class HistoryTest extends TerminalTestCase {
 		enterString("LMN").assertLinesAre("111", "IJK", "LMN", "444").assertHistoryStartsWith("FGH", "CDE");
 	}
 
+	public void testHistoryRowsAreFrozen() {
+		withTerminalSized(5, 3).enterString("\033[31mab\033[0m\r\nc\r\nd\r\n\033[44m  \033[0m\r\ne");
+		TerminalBuffer screen = mTerminal.getScreen();
+		for (int row = -2; row < 0; row++)
+			assertTrue(screen.mLines[screen.externalToInternalRow(row)].isFrozen());
+		assertFalse(screen.mLines[screen.externalToInternalRow(0)].isFrozen());
+		assertInvariants();
+
+		// Reading the transcript leaves it frozen.
+		assertEquals("ab\nc\nd\n\ne", screen.getTranscriptText());
+		assertTrue(screen.mLines[screen.externalToInternalRow(-2)].isFrozen());
+		long red = TextStyle.encode(1, TextStyle.COLOR_INDEX_BACKGROUND, 0);
+		assertEquals(red, getStyleAt(-2, 1));
+		assertEquals(TextStyle.NORMAL, getStyleAt(-2, 2));
+		assertHistoryStartsWith("c    ", "ab   ");
+		assertTrue(screen.mLines[screen.externalToInternalRow(-2)].isFrozen());
+		assertTrue(screen.mLines[screen.externalToInternalRow(-1)].isFrozen());
+
+		// Revealing history by growing the screen thaws the rows when written to.
+		resize(5, 5).assertLinesAre("ab   ", "c    ", "d    ", "     ", "e    ");
+		assertEquals(TextStyle.encode(TextStyle.COLOR_INDEX_FOREGROUND, 4, 0), getStyleAt(3, 1));
+		enterString("\033[1;3HX").assertLinesAre("abX  ", "c    ", "d    ", "     ", "e    ");
+		assertEquals(red, getStyleAt(0, 0));
+	}
+
+	/** What the renderer does for each row drawn. */
+	public void testReadingHistoryRowsLeavesThemFrozen() {
+		withTerminalSized(5, 2).enterString("\033[31mab\033[0m\r\n\033[44mcd\033[0m\r\ne\r\nf");
+		TerminalBuffer screen = mTerminal.getScreen();
+		TerminalRow first = screen.mLines[screen.externalToInternalRow(-2)];
+		TerminalRow second = screen.mLines[screen.externalToInternalRow(-1)];
+
+		TerminalRow read = screen.getLineForReading(screen.externalToInternalRow(-2));
+		assertNotSame(first, read);
+		assertEquals("ab", new String(read.mText, 0, read.getSpaceUsed()).trim());
+		assertEquals(TextStyle.encode(1, TextStyle.COLOR_INDEX_BACKGROUND, 0), read.getStyle(1));
+		read = screen.getLineForReading(screen.externalToInternalRow(-1));
+		assertEquals("cd", new String(read.mText, 0, read.getSpaceUsed()).trim());
+		assertEquals(TextStyle.encode(TextStyle.COLOR_INDEX_FOREGROUND, 4, 0), read.getStyle(0));
+		assertEquals(TextStyle.NORMAL, read.getStyle(2));
+		assertTrue(first.isFrozen());
+		assertTrue(second.isFrozen());
+
+		// The screen rows are read in place.
+		assertSame(screen.mLines[screen.externalToInternalRow(0)], screen.getLineForReading(screen.externalToInternalRow(0)));
+		assertInvariants();
+	}
+
 }
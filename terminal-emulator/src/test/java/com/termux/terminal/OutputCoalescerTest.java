@@ -0,0 +1,69 @@
+package com.termux.terminal;
+
+import junit.framework.TestCase;
+
+public class OutputCoalescerTest extends TestCase {
+
+	private static final long MICROS = 1000;
+
+	public void testOutputAfterIdleIsPassedOnAtOnce() {
+		OutputCoalescer coalescer = new OutputCoalescer();
+		coalescer.onRead(1);
+		assertTrue(coalescer.shouldFlush(0));
+		coalescer.flushed();
+
+		coalescer.onRead(1);
+		assertTrue(coalescer.shouldFlush(OutputCoalescer.IDLE_MICROS * MICROS));
+		coalescer.flushed();
+		assertFalse(coalescer.isHolding());
+	}
+
+	public void testStreamingOutputIsHeldUntilIdle() {
+		OutputCoalescer coalescer = new OutputCoalescer();
+		coalescer.onRead(100);
+		assertTrue(coalescer.shouldFlush(0));
+		coalescer.flushed();
+
+		coalescer.onRead(100);
+		assertFalse(coalescer.shouldFlush(100 * MICROS));
+		assertTrue(coalescer.isHolding());
+		coalescer.onRead(100);
+		assertFalse(coalescer.shouldFlush(300 * MICROS));
+		// Due once no more output has arrived for the idle time.
+		assertEquals((300 + OutputCoalescer.IDLE_MICROS) * MICROS, coalescer.flushDeadline());
+	}
+
+	public void testStreamingOutputIsHeldAtMostMaxHoldTime() {
+		OutputCoalescer coalescer = new OutputCoalescer();
+		coalescer.onRead(10);
+		assertTrue(coalescer.shouldFlush(0));
+		coalescer.flushed();
+
+		long now = 0;
+		int flushes = 0;
+		for (int i = 0; i < 100; i++) {
+			now += 500 * MICROS;
+			coalescer.onRead(10);
+			if (coalescer.shouldFlush(now)) {
+				coalescer.flushed();
+				flushes++;
+			}
+		}
+		// Output is held from one read for the eight following ones, so a flush every nine reads instead of 100 messages.
+		assertEquals(100 / 9, flushes);
+		assertEquals(101, coalescer.mReadCount);
+	}
+
+	public void testManyHeldBytesArePassedOn() {
+		OutputCoalescer coalescer = new OutputCoalescer();
+		coalescer.onRead(1);
+		assertTrue(coalescer.shouldFlush(0));
+		coalescer.flushed();
+
+		coalescer.onRead(OutputCoalescer.MAX_HELD_BYTES - 1);
+		assertFalse(coalescer.shouldFlush(10 * MICROS));
+		coalescer.onRead(1);
+		assertTrue(coalescer.shouldFlush(20 * MICROS));
+	}
+
+}
@@ -1,5 +1,8 @@
 package com.termux.terminal;
 
+import java.util.ArrayList;
+import java.util.List;
+
 public class ResizeTest extends TerminalTestCase {
 
 	public void testResizeWhenHasHistory() {
@@ -209,4 +212,78 @@ public class ResizeTest extends TerminalTestCase {
 		resize(5, rows).assertLinesAre("ＱＲ ", "     ", "     ", "     ");
 	}
 
+	private static String transcriptLine(int i) {
+		StringBuilder line = new StringBuilder("L").append(i).append(':');
+		for (int j = 0; j < (i * 7) % 45; j++)
+			line.append((char) ('a' + j % 26));
+		return line.toString();
+	}
+
+	public void testLazyReflowOfTranscript() {
+		final int lineCount = 300;
+		mTerminal = new TerminalEmulator(mOutput, 20, 5, INITIAL_CELL_WIDTH_PIXELS, INITIAL_CELL_HEIGHT_PIXELS, 2000, null);
+		for (int i = 0; i < lineCount; i++)
+			enterString(transcriptLine(i) + "\r\n");
+
+		// The rows expected at 13 columns, ending with the empty one of the cursor:
+		List<String> rows = new ArrayList<>();
+		for (int i = 0; i < lineCount; i++) {
+			String line = transcriptLine(i);
+			for (int start = 0; start < line.length(); start += 13)
+				rows.add(line.substring(start, Math.min(line.length(), start + 13)));
+		}
+		rows.add("");
+
+		resize(13, 5).assertCursorAt(4, 0);
+		for (int row = 0; row < 5; row++)
+			assertLineIs(row, String.format("%-13s", rows.get(rows.size() - 5 + row)));
+		TerminalBuffer screen = mTerminal.getScreen();
+		assertTrue(screen.hasRowsToReflow());
+		assertTrue(screen.getActiveTranscriptRows() < rows.size() - 5);
+
+		while (mTerminal.reflowTranscript(50))
+			assertInvariants();
+		assertEquals(rows.size() - 5, screen.getActiveTranscriptRows());
+		StringBuilder expected = new StringBuilder();
+		for (String row : rows)
+			expected.append(row).append('\n');
+		assertEquals(expected.toString().trim(), screen.getTranscriptTextWithoutJoinedLines());
+
+		// Resizing again before the transcript has been reflowed takes the rows left along.
+		resize(20, 5);
+		assertTrue(screen.hasRowsToReflow());
+		resize(17, 6);
+		expected.setLength(0);
+		for (int i = 0; i < lineCount; i++)
+			expected.append(transcriptLine(i)).append('\n');
+		assertEquals(expected.toString().trim(), screen.getTranscriptText());
+		assertFalse(screen.hasRowsToReflow());
+	}
+
+	public void testParallelReflowKeepsTextAndStyles() {
+		// Enough lines for the transcript to be split and reflowed in parts, each in a color:
+		final int lineCount = 6000;
+		mTerminal = new TerminalEmulator(mOutput, 30, 5, INITIAL_CELL_WIDTH_PIXELS, INITIAL_CELL_HEIGHT_PIXELS, 4 * lineCount, null);
+		StringBuilder expected = new StringBuilder();
+		for (int i = 0; i < lineCount; i++) {
+			String line = transcriptLine(i);
+			enterString("\033[3" + (i % 8) + "m" + line + "\r\n");
+			expected.append(line).append('\n');
+		}
+
+		resize(11, 5);
+		TerminalBuffer screen = mTerminal.getScreen();
+		assertTrue(screen.hasRowsToReflow());
+		assertEquals(expected.toString().trim(), screen.getTranscriptText());
+		assertFalse(screen.hasRowsToReflow());
+		assertInvariants();
+
+		int row = -screen.getActiveTranscriptRows();
+		for (int i = 0; i < lineCount; i++) {
+			int rowsOfLine = (transcriptLine(i).length() + 10) / 11;
+			for (int j = 0; j < rowsOfLine; j++, row++)
+				assertEquals("Color of line " + i, i % 8, TextStyle.decodeForeColor(screen.getStyleAt(row, 0)));
+		}
+	}
+
 }
@@ -117,6 +117,41 @@ public class ScrollRegionTest extends TerminalTestCase {
 		assertLinesAre("1 ", "2 ", "3 ", "QQ", "YY");
 	}
 
+	public void testInsertAndDeleteLinesWithinScrollRegion() {
+		withTerminalSized(3, 5).enterString("111\r\n222\r\n333\r\n444\r\n555");
+		enterString("\033[2;4r\033[2;1H\033[44m\033[L").assertLinesAre("111", "   ", "222", "333", "555");
+		assertEquals(4, TextStyle.decodeBackColor(getStyleAt(1, 2)));
+		enterString("\033[0m\033[M").assertLinesAre("111", "222", "333", "   ", "555");
+		assertEquals(TextStyle.COLOR_INDEX_BACKGROUND, TextStyle.decodeBackColor(getStyleAt(3, 2)));
+		enterString("\033[3;1H\033[5M").assertLinesAre("111", "222", "   ", "   ", "555");
+		enterString("\033[1;1H444\033[2;1H\033M").assertLinesAre("444", "   ", "222", "   ", "555");
+		enterString("\033[2;1H\033[2T").assertLinesAre("444", "   ", "   ", "   ", "555");
+	}
+
+	/** Scrolling one pane of a tmux style split screen, each way it can be scrolled, leaves the rest of the screen. */
+	public void testSplitScreenScrollKeepsOtherPane() {
+		final int columns = 120;
+		final int rows = 50;
+		withTerminalSized(columns, rows).enterString("\033[?1049h");
+		StringBuilder line = new StringBuilder();
+		for (int i = 0; i < columns; i++)
+			line.append((char) ('a' + i % 26));
+		// The upper pane spans rows 1 to 24, the lower rows 26 to 49 and the status line is row 50.
+		enterString("\033[50;1H" + line + "\033[25;1H" + line);
+
+		String[] scrolls = {"\033[26;49r\033[49;1H\n", "\033[1;24r\033[24;1H\n", "\033[26;49r\033[26;1H\033[M", "\033[1;24r\033[1;1H\033M"};
+		for (int i = 0; i < scrolls.length; i++) {
+			enterString("\033[1;1Hupper\033[26;1Hlower");
+			for (int j = 0; j < rows; j++)
+				enterString(scrolls[i]);
+			boolean lowerPane = i % 2 == 0;
+			assertLineStartsWith(0, lowerPane ? 'u' : ' ');
+			assertLineStartsWith(25, lowerPane ? ' ' : 'l');
+			assertLineIs(24, line.toString());
+			assertLineIs(49, line.toString());
+		}
+	}
+
 	/** See https://github.com/termux/termux-app/issues/1340 */
 	public void testScrollRegionDoesNotLimitCursorMovement() {
 		withTerminalSized(6, 4)
@@ -0,0 +1,169 @@
+package com.termux.terminal;
+
+import java.io.File;
+import java.nio.file.Files;
+
+public class ScrollbackFileTest extends TerminalTestCase {
+
+	private File mDirectory;
+
+	@Override
+	protected void setUp() throws Exception {
+		super.setUp();
+		mDirectory = Files.createTempDirectory("scrollback").toFile();
+	}
+
+	@Override
+	protected void tearDown() throws Exception {
+		assertTrue(mDirectory.delete());
+		super.tearDown();
+	}
+
+	/** A terminal whose transcript holds 97 rows, keeping those scrolled out of it in the scrollback file. */
+	private void withTerminalKeepingScrollback(int maxRows, boolean compress) {
+		mTerminal = new TerminalEmulator(mOutput, 10, 3, INITIAL_CELL_WIDTH_PIXELS, INITIAL_CELL_HEIGHT_PIXELS, TerminalEmulator.TERMINAL_TRANSCRIPT_ROWS_MIN, null);
+		mTerminal.setScrollbackDirectory(mDirectory, maxRows, compress);
+	}
+
+	public void testRowsScrolledOutOfTranscriptAreKept() {
+		checkRowsScrolledOutOfTranscriptAreKept(false);
+	}
+
+	public void testCompressedRowsScrolledOutOfTranscriptAreKept() {
+		checkRowsScrolledOutOfTranscriptAreKept(true);
+	}
+
+	private void checkRowsScrolledOutOfTranscriptAreKept(boolean compress) {
+		withTerminalKeepingScrollback(1000, compress);
+		for (int i = 0; i < 300; i++)
+			enterString("\033[3" + (i % 8) + "mline " + i + "\r\n");
+		assertLinesAre("line 298  ", "line 299  ", "          ");
+
+		TerminalBuffer screen = mTerminal.getScreen();
+		assertEquals(298, screen.getActiveTranscriptRows());
+		assertHistoryStartsWith("line 297  ", "line 296  ");
+		for (int i = 0; i < 298; i++) {
+			assertLineIs(i - 298, String.format("%-10s", "line " + i));
+			assertEquals(i % 8, TextStyle.decodeForeColor(screen.getStyleAt(i - 298, 0)));
+		}
+		assertInvariants();
+		// The files are unlinked once mapped:
+		assertEquals(0, mDirectory.list().length);
+
+		enterString("\033[3J");
+		assertEquals(0, screen.getActiveTranscriptRows());
+	}
+
+	public void testOldestRowsAreDropped() {
+		withTerminalKeepingScrollback(20, false);
+		for (int i = 0; i < 300; i++)
+			enterString("line " + i + "\r\n");
+		assertEquals(117, mTerminal.getScreen().getActiveTranscriptRows());
+		assertLineIs(-117, "line 181  ");
+		assertLineIs(-98, "line 200  ");
+		assertLineIs(-97, "line 201  ");
+	}
+
+	public void testReflowKeepsOrderWithScrollback() {
+		withTerminalKeepingScrollback(1000, true);
+		for (int i = 0; i < 300; i++)
+			enterString("line " + i + "\r\n");
+
+		resize(6, 3);
+		// The rows scrolled out before are cut to the new width, while those of the transcript are reflowed:
+		StringBuilder expected = new StringBuilder();
+		for (int i = 0; i < 300; i++) {
+			String line = "line " + i;
+			if (i <= 200) expected.append(line, 0, 6).append('\n');
+			else expected.append(line, 0, 6).append('\n').append(line.substring(6)).append('\n');
+		}
+		TerminalBuffer screen = mTerminal.getScreen();
+		assertEquals(expected.toString().trim(), screen.getTranscriptTextWithoutJoinedLines());
+		assertEquals(201 + 2 * 99 - 2, screen.getActiveTranscriptRows());
+		assertLinesAre("line 2", "99    ", "      ");
+		assertInvariants();
+	}
+
+	public void testReplacedScrollbackIsClosed() {
+		withTerminalKeepingScrollback(1000, true);
+		for (int i = 0; i < 300; i++)
+			enterString("line " + i + "\r\n");
+		TerminalBuffer screen = mTerminal.getScreen();
+		ScrollbackFile scrollback = screen.getScrollback();
+		assertEquals(201, scrollback.size());
+
+		mTerminal.setScrollbackDirectory(null, 0, false);
+		assertNull(screen.getScrollback());
+		assertEquals(0, scrollback.size());
+		assertEquals(0, scrollback.getSegmentCount());
+		// The transcript itself is left:
+		assertEquals(97, screen.getActiveTranscriptRows());
+		assertLineIs(-97, "line 201  ");
+		assertInvariants();
+	}
+
+	public void testRowsStayReadableAfterReleasingCompressor() {
+		withTerminalKeepingScrollback(1000, true);
+		for (int i = 0; i < 300; i++)
+			enterString("line " + i + "\r\n");
+		mTerminal.releaseScrollbackCompressor();
+		assertEquals(298, mTerminal.getScreen().getActiveTranscriptRows());
+		assertLineIs(-298, "line 0    ");
+		assertLineIs(-100, "line 198  ");
+
+		// Output after the process exited, or rows scrolled out on resize, still go to the scrollback:
+		mTerminal.releaseScrollbackCompressor();
+		for (int i = 300; i < 5000; i++)
+			enterString("line " + i + "\r\n");
+		assertEquals(1097, mTerminal.getScreen().getActiveTranscriptRows());
+		assertLineIs(-1097, "line 3901 ");
+		assertInvariants();
+	}
+
+	public void testSegmentsAreDropped() {
+		ScrollbackFile scrollback = new ScrollbackFile(mDirectory, 10, false, 64);
+		StyleTable styleTable = new StyleTable();
+		for (int i = 0; i < 100; i++)
+			assertTrue(scrollback.append(newRow(styleTable, "row " + i, i % 8)));
+		assertEquals(10, scrollback.size());
+		assertEquals(100, scrollback.getEndRow());
+		assertTrue(scrollback.getSegmentCount() <= 11);
+		assertRowIs(scrollback.read(95, styleTable, null), "row 95", 7);
+	}
+
+	public void testCompressedBlocks() {
+		// Small segments for blocks to be dropped with them:
+		ScrollbackFile scrollback = new ScrollbackFile(mDirectory, 20000, true, 16 << 10);
+		StyleTable styleTable = new StyleTable();
+		for (int i = 0; i < 50000; i++)
+			assertTrue(scrollback.append(newRow(styleTable, "row " + i, i % 8)));
+		assertEquals(20000, scrollback.size());
+		assertTrue(scrollback.getWrittenBytes() * 2 < scrollback.getRowBytes());
+
+		// The newest rows, not yet compressed, the oldest kept, and rows back and forth across blocks:
+		for (int i : new int[]{49999, 30000, 30001, 45000, 30002, 42424})
+			assertRowIs(scrollback.read(i, styleTable, null), "row " + i, i % 8);
+		try {
+			scrollback.read(29999, styleTable, null);
+			fail();
+		} catch (IllegalArgumentException e) {
+			// Expected.
+		}
+	}
+
+	private static TerminalRow newRow(StyleTable styleTable, String text, int color) {
+		TerminalRow row = new TerminalRow(80, styleTable, null, TextStyle.NORMAL);
+		for (int column = 0; column < text.length(); column++)
+			row.setChar(column, text.charAt(column), TextStyle.encode(color, TextStyle.COLOR_INDEX_BACKGROUND, 0));
+		return row;
+	}
+
+	private static void assertRowIs(TerminalRow row, String text, int color) {
+		assertTrue(row.isFrozen());
+		row.thaw();
+		assertEquals(String.format("%-80s", text), new String(row.mText, 0, row.getSpaceUsed()));
+		assertEquals(color, TextStyle.decodeForeColor(row.getStyle(0)));
+		assertEquals(TextStyle.NORMAL, row.getStyle(79));
+	}
+
+}
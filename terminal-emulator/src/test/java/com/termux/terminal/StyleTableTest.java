@@ -0,0 +1,64 @@
+package com.termux.terminal;
+
+import junit.framework.TestCase;
+
+public class StyleTableTest extends TestCase {
+
+	private static long trueColorStyle(int i) {
+		return TextStyle.encode(0xff000000 | i, TextStyle.COLOR_INDEX_BACKGROUND, 0);
+	}
+
+	public void testIntern() {
+		StyleTable table = new StyleTable();
+		int normal = table.intern(TextStyle.NORMAL);
+		int bold = table.intern(TextStyle.encode(TextStyle.COLOR_INDEX_FOREGROUND, TextStyle.COLOR_INDEX_BACKGROUND, TextStyle.CHARACTER_ATTRIBUTE_BOLD));
+		assertFalse(normal == bold);
+		assertEquals(normal, table.intern(TextStyle.NORMAL));
+		assertEquals(TextStyle.NORMAL, table.get(normal));
+		assertEquals(2, table.size());
+
+		for (int i = 0; i < 1000; i++)
+			assertEquals(i + 2, table.intern(trueColorStyle(i)));
+		for (int i = 0; i < 1000; i++)
+			assertEquals(trueColorStyle(i), table.get(table.intern(trueColorStyle(i))));
+		assertEquals(1002, table.size());
+	}
+
+	public void testRowStylesRoundTrip() {
+		TerminalRow row = new TerminalRow(10, TextStyle.NORMAL);
+		for (int column = 0; column < 10; column++)
+			row.setChar(column, 'a', trueColorStyle(column));
+		for (int column = 0; column < 10; column++)
+			assertEquals(trueColorStyle(column), row.getStyle(column));
+		row.setStyle(3, TextStyle.NORMAL);
+		assertEquals(TextStyle.NORMAL, row.getStyle(3));
+	}
+
+	public void testUnusedIdsAreReused() {
+		TerminalRow row = new TerminalRow(10, TextStyle.NORMAL);
+		row.setChar(5, 'b', trueColorStyle(1234567));
+		// Every style but the last written to column 0 goes out of use right away.
+		for (int i = 0; i < StyleTable.MAX_STYLES + 1000; i++)
+			row.setChar(0, 'a', trueColorStyle(i));
+		assertEquals(trueColorStyle(StyleTable.MAX_STYLES + 999), row.getStyle(0));
+		assertEquals(trueColorStyle(1234567), row.getStyle(5));
+		assertEquals(TextStyle.NORMAL, row.getStyle(9));
+		assertTrue(row.mStyleTable.size() <= StyleTable.MAX_STYLES);
+	}
+
+	public void testFullTableFallsBackToNearestStyle() {
+		TerminalBuffer buffer = new TerminalBuffer(256, 300, 300);
+		for (int i = 0; i < StyleTable.MAX_STYLES - 1; i++)
+			buffer.setChar(i % 256, i / 256, 'a', trueColorStyle(i));
+		// NORMAL from the initial blank screen takes the first id, and styles still in use are not freed.
+		long bold = TextStyle.encode(0xff000000 | 100, TextStyle.COLOR_INDEX_BACKGROUND, TextStyle.CHARACTER_ATTRIBUTE_BOLD);
+		buffer.setChar(253, 299, 'a', bold);
+		assertEquals(trueColorStyle(100), buffer.getStyleAt(299, 253));
+		buffer.setChar(254, 299, 'a', TextStyle.encode(0xff000000 | 200, 4, 0));
+		assertEquals(trueColorStyle(200), buffer.getStyleAt(299, 254));
+		buffer.setChar(255, 299, 'a', trueColorStyle(StyleTable.MAX_STYLES));
+		assertEquals(TextStyle.NORMAL, buffer.getStyleAt(299, 255));
+		assertEquals(trueColorStyle(100), buffer.getStyleAt(0, 100));
+	}
+
+}
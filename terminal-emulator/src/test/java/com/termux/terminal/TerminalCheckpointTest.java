@@ -0,0 +1,134 @@
+package com.termux.terminal;
+
+import java.io.File;
+import java.io.IOException;
+import java.nio.file.Files;
+
+public class TerminalCheckpointTest extends TerminalTestCase {
+
+	private File mFile;
+
+	@Override
+	protected void setUp() throws Exception {
+		super.setUp();
+		mFile = File.createTempFile("checkpoint", null);
+	}
+
+	@Override
+	protected void tearDown() throws Exception {
+		assertTrue(mFile.delete());
+		super.tearDown();
+	}
+
+	public void testRestoresScreenTranscriptAndState() throws IOException {
+		withTerminalSized(10, 4);
+		for (int i = 0; i < 50; i++)
+			enterString("\033[3" + (i % 8) + "mline " + i + "\r\n");
+		// Title, a wrapped line, insert mode, margins, a redefined color, bracketed paste and a style in effect:
+		enterString("\033]2;title\007\033[0mwrapping line\033[4h\033[2;3r\033]4;5;#102030\007\033[?2004h\033[1;44m");
+		enterString("\033[1;2H");
+
+		TerminalEmulator restored = writeAndRestore();
+		assertEquals(describe(mTerminal), describe(restored));
+		assertEquals("title", restored.getTitle());
+		assertTrue(restored.isBracketedPasteMode());
+		assertEquals(0xFF102030, restored.mColors.mCurrentColors[5]);
+		assertEquals(mTerminal.getScreen().getTranscriptText(), restored.getScreen().getTranscriptText());
+
+		// Both go on alike, which they only do with the same modes, margins and style:
+		String more = "\033[2;1Hab\033[Scd\rinserted\033[3;10Hxyz\r\n\r\n";
+		enterString(more);
+		restored.append(more.getBytes(), more.length());
+		assertEquals(describe(mTerminal), describe(restored));
+	}
+
+	public void testRestoresAlternateBuffer() throws IOException {
+		withTerminalSized(5, 3).enterString("main\033[?1049h\033[2;2Halt");
+		TerminalEmulator restored = writeAndRestore();
+		assertTrue(restored.isAlternateBufferActive());
+		assertEquals(describe(mTerminal), describe(restored));
+
+		enterString("\033[?1049l");
+		restored.append("\033[?1049l".getBytes(), 8);
+		assertEquals(describe(mTerminal), describe(restored));
+		assertEquals("main", restored.getScreen().getTranscriptText());
+	}
+
+	public void testWritesOnlyChangedRows() throws IOException {
+		withTerminalSized(10, 4);
+		for (int i = 0; i < 200; i++)
+			enterString("line " + i + "\r\n");
+		TerminalCheckpoint checkpoint = new TerminalCheckpoint(mFile);
+		checkpoint.write(mTerminal);
+		// The transcript and the screens of both buffers:
+		assertEquals(mTerminal.getScreen().getActiveTranscriptRows() + 8, checkpoint.getWrittenRows());
+		long length = mFile.length();
+
+		checkpoint.write(mTerminal);
+		assertEquals(0, checkpoint.getWrittenRows());
+		enterString("line 200\r\nline 201");
+		checkpoint.write(mTerminal);
+		// The changed rows of the screen, the rows scrolled into the transcript keeping their records:
+		assertEquals(2, checkpoint.getWrittenRows());
+		assertTrue(mFile.length() - length < 4096);
+		checkpoint.close();
+		assertEquals(describe(mTerminal), describe(restore()));
+
+		// The restored emulator keeps writing only what changed to the same file:
+		TerminalEmulator restored = restore();
+		restored.append("x".getBytes(), 1);
+		checkpoint = new TerminalCheckpoint(mFile);
+		checkpoint.write(restored);
+		assertEquals(1, checkpoint.getWrittenRows());
+		checkpoint.close();
+		assertEquals(describe(restored), describe(restore()));
+	}
+
+	public void testRewritesFileOfMostlyUnusedRows() throws IOException {
+		withTerminalSized(10, 4);
+		TerminalCheckpoint checkpoint = new TerminalCheckpoint(mFile);
+		// Each checkpoint appends a changed row and the state, of about a kilobyte:
+		for (int i = 0; i < 2000; i++) {
+			enterString("\rline " + i);
+			checkpoint.write(mTerminal);
+		}
+		assertTrue(mFile.length() < 3 << 19);
+		checkpoint.close();
+		assertEquals(describe(mTerminal), describe(restore()));
+	}
+
+	public void testRefusesCorruptFile() throws IOException {
+		Files.write(mFile.toPath(), "not a checkpoint".getBytes());
+		try {
+			restore();
+			fail();
+		} catch (IOException e) {
+			// Expected.
+		}
+	}
+
+	private TerminalEmulator writeAndRestore() throws IOException {
+		try (TerminalCheckpoint checkpoint = new TerminalCheckpoint(mFile)) {
+			checkpoint.write(mTerminal);
+		}
+		return restore();
+	}
+
+	private TerminalEmulator restore() throws IOException {
+		return TerminalCheckpoint.restore(mFile, mOutput, INITIAL_CELL_WIDTH_PIXELS, INITIAL_CELL_HEIGHT_PIXELS, null);
+	}
+
+	/** The text, styles and line wraps of all rows of an emulator, and its cursor. */
+	private static String describe(TerminalEmulator emulator) {
+		TerminalBuffer screen = emulator.getScreen();
+		StringBuilder builder = new StringBuilder();
+		for (int row = -screen.getActiveTranscriptRows(); row < screen.mScreenRows; row++) {
+			builder.append(screen.getSelectedText(0, row, screen.mColumns - 1, row, false, false));
+			for (int column = 0; column < screen.mColumns; column++)
+				builder.append(' ').append(Long.toHexString(screen.getStyleAt(row, column)));
+			builder.append(screen.getLineWrap(row) ? " wrap\n" : "\n");
+		}
+		return builder.append("cursor ").append(emulator.getCursorRow()).append(',').append(emulator.getCursorCol()).toString();
+	}
+
+}
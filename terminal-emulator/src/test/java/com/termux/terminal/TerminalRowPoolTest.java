@@ -0,0 +1,34 @@
+package com.termux.terminal;
+
+public class TerminalRowPoolTest extends TerminalTestCase {
+
+	public void testScrollingReusesArrays() {
+		withTerminalSized(10, 3);
+		TerminalBuffer screen = mTerminal.getScreen();
+		assertEquals(3, screen.getRowAllocations());
+
+		for (int i = 0; i < 100; i++)
+			enterString("line " + i + "\r\n");
+		// The arrays of each row frozen into the transcript go to the next new line, filling the transcript or not.
+		assertEquals(3, screen.getRowAllocations());
+		assertEquals(98, screen.getRowPoolHits());
+		assertLinesAre("line 98   ", "line 99   ", "          ");
+		assertHistoryStartsWith("line 97   ", "line 96   ", "line 95   ");
+	}
+
+	public void testPoolSkipsArraysOfOldWidth() {
+		TerminalRowPool pool = new TerminalRowPool();
+		TerminalRow row = new TerminalRow(10, null, pool, TextStyle.NORMAL);
+		row.freeze();
+		assertEquals(10, new TerminalRow(10, null, pool, TextStyle.NORMAL).mStyleIds.length);
+		assertEquals(1, pool.getHits());
+
+		row.clear(TextStyle.NORMAL);
+		row.freeze();
+		TerminalRow wider = new TerminalRow(20, null, pool, TextStyle.NORMAL);
+		wider.setChar(19, 'a', TextStyle.NORMAL);
+		assertEquals(1, pool.getHits());
+		assertEquals(3, pool.getAllocations());
+	}
+
+}
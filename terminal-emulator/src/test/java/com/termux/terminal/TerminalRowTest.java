@@ -429,4 +429,127 @@ public class TerminalRowTest extends TestCase {
 		// assertEquals(' ', line.mText[line.findStartOfColumn(COLUMNS - 1)]);
 	}
 
+	/** Find the start of a column by scanning the row, as done before the column index was kept. */
+	private static int findStartOfColumnByScanning(TerminalRow row, int column, int columns) {
+		if (column == columns) return row.getSpaceUsed();
+		char[] text = row.mText;
+		int currentColumn = 0;
+		int currentCharIndex = 0;
+		while (true) {
+			int newCharIndex = currentCharIndex;
+			char c = text[newCharIndex++];
+			int codePoint = Character.isHighSurrogate(c) ? Character.toCodePoint(c, text[newCharIndex++]) : c;
+			int wcwidth = WcWidth.width(codePoint);
+			if (wcwidth > 0) {
+				currentColumn += wcwidth;
+				if (currentColumn == column) {
+					while (newCharIndex < row.getSpaceUsed() && WcWidth.width(text, newCharIndex) <= 0)
+						newCharIndex += Character.isHighSurrogate(text[newCharIndex]) ? 2 : 1;
+					return newCharIndex;
+				} else if (currentColumn > column) {
+					return currentCharIndex;
+				}
+			}
+			currentCharIndex = newCharIndex;
+		}
+	}
+
+	public void testColumnIndexFollowsRandomEdits() {
+		int[] codePoints = {'a', 'b', 'ö', DIARESIS_CODEPOINT, ONE_JAVA_CHAR_DISPLAY_WIDTH_TWO_1, ONE_JAVA_CHAR_DISPLAY_WIDTH_TWO_2,
+			TWO_JAVA_CHARS_DISPLAY_WIDTH_TWO_1, TWO_JAVA_CHARS_DISPLAY_WIDTH_ONE_1};
+		Random random = new Random(42);
+		TerminalRow other = new TerminalRow(COLUMNS, TextStyle.NORMAL);
+		for (int i = 0; i < 5000; i++) {
+			if (i % 1000 == 0) row.clear(TextStyle.NORMAL);
+			int codePoint = codePoints[random.nextInt(codePoints.length)];
+			int column = random.nextInt(WcWidth.width(codePoint) == 2 ? COLUMNS - 1 : COLUMNS);
+			if (i % 7 == 0) {
+				other.clear(TextStyle.NORMAL);
+				other.setChar(random.nextInt(COLUMNS - 1), ONE_JAVA_CHAR_DISPLAY_WIDTH_TWO_1, 0);
+				int start = random.nextInt(COLUMNS);
+				int length = random.nextInt(COLUMNS - start + 1);
+				row.copyInterval(other, start, start + length, random.nextInt(COLUMNS - length + 1));
+			} else {
+				row.setChar(column, codePoint, 0);
+			}
+			for (int c = 0; c <= COLUMNS; c++)
+				assertEquals("After edit " + i + " at column " + c, findStartOfColumnByScanning(row, c, COLUMNS), row.findStartOfColumn(c));
+		}
+	}
+
+	public void testFreezeAndThaw() {
+		long red = TextStyle.encode(1, TextStyle.COLOR_INDEX_BACKGROUND, 0);
+		row.setChar(0, 'a', red);
+		row.setChar(1, ONE_JAVA_CHAR_DISPLAY_WIDTH_TWO_1, red);
+		row.setChar(3, TWO_JAVA_CHARS_DISPLAY_WIDTH_ONE_1, TextStyle.NORMAL);
+		row.setChar(COLUMNS - 1, ' ', red);
+		row.freeze();
+
+		assertTrue(row.isFrozen());
+		assertFalse(row.isBlank());
+		assertEquals(4, row.mText.length);
+		assertEquals(red, row.getStyle(0));
+		assertEquals(red, row.getStyle(1));
+		assertEquals(TextStyle.NORMAL, row.getStyle(2));
+		assertEquals(TextStyle.NORMAL, row.getStyle(3));
+		assertEquals(TextStyle.NORMAL, row.getStyle(COLUMNS - 2));
+		assertEquals(red, row.getStyle(COLUMNS - 1));
+
+		// Editing thaws the row.
+		row.setChar(4, 'b', TextStyle.NORMAL);
+		assertFalse(row.isFrozen());
+		assertLineStartsWith('a', ONE_JAVA_CHAR_DISPLAY_WIDTH_TWO_1, TWO_JAVA_CHARS_DISPLAY_WIDTH_ONE_1, 'b', ' ');
+		assertEquals(COLUMNS, row.getSpaceUsed());
+		assertEquals(2, row.findStartOfColumn(3));
+		assertEquals(red, row.getStyle(COLUMNS - 1));
+
+		TerminalRow blank = new TerminalRow(COLUMNS, TextStyle.NORMAL);
+		blank.freeze();
+		assertTrue(blank.isBlank());
+		blank.clear(red);
+		assertFalse(blank.isFrozen());
+		assertEquals(red, blank.getStyle(COLUMNS - 1));
+	}
+
+	public void testReadingFrozenRowLeavesItFrozen() {
+		row.setChar(0, 'a', TextStyle.NORMAL);
+		row.setChar(1, ONE_JAVA_CHAR_DISPLAY_WIDTH_TWO_1, TextStyle.NORMAL);
+		row.setChar(3, TWO_JAVA_CHARS_DISPLAY_WIDTH_ONE_1, TextStyle.NORMAL);
+		int[] expected = new int[COLUMNS + 1];
+		for (int column = 0; column <= COLUMNS; column++)
+			expected[column] = row.findStartOfColumn(column);
+		row.freeze();
+
+		for (int column = 0; column <= COLUMNS; column++)
+			assertEquals("Column " + column, expected[column], row.findStartOfColumn(column));
+		TerminalRow copy = new TerminalRow(COLUMNS, TextStyle.NORMAL);
+		copy.copyInterval(row, 0, 4, 2);
+		assertTrue(row.isFrozen());
+		assertEquals(ONE_JAVA_CHAR_DISPLAY_WIDTH_TWO_1, copy.getText()[3]);
+		try {
+			row.getText();
+			fail();
+		} catch (IllegalStateException e) {
+			// Expected.
+		}
+	}
+
+	/** Rewriting the right half of a wide row, as a full screen program updating a status column would. */
+	public void testRewritingWideCharsKeepsColumnIndex() {
+		final int columns = 300;
+		TerminalRow wideRow = new TerminalRow(columns, TextStyle.NORMAL);
+		for (int column = 0; column < columns; column += 2)
+			wideRow.setChar(column, ONE_JAVA_CHAR_DISPLAY_WIDTH_TWO_1, 0);
+
+		for (int round = 0; round < 3; round++) {
+			for (int column = columns / 2; column < columns; column += 2)
+				wideRow.setChar(column, (round & 1) == 0 ? ONE_JAVA_CHAR_DISPLAY_WIDTH_TWO_2 : ONE_JAVA_CHAR_DISPLAY_WIDTH_TWO_1, 0);
+			for (int column = 0; column < columns; column += 2) {
+				assertEquals(column / 2, wideRow.findStartOfColumn(column));
+				assertEquals(column >= columns / 2 && (round & 1) == 0 ? ONE_JAVA_CHAR_DISPLAY_WIDTH_TWO_2 : ONE_JAVA_CHAR_DISPLAY_WIDTH_TWO_1,
+					wideRow.mText[column / 2]);
+			}
+		}
+	}
+
 }
@@ -0,0 +1,44 @@
+package com.termux.terminal;
+
+import junit.framework.TestCase;
+
+import java.util.concurrent.Semaphore;
+import java.util.concurrent.TimeUnit;
+
+public class TerminalSessionTest extends TestCase {
+
+	public void testWriteLargerThanQueue() throws InterruptedException {
+		TerminalSession session = new TerminalSession("/bin/sh", "/", new String[0], new String[0], null, null);
+		session.mShellPid = 1;
+		// Like the reactor, only drain the queue when asked to:
+		Semaphore flushRequests = new Semaphore(0);
+		session.mRequestFlush = flushRequests::release;
+
+		byte[] paste = new byte[256 * 1024];
+		for (int i = 0; i < paste.length; i++)
+			paste[i] = (byte) (i % 251);
+		Thread mainThread = new Thread(() -> session.write(paste, 0, paste.length));
+		mainThread.setDaemon(true);
+		mainThread.start();
+
+		ByteRing queue = session.mTerminalToProcessIOQueue;
+		try {
+			byte[] buffer = new byte[4096];
+			int total = 0;
+			while (total < paste.length) {
+				assertTrue("Write blocked without asking for a flush", flushRequests.tryAcquire(10, TimeUnit.SECONDS));
+				int read;
+				while ((read = queue.read(buffer, false)) > 0) {
+					for (int i = 0; i < read; i++)
+						assertEquals(paste[total + i], buffer[i]);
+					total += read;
+				}
+			}
+			mainThread.join(10_000);
+			assertFalse(mainThread.isAlive());
+		} finally {
+			queue.close();
+		}
+	}
+
+}
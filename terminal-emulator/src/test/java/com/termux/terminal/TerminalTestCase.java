@@ -149,8 +149,14 @@ public abstract class TerminalTestCase extends TestCase {
 		for (int i = 0; i < lines.length; i++) {
 			if (lines[i] == null) continue;
 			assertTrue("Line exists at multiple places: " + i, linesSet.add(new LineWrapper(lines[i])));
-			char[] text = lines[i].mText;
-			int usedChars = lines[i].getSpaceUsed();
+			TerminalRow line = lines[i];
+			if (line.isFrozen()) {
+				assertTrue("Frozen line with trailing space", line.mText.length == 0 || line.mText[line.mText.length - 1] != ' ');
+				line = new TerminalRow(screen.mColumns, line.mStyleTable, null, TextStyle.NORMAL);
+				lines[i].thawInto(line);
+			}
+			char[] text = line.mText;
+			int usedChars = line.getSpaceUsed();
 			int currentColumn = 0;
 			for (int j = 0; j < usedChars; j++) {
 				char c = text[j];
@@ -168,7 +174,7 @@ public abstract class TerminalTestCase extends TestCase {
 				assertFalse("The first column should not start with combining character", currentColumn == 0 && width < 0);
 				if (width > 0) currentColumn += width;
 			}
-			assertEquals("Line whose width does not match screens. line=" + new String(lines[i].mText, 0, lines[i].getSpaceUsed()),
+			assertEquals("Line whose width does not match screens. line=" + new String(text, 0, usedChars),
 					screen.mColumns, currentColumn);
 		}
 
@@ -181,7 +187,7 @@ public abstract class TerminalTestCase extends TestCase {
 	}
 
 	protected void assertLineIs(int line, String expected) {
-		TerminalRow l = mTerminal.getScreen().allocateFullLineIfNecessary(mTerminal.getScreen().externalToInternalRow(line));
+		TerminalRow l = mTerminal.getScreen().getLineForReading(mTerminal.getScreen().externalToInternalRow(line));
 		char[] chars = l.mText;
 		int textLen = l.getSpaceUsed();
 		if (textLen != expected.length()) fail("Expected '" + expected + "' (len=" + expected.length() + "), was='"
@@ -216,7 +222,7 @@ public abstract class TerminalTestCase extends TestCase {
 	}
 
 	protected TerminalTestCase assertLineStartsWith(int line, int... codePoints) {
-		char[] chars = mTerminal.getScreen().mLines[mTerminal.getScreen().externalToInternalRow(line)].mText;
+		char[] chars = mTerminal.getScreen().getLineForReading(mTerminal.getScreen().externalToInternalRow(line)).mText;
 		int charIndex = 0;
 		for (int i = 0; i < codePoints.length; i++) {
 			int lineCodePoint = chars[charIndex++];
@@ -78,4 +78,20 @@ public class WcWidthTest extends TestCase {
 		assertWidthIs(2, 0x1F643); // UPSIDE-DOWN FACE (Unicode 8).
 	}
 
+	public void testTableMatchesIntervalsOnAllPlanes() {
+		for (int codePoint = 0; codePoint <= 0x10FFFF; codePoint++) {
+			if (WcWidth.width(codePoint) != WcWidth.widthFromIntervals(codePoint)) {
+				fail("Width of 0x" + Integer.toHexString(codePoint) + " from table is " + WcWidth.width(codePoint)
+					+ ", from intervals " + WcWidth.widthFromIntervals(codePoint));
+			}
+		}
+	}
+
+	public void testOutOfRange() {
+		assertWidthIs(0, -1);
+		assertWidthIs(0, Integer.MIN_VALUE);
+		assertWidthIs(1, 0x110000);
+		assertWidthIs(1, Integer.MAX_VALUE);
+	}
+
 }
@@ -0,0 +1,155 @@
+/*
+ * Host test of the fd sweep in termux.c, which the JVM unit tests cannot load. With thousands of fds open it checks that
+ * a child spawned by clone_subprocess() inherits nothing but stdio, and that every strategy of sweep_fds() leaves no fd
+ * behind, printing how long each one takes. Built and run by the fdSweepHostTest task of terminal-emulator/build.gradle:
+ *
+ *   cc -std=c11 -Wall -Wextra -Werror -I$JAVA_HOME/include -I$JAVA_HOME/include/linux -o fd_sweep_test fd_sweep_test.c
+ */
+#include "../../main/jni/termux.c"
+
+/** The number of fds held open, without FD_CLOEXEC, while spawning. */
+#define OPEN_FDS 5000
+
+static int failures;
+
+static void check(int condition, char const* format, int value)
+{
+    if (condition) return;
+    fprintf(stderr, "FAILED: ");
+    fprintf(stderr, format, value);
+    fputc('\n', stderr);
+    failures++;
+}
+
+/** Count the open fds >= lowest_fd by asking for the flags of every fd below the limit, which allocates nothing. */
+static int count_open_fds(int lowest_fd)
+{
+    struct rlimit limit;
+    getrlimit(RLIMIT_NOFILE, &limit);
+    int count = 0;
+    for (int fd = lowest_fd; fd < (int) limit.rlim_cur; fd++)
+        if (fcntl(fd, F_GETFD) != -1) count++;
+    return count;
+}
+
+struct sweep_result {
+    int leaked;
+    int64_t nanos;
+};
+
+static int64_t monotonic_nanos(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+/** Sweep with the given strategy in a forked child, which reports back over a pipe moved to its stdout. */
+static void test_strategy(char const* name, struct fd_sweep const* sweep)
+{
+    int result_pipe[2];
+    if (pipe(result_pipe) != 0) {
+        perror("pipe");
+        exit(1);
+    }
+    pid_t pid = fork();
+    if (pid == 0) {
+        dup2(result_pipe[1], 1);
+        int64_t start = monotonic_nanos();
+        sweep_fds(sweep, 3);
+        struct sweep_result result = { .nanos = monotonic_nanos() - start };
+        result.leaked = count_open_fds(3);
+        _exit(write(1, &result, sizeof(result)) == sizeof(result) ? 0 : 1);
+    }
+    close(result_pipe[1]);
+    struct sweep_result result;
+    ssize_t bytes_read = read(result_pipe[0], &result, sizeof(result));
+    close(result_pipe[0]);
+    int status;
+    waitpid(pid, &status, 0);
+    check(bytes_read == sizeof(result) && WIFEXITED(status) && WEXITSTATUS(status) == 0, "sweeping child exited with status %d", status);
+    if (bytes_read != sizeof(result)) return;
+
+    printf("%-12s %d fds left open, swept in %.2f ms\n", name, result.leaked, result.nanos / 1e6);
+    check(result.leaked == 0, "fds left open by the sweep: %d", result.leaked);
+}
+
+/** Spawn this executable on a pseudoterminal the way sessions are spawned, and read how many fds it inherited. */
+static void test_spawn(void)
+{
+    char devname[64];
+    char const* error = NULL;
+    int ptm = open_pty_master(devname, sizeof(devname), 24, 80, 0, 0, &error);
+    if (ptm < 0) {
+        printf("spawn        skipped: %s\n", error);
+        return;
+    }
+    // Leave the master open across exec as well, as an app may have done with any fd.
+    fcntl(ptm, F_SETFD, 0);
+
+    char* argv[] = { "fd_sweep_test", "--count-fds", NULL };
+    char* envp[] = { NULL };
+    int64_t start = monotonic_nanos();
+    pid_t pid = clone_subprocess("/proc/self/exe", "/", devname, argv, envp);
+    int64_t spawn_nanos = monotonic_nanos() - start;
+    check(pid > 0, "clone_subprocess() returned %d", pid);
+    if (pid <= 0) {
+        close(ptm);
+        return;
+    }
+
+    char output[64] = { 0 };
+    size_t length = 0;
+    while (length < sizeof(output) - 1 && !memchr(output, '\n', length)) {
+        ssize_t bytes_read = read(ptm, output + length, sizeof(output) - 1 - length);
+        if (bytes_read <= 0) break;
+        length += (size_t) bytes_read;
+    }
+    int status;
+    waitpid(pid, &status, 0);
+    close(ptm);
+
+    int inherited = length > 0 ? atoi(output) : -1;
+    printf("spawn        %d fds inherited, clone_subprocess() took %.2f ms\n", inherited, spawn_nanos / 1e6);
+    check(inherited == 0, "fds inherited by the spawned child: %d", inherited);
+}
+
+int main(int argc, char** argv)
+{
+    if (argc > 1 && strcmp(argv[1], "--count-fds") == 0) {
+        printf("%d\n", count_open_fds(3));
+        return 0;
+    }
+
+    // Leave room for the fds and for the rlimit loop, which is only used up to FD_SWEEP_MAX_LOOP_LIMIT.
+    struct rlimit limit;
+    getrlimit(RLIMIT_NOFILE, &limit);
+    limit.rlim_cur = limit.rlim_max == RLIM_INFINITY || limit.rlim_max > 16384 ? 16384 : limit.rlim_max;
+    if (setrlimit(RLIMIT_NOFILE, &limit) != 0 || limit.rlim_cur < OPEN_FDS + 16) {
+        fprintf(stderr, "Cannot raise RLIMIT_NOFILE above %d\n", OPEN_FDS + 16);
+        return 1;
+    }
+    for (int i = 0; i < OPEN_FDS; i++) {
+        if (open("/dev/null", O_RDONLY) < 0) {
+            perror("open");
+            return 1;
+        }
+    }
+
+    struct fd_sweep chosen = prepare_fd_sweep();
+    printf("%d fds open, sweeping with %s\n", OPEN_FDS, chosen.strategy == FD_SWEEP_CLOSE_RANGE ? "close_range"
+            : chosen.strategy == FD_SWEEP_LOOP ? "the rlimit loop" : "/proc/self/fd");
+
+    if (close_range_supported) {
+        test_strategy("close_range", &(struct fd_sweep) { .strategy = FD_SWEEP_CLOSE_RANGE });
+    } else {
+        printf("close_range  skipped: not supported by this kernel\n");
+    }
+    test_strategy("rlimit loop", &(struct fd_sweep) { .strategy = FD_SWEEP_LOOP, .limit = (int) limit.rlim_cur });
+    test_strategy("/proc", &(struct fd_sweep) { .strategy = FD_SWEEP_PROC });
+    test_spawn();
+
+    if (failures) return 1;
+    printf("OK\n");
+    return 0;
+}
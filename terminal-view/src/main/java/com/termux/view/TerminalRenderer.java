@@ -80,8 +80,8 @@ public final class TerminalRenderer {
                 selx2 = (row == selectionY2) ? selectionX2 : mEmulator.mColumns;
             }
 
-            TerminalRow lineObject = screen.allocateFullLineIfNecessary(screen.externalToInternalRow(row));
-            final char[] line = lineObject.mText;
+            TerminalRow lineObject = screen.getLineForReading(screen.externalToInternalRow(row));
+            final char[] line = lineObject.getText();
             final int charsUsedInLine = lineObject.getSpaceUsed();
 
             long lastRunStyle = 0;